@@ -0,0 +1,133 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_ATTACHMENT_STREAM_H
+#define LIBMATROSKA_ATTACHMENT_STREAM_H
+
+#include <string>
+#include <vector>
+
+#include <ebml/EbmlElement.h>
+#include <ebml/EbmlStream.h>
+#include <ebml/IOCallback.h>
+
+#include "matroska/KaxConfig.h"
+
+namespace libmatroska {
+
+class KaxAttached;
+class KaxSegment;
+
+/*!
+  \brief an AttachedFile whose FileData was left in the file
+*/
+struct MATROSKA_DLL_API KaxAttachmentEntry {
+  std::string   Name;        ///< FileName, in UTF-8
+  std::string   MediaType;
+  std::string   Description; ///< FileDescription, in UTF-8
+  std::uint64_t UID{0};
+  std::uint64_t DataPosition{0}; ///< position of the FileData content in the file
+  std::uint64_t DataSize{0};
+};
+
+/*!
+  \brief read-only view of \a aSize octets of another IOCallback, starting at \a aStart
+  \note the source position is set before each read, views of the same source can be used in turn
+*/
+class MATROSKA_DLL_API KaxFileDataIOCallback : public libebml::IOCallback {
+  public:
+    KaxFileDataIOCallback(libebml::IOCallback & aSource, std::uint64_t aStart, std::uint64_t aSize)
+      :Source(aSource), Start(aStart), Size(aSize)
+    {}
+
+    std::size_t read(void *Buffer, std::size_t Size) override;
+    void setFilePointer(std::int64_t Offset, libebml::seek_mode Mode = libebml::seek_beginning) override;
+    /// \note throws, the view is read-only
+    std::size_t write(const void *Buffer, std::size_t Size) override;
+    std::uint64_t getFilePointer() override { return Position; }
+    void close() override {}
+
+    std::uint64_t GetSize() const { return Size; }
+
+  private:
+    libebml::IOCallback & Source;
+    const std::uint64_t   Start;
+    const std::uint64_t   Size;
+    std::uint64_t         Position{0};
+};
+
+/*!
+  \brief read the attachments of a Segment without loading their data
+
+  Only the small children of each AttachedFile are read, the position and
+  size of its FileData are kept to read the data on demand.
+
+  \code
+  KaxAttachmentReader reader(stream, *Segment);
+  reader.Read(loader.GetPosition(EBML_INFO(KaxAttachments)));
+  for (const auto & File : reader.GetAttachments()) {
+    auto Data = reader.OpenData(File);
+    ...
+  }
+  \endcode
+*/
+class MATROSKA_DLL_API KaxAttachmentReader {
+  public:
+    KaxAttachmentReader(libebml::EbmlStream & aStream, const KaxSegment & aSegment);
+
+    /*!
+      \brief read the Attachments element at \a Position in the file
+      \return false if there is no Attachments element at this position
+    */
+    bool Read(std::uint64_t Position);
+
+    const std::vector<KaxAttachmentEntry> & GetAttachments() const { return Attachments; }
+
+    /// \return the data of the attached file, read from the stream
+    KaxFileDataIOCallback OpenData(const KaxAttachmentEntry & Entry) const;
+
+  private:
+    libebml::EbmlStream &           Stream;
+    const KaxSegment &              Segment;
+    std::vector<KaxAttachmentEntry> Attachments;
+
+    void ReadAttached(const libebml::EbmlElement & Attached);
+};
+
+/*!
+  \brief write an Attachments element whose FileData are copied from other IOCallbacks
+
+  The data of the files are copied by chunks when rendering, they are never
+  all in memory. The sizes of the elements are coded on 8 octets since
+  they are known before the data are read.
+*/
+class MATROSKA_DLL_API KaxAttachmentWriter {
+  public:
+    /*!
+      \param aAttached the AttachedFile without a FileData, it must stay valid until rendered
+      \param aData the \a aSize octets of the file are read from its current position when rendering
+    */
+    void AddFile(KaxAttached & aAttached, libebml::IOCallback & aData, std::uint64_t aSize);
+
+    /*!
+      \return the size of the Attachments element written
+      \note throws if a file has less data than announced
+    */
+    std::uint64_t Render(libebml::IOCallback & output, const libebml::EbmlElement::ShouldWrite & writeFilter = libebml::EbmlElement::WriteSkipDefault);
+
+  private:
+    struct File {
+      KaxAttached *         Attached;
+      libebml::IOCallback * Data;
+      std::uint64_t         Size;
+    };
+    std::vector<File> Files;
+};
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_ATTACHMENT_STREAM_H
@@ -10,9 +10,12 @@
 #ifndef LIBMATROSKA_BLOCK_H
 #define LIBMATROSKA_BLOCK_H
 
+#include <memory>
 #include <vector>
 
 #include "matroska/KaxTypes.h"
+#include "matroska/KaxClusterArena.h"
+#include "matroska/KaxSmallVector.h"
 #include <ebml/EbmlBinary.h>
 #include <ebml/EbmlMaster.h>
 #include "matroska/KaxTracks.h"
@@ -24,6 +27,8 @@ class KaxCluster;
 class KaxReferenceBlock;
 class KaxInternalBlock;
 class KaxBlockBlob;
+class KaxTrackEncoding;
+struct KaxFrameView;
 
 class MATROSKA_DLL_API DataBuffer {
   protected:
@@ -52,11 +57,38 @@ class MATROSKA_DLL_API DataBuffer {
         myBuffer = aBuffer;
     }
 
+    DataBuffer(const DataBuffer &) = default;
+    DataBuffer & operator=(const DataBuffer &) = default;
+    /*!
+      \note the moved buffer is left empty, only the new one frees the data
+    */
+    DataBuffer(DataBuffer && Other) noexcept
+      :myBuffer(Other.myBuffer)
+      ,mySize(Other.mySize)
+      ,bValidValue(Other.bValidValue)
+      ,myFreeBuffer(Other.myFreeBuffer)
+      ,bInternalBuffer(Other.bInternalBuffer)
+    {
+      Other.Forget();
+    }
+    DataBuffer & operator=(DataBuffer && Other) noexcept
+    {
+      if (this != &Other) {
+        myBuffer        = Other.myBuffer;
+        mySize          = Other.mySize;
+        bValidValue     = Other.bValidValue;
+        myFreeBuffer    = Other.myFreeBuffer;
+        bInternalBuffer = Other.bInternalBuffer;
+        Other.Forget();
+      }
+      return *this;
+    }
+
     virtual ~DataBuffer() = default;
-    virtual libebml::binary * Buffer() {assert(bValidValue); return myBuffer;}
-    virtual std::uint32_t & Size() {return mySize;};
-    virtual const libebml::binary * Buffer() const {assert(bValidValue); return myBuffer;}
-    virtual std::uint32_t Size()   const {return mySize;};
+    libebml::binary * Buffer() {assert(bValidValue); return myBuffer;}
+    std::uint32_t & Size() {return mySize;};
+    const libebml::binary * Buffer() const {assert(bValidValue); return myBuffer;}
+    std::uint32_t Size()   const {return mySize;};
     bool    FreeBuffer(const DataBuffer & aBuffer) {
       bool bResult = true;
       if (myBuffer && bValidValue) {
@@ -72,6 +104,50 @@ class MATROSKA_DLL_API DataBuffer {
     }
 
     virtual DataBuffer * Clone();
+
+  private:
+    void Forget() {
+      myBuffer        = nullptr;
+      mySize          = 0;
+      bValidValue     = false;
+      myFreeBuffer    = nullptr;
+      bInternalBuffer = false;
+    }
+};
+
+/*!
+  \brief frame data given to a Block without copy
+
+  The frame either belongs to the caller, belongs to the FrameBuffer
+  (e.g. the output of an encoder) or is part of a shared memory area kept
+  alive by the FrameBuffer. It is moved in the Block with the AddFrame()
+  variants taking a FrameBuffer, no other allocation is done.
+*/
+class MATROSKA_DLL_API FrameBuffer final : public DataBuffer {
+  public:
+    /// the data must be kept until the frames of the Block are released
+    FrameBuffer(libebml::binary * aBuffer, std::uint32_t aSize)
+      :DataBuffer(aBuffer, aSize)
+    {}
+    /// the data is freed with the FrameBuffer
+    FrameBuffer(std::unique_ptr<libebml::binary[]> aBuffer, std::uint32_t aSize)
+      :DataBuffer(aBuffer.get(), aSize)
+      ,myData(std::move(aBuffer))
+    {}
+    /// \a aOwner keeps the memory of \a aBuffer alive as long as the frame is used
+    FrameBuffer(std::shared_ptr<const void> aOwner, libebml::binary * aBuffer, std::uint32_t aSize)
+      :DataBuffer(aBuffer, aSize)
+      ,myOwner(std::move(aOwner))
+    {}
+    FrameBuffer(FrameBuffer &&) noexcept = default;
+    FrameBuffer & operator=(FrameBuffer &&) noexcept = default;
+    FrameBuffer(const FrameBuffer &) = delete;
+    FrameBuffer & operator=(const FrameBuffer &) = delete;
+    ~FrameBuffer() override = default;
+
+  private:
+    std::unique_ptr<libebml::binary[]> myData;
+    std::shared_ptr<const void>        myOwner;
 };
 
 class MATROSKA_DLL_API SimpleDataBuffer : public DataBuffer {
@@ -114,6 +190,7 @@ class MATROSKA_DLL_API NotSoSimpleDataBuffer : public SimpleDataBuffer {
 */
 
 DECLARE_MKX_MASTER(KaxBlockGroup)
+    MATROSKA_ARENA_ALLOCATED
   public:
     ~KaxBlockGroup() override = default;
 
@@ -132,8 +209,19 @@ DECLARE_MKX_MASTER(KaxBlockGroup)
     bool AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, DataBuffer & buffer, const KaxBlockGroup & PastBlock, const KaxBlockGroup & ForwBlock, LacingType lacing = LACING_AUTO);
     bool AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, DataBuffer & buffer, const KaxBlockBlob * PastBlock, const KaxBlockBlob * ForwBlock, LacingType lacing = LACING_AUTO);
 
+    /*!
+      \brief same as the DataBuffer variants, the frame is moved in the Block
+    */
+    bool AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, FrameBuffer && buffer, LacingType lacing = LACING_AUTO);
+    bool AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, FrameBuffer && buffer, const KaxBlockGroup & PastBlock, LacingType lacing = LACING_AUTO);
+    bool AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, FrameBuffer && buffer, const KaxBlockGroup & PastBlock, const KaxBlockGroup & ForwBlock, LacingType lacing = LACING_AUTO);
+
+    /// \see KaxInternalBlock::SetParent()
     void SetParent(KaxCluster & aParentCluster);
 
+    /// \note the elements read are counted in KaxStats when the library is built with ENABLE_STATS
+    void Read(libebml::EbmlStream & inDataStream, const libebml::EbmlSemanticContext & Context, int & UpperEltFound, libebml::EbmlElement * & FoundElt, bool AllowDummyElt, libebml::ScopeMode ReadFully = libebml::SCOPE_ALL_DATA) override;
+
     void SetParentTrack(const KaxTrackEntry & aParentTrack) {
       ParentTrack = &aParentTrack;
     }
@@ -178,6 +266,7 @@ DECLARE_MKX_MASTER(KaxBlockGroup)
 };
 
 class MATROSKA_DLL_API KaxInternalBlock : public libebml::EbmlBinary {
+    MATROSKA_ARENA_ALLOCATED
   public:
     KaxInternalBlock(const libebml::EbmlCallbacks & classInfo)
       :libebml::EbmlBinary(classInfo)
@@ -195,10 +284,32 @@ class MATROSKA_DLL_API KaxInternalBlock : public libebml::EbmlBinary {
     */
     std::uint64_t GlobalTimestamp() const {return Timestamp;}
 
+    /*!
+      \brief change the track of the Block, e.g. when remuxing
+      \note the frames of a Block read are kept as they are, see IsRawPassthrough()
+    */
+    void SetTrackNum(std::uint16_t aTrackNumber) { TrackNumber = aTrackNumber; }
+    /*!
+      \brief change the timestamp of the Block, in nanoseconds
+      \note the local timestamp is computed from the parent Cluster when rendering
+    */
+    void SetGlobalTimestamp(std::uint64_t aTimestamp) { Timestamp = aTimestamp; bLocalTimestampUsed = false; }
+
+    /*!
+      \return true if the Block was read fully and is rendered with its lace head and frames
+      as they were read, only the track number, timestamp and flags are coded again
+      \note adding or releasing frames ends the passthrough
+    */
+    bool IsRawPassthrough() const { return myRawPayload != nullptr; }
+
     /*!
       \note override this function to generate the Data/Size on the fly, unlike the usual binary elements
     */
     libebml::filepos_t UpdateSize(const ShouldWrite & writeFilter = WriteSkipDefault, bool bForceRender = false) override;
+    /*!
+      \note when \a input is a KaxSharedMemReadIOCallback the payload is not copied,
+      the frames point directly in its memory which is kept alive until ReleaseFrames()
+    */
     libebml::filepos_t ReadData(libebml::IOCallback & input, libebml::ScopeMode ReadFully = libebml::SCOPE_ALL_DATA) override;
 
     /*!
@@ -208,15 +319,62 @@ class MATROSKA_DLL_API KaxInternalBlock : public libebml::EbmlBinary {
     std::uint64_t ReadInternalHead(libebml::IOCallback & input);
 
     unsigned int NumberFrames() const { return SizeList.size();}
-    DataBuffer & GetBuffer(unsigned int iIndex) {return *myBuffers[iIndex];}
+    /*!
+      \note after a SCOPE_PARTIAL_DATA read the frame must be loaded with LoadFrame() first
+      \note the DataBuffer of the frames read are created on the first call, use GetFrameData() to avoid it
+    */
+    DataBuffer & GetBuffer(unsigned int iIndex);
+
+    /*!
+      \brief access the data of a frame without creating a DataBuffer
+      \return nullptr if the frame is not available
+    */
+    const libebml::binary * GetFrameData(unsigned int iIndex, std::uint32_t & Size) const;
+
+    /*!
+      \brief read the data of a single frame, e.g. after a SCOPE_PARTIAL_DATA read
+      \param input the stream the Block was read from, a KaxCachedIOCallback can be shared by the Blocks
+      \return the frame, also available with GetBuffer() until the frames are released
+      \note the input is left after the frame data, nothing is read if the frame is already loaded
+    */
+    DataBuffer & LoadFrame(libebml::IOCallback & input, unsigned int iIndex);
+    /// \return true if the frame data can be accessed with GetBuffer()
+    bool IsFrameLoaded(unsigned int iIndex) const;
 
+    /*!
+      \brief get a frame decoded with the ContentEncodings of its track
+      \return false if the frame is not loaded or can't be decoded
+      \note no copy is done for header stripping
+    */
+    bool GetDecodedFrame(unsigned int iIndex, KaxTrackEncoding & Encoding, KaxFrameView & View) const;
+
+    /*!
+      \note on a Block read the frames read are kept before the new one, the ones not loaded
+      after a SCOPE_PARTIAL_DATA read are dropped, and buffers from GetBuffer() are invalidated
+    */
     bool AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, DataBuffer & buffer, LacingType lacing = LACING_AUTO, bool invisible = false);
+    /*!
+      \brief add a frame moved in the Block, no allocation is done for the usual lace sizes
+    */
+    bool AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, FrameBuffer && buffer, LacingType lacing = LACING_AUTO, bool invisible = false);
+
+    /*!
+      \brief keep a frame in the Block until its frames are released
+      \return the stored frame, to give to AddFrame()
+    */
+    DataBuffer & StoreFrame(FrameBuffer && buffer);
 
     /*!
       \brief release all the frames of all Blocks
     */
     void ReleaseFrames();
 
+    /*!
+      \brief set the Cluster of the Block, the timestamp of a Block read is computed from the first Cluster set
+      \note to move a Block read to another Cluster, e.g. when it's rendered as is in a remux,
+      first call it with the Cluster it was read from, or call SetGlobalTimestamp(),
+      the local timestamp is then computed from the new Cluster when rendering
+    */
     void SetParent(KaxCluster & aParentCluster);
 
     /*!
@@ -242,6 +400,8 @@ class MATROSKA_DLL_API KaxInternalBlock : public libebml::EbmlBinary {
 
     std::uint64_t ClusterPosition() const;
 
+    const KaxCluster *GetParentCluster() const { return ParentCluster; }
+
     /*!
      * \return Get the timestamp as written in the Block (not scaled).
      * \since LIBMATROSKA_VERSION >= 0x010700
@@ -254,8 +414,21 @@ class MATROSKA_DLL_API KaxInternalBlock : public libebml::EbmlBinary {
     LacingType GetCurrentLacing() const { return mLacing; }
 
   protected:
-    std::vector<DataBuffer *> myBuffers;
-    std::vector<std::int32_t> SizeList;
+    /// frames kept inside the Block, allocations only happen for larger laces
+    static constexpr std::size_t InlineFrames = 8;
+    /// Blocks up to this size are rendered with a single write when the output is not vectored
+    static constexpr std::size_t RenderBufferSize = 2048;
+    /// octets read at once for the Block head and lace sizes when reading with SCOPE_PARTIAL_DATA
+    static constexpr std::size_t PartialReadSize = 256;
+
+    KaxSmallVector<DataBuffer *, InlineFrames>   myBuffers; ///< frames to render
+    KaxSmallVector<std::int32_t, InlineFrames>   SizeList;  ///< size of the frames read
+    KaxSmallVector<std::uint32_t, InlineFrames>  FrameOffsets; ///< offset of the frames read from the first one
+    KaxSmallVector<FrameBuffer, InlineFrames>    myFrames; ///< storage of the frames moved in, pointed to by myBuffers
+    /// DataBuffer of the frames read, created by GetBuffer() or LoadFrame(), without data when not loaded
+    KaxSmallVector<FrameBuffer, InlineFrames>    myReadFrames;
+    /// first frame of a Block read with SCOPE_ALL_DATA, the frames are described by SizeList and FrameOffsets
+    const libebml::binary *   myFrameData{nullptr};
     std::uint64_t             Timestamp; // temporary timestamp of the first frame, non scaled
     std::int16_t              LocalTimestamp;
     bool                      bLocalTimestampUsed{false};
@@ -266,6 +439,42 @@ class MATROSKA_DLL_API KaxInternalBlock : public libebml::EbmlBinary {
 
     KaxCluster               *ParentCluster{nullptr};
 
+    /// lacing and lace head used for writing, computed once until frames are added or released
+    LacingType                myRenderLacing{LACING_NONE};
+    KaxSmallVector<libebml::binary, 32> myLaceHead;
+    std::uint64_t             myFramesSize{0};
+    bool                      bLacingPrepared{false};
+    void PrepareLacing();
+
+    /// lace head and frames as read, after the track number, timestamp and flags
+    const libebml::binary *   myRawPayload{nullptr};
+    std::size_t               myRawPayloadSize{0};
+
+    /*!
+      \brief code the track number, timestamp and flags of the Block
+      \return the size of the head
+    */
+    std::size_t RenderHead(libebml::binary (&BlockHead)[5]) const;
+
+    /// \return true if the frame is stored in myFrames
+    bool OwnsFrame(const DataBuffer * Buffer) const;
+
+    /// move the frames read in the frames to render
+    void KeepReadFrames();
+
+    /// \return false if the sizes of the frames read don't fill the \a PayloadSize octets after the lace head
+    bool SetFrameOffsets(std::uint64_t PayloadSize);
+
+    /*!
+      \brief decode the Block head and the lace sizes from \a Available octets of memory
+      \return the size of the head, lace sizes included, 0 if the lace sizes go past \a Available
+      \note throws SafeReadIOCallback::EndOfStreamX if the data are invalid
+    */
+    std::size_t DecodeHead(const libebml::binary * Buffer, std::size_t Available);
+
+    /// memory the frames point to when read without copy from a KaxSharedMemReadIOCallback
+    std::shared_ptr<const libebml::binary> SharedData;
+
     libebml::filepos_t RenderData(libebml::IOCallback & output, bool bForceRender, const ShouldWrite & writeFilter = WriteSkipDefault) override;
 };
 
@@ -284,6 +493,7 @@ DECLARE_xxx_BASE(KaxSimpleBlock, MATROSKA_DLL_API, KaxInternalBlock)
     bool IsKeyframe() const    { return bIsKeyframe; }
     bool IsDiscardable() const { return bIsDiscardable; }
 
+    /// \see KaxInternalBlock::SetParent()
     void SetParent(KaxCluster & aParentCluster);
 
     MATROSKA_CLASS_BODY(KaxSimpleBlock)
@@ -314,8 +524,12 @@ public:
 
   void SetParent(KaxCluster & aParentCluster);
   bool AddFrameAuto(const KaxTrackEntry & track, std::uint64_t timestamp, DataBuffer & buffer, LacingType lacing = LACING_AUTO, const KaxBlockBlob * PastBlock = nullptr, const KaxBlockBlob * ForwBlock = nullptr);
+  /// same as the DataBuffer variant, the frame is moved in the Block
+  bool AddFrameAuto(const KaxTrackEntry & track, std::uint64_t timestamp, FrameBuffer && buffer, LacingType lacing = LACING_AUTO, const KaxBlockBlob * PastBlock = nullptr, const KaxBlockBlob * ForwBlock = nullptr);
 
   bool IsSimpleBlock() const {return bUseSimpleBlock;}
+  /// \return false until a frame is added or a BlockGroup is set
+  bool HasBlock() const {return Block.group != nullptr;}
 
   bool ReplaceSimpleByGroup();
 protected:
@@ -8,6 +8,8 @@
 #ifndef LIBMATROSKA_BLOCK_ADDITIONAL_H
 #define LIBMATROSKA_BLOCK_ADDITIONAL_H
 
+#include <memory>
+
 #include "matroska/KaxTypes.h"
 #include <ebml/EbmlMaster.h>
 #include <ebml/EbmlUInteger.h>
@@ -21,14 +23,25 @@ namespace libmatroska {
   \brief element used for B frame-likes
 */
 DECLARE_MKX_SINTEGER_CONS(KaxReferenceBlock)
+    MATROSKA_ARENA_ALLOCATED
   public:
-        ~KaxReferenceBlock() override;
+        ~KaxReferenceBlock() override = default;
     /*!
       \brief override this method to compute the timestamp value
     */
     libebml::filepos_t UpdateSize(const ShouldWrite & writeFilter = WriteSkipDefault, bool bForceRender = false) override;
 
-    const KaxBlockBlob & RefBlock() const;
+    /*!
+      \deprecated use ReferencedBlock(), a BlockGroup set with SetReferencedBlock() is seen through a KaxBlockBlob that doesn't own it
+      \note a Block must be referenced
+    */
+    [[deprecated("use ReferencedBlock()")]] const KaxBlockBlob & RefBlock() const;
+    /// \return the Block referenced, nullptr if only the timestamp was set
+    const KaxInternalBlock * ReferencedBlock() const;
+    /*!
+      \brief reference a Block, its timestamp is read when the size is updated
+      \note the referenced Block is not owned, it must be valid until this element is rendered
+    */
     void SetReferencedBlock(const KaxBlockBlob * aRefdBlock);
     void SetReferencedBlock(const KaxBlockGroup & aRefdBlock);
     void SetParentBlock(const KaxBlockGroup & aParentBlock) {ParentBlock = &aParentBlock;}
@@ -36,10 +49,10 @@ DECLARE_MKX_SINTEGER_CONS(KaxReferenceBlock)
 
   protected:
     const KaxBlockBlob * RefdBlock{nullptr};
+    const KaxBlockGroup * RefdGroup{nullptr};
     const KaxBlockGroup * ParentBlock{nullptr};
+    mutable std::shared_ptr<const KaxBlockBlob> GroupBlob; ///< only created by RefBlock()
     bool bTimestampSet{false};
-        bool bOurBlob{false};
-        void FreeBlob();
 };
 
 } // namespace libmatroska
@@ -0,0 +1,72 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_CACHED_IO_CALLBACK_H
+#define LIBMATROSKA_CACHED_IO_CALLBACK_H
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include <ebml/IOCallback.h>
+
+#include "matroska/KaxConfig.h"
+
+namespace libmatroska {
+
+/*!
+  \brief Read-only IOCallback keeping the last pages read from another IOCallback
+
+  Small reads close to each other, like the heads of Blocks and their frames loaded
+  with KaxInternalBlock::LoadFrame(), are served from memory. Reads of a page size
+  or more go directly to the source.
+
+  \note the source must not be modified while cached, see Invalidate()
+*/
+class MATROSKA_DLL_API KaxCachedIOCallback : public libebml::IOCallback {
+  public:
+    /*!
+      \param aPageSize size of the blocks read from the source
+      \param aMaxPages number of pages kept, the least recently used ones are dropped first
+    */
+    KaxCachedIOCallback(libebml::IOCallback & aSource, std::size_t aPageSize = 64 * 1024, std::size_t aMaxPages = 32);
+    ~KaxCachedIOCallback() override = default;
+
+    std::size_t read(void *Buffer, std::size_t Size) override;
+    void setFilePointer(std::int64_t Offset, libebml::seek_mode Mode = libebml::seek_beginning) override;
+    std::size_t write(const void *Buffer, std::size_t Size) override;
+    std::uint64_t getFilePointer() override { return Position; }
+    void close() override;
+
+    /// drop all the cached pages
+    void Invalidate();
+
+    std::uint64_t CacheHits() const { return Hits; }
+    std::uint64_t CacheMisses() const { return Misses; }
+
+  private:
+    struct Page {
+      std::uint64_t                Index;
+      std::vector<libebml::binary> Data; ///< shorter than a page at the end of the source
+    };
+
+    libebml::IOCallback & Source;
+    const std::size_t     PageSize;
+    const std::size_t     MaxPages;
+    std::uint64_t         Position;
+
+    std::list<Page> Pages; ///< most recently used first
+    std::unordered_map<std::uint64_t, std::list<Page>::iterator> PageMap;
+    std::uint64_t   Hits{0};
+    std::uint64_t   Misses{0};
+
+    const Page & GetPage(std::uint64_t Index);
+};
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_CACHED_IO_CALLBACK_H
@@ -10,6 +10,8 @@
 #ifndef LIBMATROSKA_CLUSTER_H
 #define LIBMATROSKA_CLUSTER_H
 
+#include <unordered_map>
+
 #include "matroska/KaxTypes.h"
 #include <ebml/EbmlMaster.h>
 #include "matroska/KaxTracks.h"
@@ -43,11 +45,45 @@ DECLARE_MKX_MASTER_CONS(KaxCluster)
     */
     bool AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, DataBuffer & buffer, KaxBlockGroup * & MyNewBlock, const KaxBlockGroup & PastBlock, const KaxBlockGroup & ForwBlock, LacingType lacing = LACING_AUTO);
 
+    /*!
+      \brief same as the DataBuffer variants, the frame is moved in the Block without copy
+    */
+    bool AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, FrameBuffer && buffer, KaxBlockGroup * & MyNewBlock, LacingType lacing = LACING_AUTO);
+    bool AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, FrameBuffer && buffer, KaxBlockGroup * & MyNewBlock, const KaxBlockGroup & PastBlock, LacingType lacing = LACING_AUTO);
+    bool AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, FrameBuffer && buffer, KaxBlockGroup * & MyNewBlock, const KaxBlockGroup & PastBlock, const KaxBlockGroup & ForwBlock, LacingType lacing = LACING_AUTO);
+
+    /// \note the elements read are counted in KaxStats when the library is built with ENABLE_STATS
+    void Read(libebml::EbmlStream & inDataStream, const libebml::EbmlSemanticContext & Context, int & UpperEltFound, libebml::EbmlElement * & FoundElt, bool AllowDummyElt, libebml::ScopeMode ReadFully = libebml::SCOPE_ALL_DATA) override;
+
     /*!
       \brief Render the data to the stream and retrieve the position of BlockGroups for later cue entries
     */
     libebml::filepos_t Render(libebml::IOCallback & output, KaxCues & CueToUpdate, const ShouldWrite& writeFilter = WriteSkipDefault);
 
+    /*!
+      \brief First step of Render(): set the ClusterTimestamp, add the Blobs as children and compute the size
+      \return the size of the whole Cluster element, as it will be rendered with the same \a writeFilter
+      \note optional, done by RenderBlocks() when not called before
+    */
+    std::uint64_t PrepareRender(const ShouldWrite& writeFilter = WriteSkipDefault);
+
+    /*!
+      \brief Second step of Render(): render the data to the stream, without touching the Cues
+      \note it only reads the Cluster and its Blocks, so Clusters can be rendered in parallel, see KaxClusterPipeline
+    */
+    libebml::filepos_t RenderBlocks(libebml::IOCallback & output, const ShouldWrite& writeFilter = WriteSkipDefault);
+
+    /*!
+      \brief Last step of Render(): retrieve the position of the Blocks rendered with RenderBlocks() for the cue entries
+    */
+    void UpdateCues(KaxCues & CueToUpdate);
+
+    /*!
+      \return the rank of \a Block, a SimpleBlock or BlockGroup of this Cluster, 1 for the first one
+      \note only known while UpdateCues() sets the cue entries, 0 otherwise
+    */
+    std::uint64_t GetBlockNumber(const libebml::EbmlElement & Block) const;
+
     /*!
       \return the global timestamp of this Cluster
     */
@@ -101,7 +137,34 @@ DECLARE_MKX_MASTER_CONS(KaxCluster)
 
     const KaxSegment *GetParentSegment() const { return ParentSegment; }
 
+    /*!
+      \brief check the CRC-32 of the data of a Cluster
+      \param Data the data of the Cluster after its head, e.g. in the memory of a KaxSharedMemReadIOCallback
+      \return false if the data start with a CRC-32 element that doesn't match the rest of the data
+      \note \a Data is only read, the check can run in another thread while the same memory is parsed
+    */
+    static bool VerifyCrc32(const libebml::binary * Data, std::size_t Size);
+    /*!
+      \brief check the CRC-32 of the \a DataSize octets of Cluster data at the current position of \a input
+      \note the data are read again, to check a Cluster while it's parsed use KaxCrc32IOCallback
+      \note the input is left at the end of the data
+    */
+    static bool VerifyCrc32(libebml::IOCallback & input, std::uint64_t DataSize);
+
+    /*!
+      \brief with EnableChecksum(), write the CRC-32 in place after the children instead of rendering them in memory first
+      \note on by default, the output must be seekable
+    */
+    void SetChecksumInPlace(bool bInPlace = true) { bChecksumInPlace = bInPlace; }
+
   protected:
+    /*!
+      \note with EnableChecksum() the CRC-32 is computed while the children are written,
+      then written in place, unless SetChecksumInPlace(false) was called, \a bForceRender
+      is set or the output can't seek: the Cluster is then rendered in memory first
+    */
+    libebml::filepos_t RenderData(libebml::IOCallback & output, bool bForceRender, const ShouldWrite & writeFilter = WriteSkipDefault) override;
+
     KaxBlockBlob     * currentNewBlob;
     std::vector<KaxBlockBlob*> Blobs;
     KaxBlockGroup    * currentNewBlock{nullptr};
@@ -113,11 +176,20 @@ DECLARE_MKX_MASTER_CONS(KaxCluster)
     bool   bFirstFrameInside{false}; // used to speed research
     bool   bPreviousTimestampIsSet{false};
     bool   bTimestampScaleIsSet{false};
+    bool   bRenderPrepared{false};
+    bool   bChecksumInPlace{true};
+
+    std::unordered_map<const libebml::EbmlElement *, std::uint64_t> BlockNumbers; ///< filled during UpdateCues()
 
     /*!
       \note method used internally
     */
-    bool AddFrameInternal(const KaxTrackEntry & track, std::uint64_t timestamp, DataBuffer & buffer, KaxBlockGroup * & MyNewBlock, const KaxBlockGroup * PastBlock, const KaxBlockGroup * ForwBlock, LacingType lacing);
+    void PrepareChildren();
+
+    /*!
+      \param buffer the frame to add, or nullptr to move \a frame in the Block
+    */
+    bool AddFrameInternal(const KaxTrackEntry & track, std::uint64_t timestamp, DataBuffer * buffer, FrameBuffer * frame, KaxBlockGroup * & MyNewBlock, const KaxBlockGroup * PastBlock, const KaxBlockGroup * ForwBlock, LacingType lacing);
 };
 
 } // namespace libmatroska
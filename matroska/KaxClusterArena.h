@@ -0,0 +1,101 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_CLUSTER_ARENA_H
+#define LIBMATROSKA_CLUSTER_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "matroska/KaxConfig.h"
+
+namespace libmatroska {
+
+/*!
+  \brief Bump allocator for the Block elements created while parsing a Cluster
+
+  While a KaxClusterArena::Scope is active on a thread, the KaxBlockGroup,
+  KaxBlock, KaxSimpleBlock and KaxReferenceBlock objects created on that
+  thread (usually by reading a KaxCluster) are allocated in the arena. Deleting
+  them doesn't give memory back to the system: it is all reclaimed at once by
+  Reset(), which keeps the first chunk for the next Cluster.
+
+  \code
+  KaxClusterArena arena;
+  {
+    KaxClusterArena::Scope scope(arena);
+    cluster->Read(stream, EBML_CLASS_CONTEXT(KaxCluster), UpperElementLevel, ElementFound, false);
+  }
+  ...
+  delete cluster;
+  arena.Reset();
+  \endcode
+
+  \note the arena must outlive all the elements allocated from it
+  \note without an active arena the objects are allocated as usual, with a small
+  header telling they are not from an arena, so releasing them doesn't lock
+  \note allocations are not thread-safe, releasing elements from another thread is
+*/
+class MATROSKA_DLL_API KaxClusterArena {
+  public:
+    explicit KaxClusterArena(std::size_t aChunkSize = 64 * 1024);
+    ~KaxClusterArena();
+    KaxClusterArena(const KaxClusterArena &) = delete;
+    KaxClusterArena & operator=(const KaxClusterArena &) = delete;
+
+    /// activate an arena on the current thread for the lifetime of the object
+    class MATROSKA_DLL_API Scope {
+      public:
+        explicit Scope(KaxClusterArena & arena);
+        ~Scope();
+        Scope(const Scope &) = delete;
+        Scope & operator=(const Scope &) = delete;
+      private:
+        KaxClusterArena *Previous;
+    };
+
+    /*!
+      \brief reclaim all the memory of the arena
+      \note all the elements allocated from the arena must have been deleted
+    */
+    void Reset();
+
+    /// number of objects from the arena not deleted yet
+    std::size_t LiveObjects() const { return LiveCount.load(std::memory_order_acquire); }
+    /// number of bytes used in the arena
+    std::size_t UsedBytes() const { return Used; }
+
+    /// \return the arena active on the current thread, if any
+    static KaxClusterArena *Current();
+
+    /// allocation entry points of the classes using MATROSKA_ARENA_ALLOCATED
+    static void *Allocate(std::size_t size);
+    static void Free(void *ptr) noexcept;
+
+  private:
+    void *AllocateLocal(std::size_t size);
+
+    std::size_t ChunkSize;
+    std::vector<char *> Chunks;
+    char *ChunkCursor{nullptr};
+    char *ChunkEnd{nullptr};
+    std::size_t Used{0};
+    std::atomic<std::size_t> LiveCount{0};
+};
+
+} // namespace libmatroska
+
+/*!
+  \brief allocate the objects of a class in the active KaxClusterArena, if any
+*/
+#define MATROSKA_ARENA_ALLOCATED \
+  public: \
+    static void *operator new(std::size_t size) { return libmatroska::KaxClusterArena::Allocate(size); } \
+    static void operator delete(void *ptr) noexcept { libmatroska::KaxClusterArena::Free(ptr); }
+
+#endif // LIBMATROSKA_CLUSTER_ARENA_H
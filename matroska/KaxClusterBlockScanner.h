@@ -0,0 +1,144 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_CLUSTER_BLOCK_SCANNER_H
+#define LIBMATROSKA_CLUSTER_BLOCK_SCANNER_H
+
+#include <cstddef>
+
+#include <ebml/IOCallback.h>
+
+#include "matroska/KaxTypes.h"
+
+namespace libmatroska {
+
+class KaxCluster;
+
+/*!
+  \brief Description of a SimpleBlock or BlockGroup found by KaxClusterBlockScanner
+*/
+struct MATROSKA_DLL_API KaxBlockRecord {
+  std::uint64_t ElementPosition;   ///< position of the SimpleBlock or BlockGroup element
+  std::uint64_t BlockPosition;     ///< position of the SimpleBlock or Block element
+  std::uint64_t PayloadPosition;   ///< position of the data after the Block head (lace head included)
+  std::uint64_t PayloadSize;       ///< size of the data after the Block head (lace head included)
+  std::uint64_t Timestamp;         ///< absolute timestamp in nanoseconds
+  std::uint64_t Duration;          ///< BlockDuration in nanoseconds, when HasDuration is set
+  std::uint64_t TrackNumber;
+  std::int16_t  RelativeTimestamp; ///< timestamp as written in the Block (not scaled)
+  LacingType    Lacing;
+  unsigned int  FrameCount;
+  bool          IsSimpleBlock;
+  bool          IsKeyframe;        ///< SimpleBlock keyframe flag or BlockGroup without ReferenceBlock
+  bool          IsInvisible;
+  bool          IsDiscardable;
+  bool          HasDuration;
+};
+
+/*!
+  \brief Walk the Blocks of Clusters directly from an IOCallback
+
+  No EbmlElement is created and no frame data is read, only the EBML heads
+  of the Cluster children and the Block heads.
+
+  \code
+  KaxClusterBlockScanner scanner(file, TimestampScale);
+  scanner.Seek(FirstClusterPosition);
+  while (scanner.NextCluster(SegmentEnd)) {
+    KaxBlockRecord record;
+    while (scanner.Next(record))
+      ...
+  }
+  \endcode
+*/
+class MATROSKA_DLL_API KaxClusterBlockScanner {
+  public:
+    /*!
+      \param aTimestampScale the TimestampScale of the Segment, in nanoseconds
+    */
+    KaxClusterBlockScanner(libebml::IOCallback & aInput, std::uint64_t aTimestampScale = 1000000);
+
+    /*!
+      \brief start scanning the Cluster element found at \a ClusterPosition
+      \return false if there is no valid Cluster head at this position
+    */
+    bool StartCluster(std::uint64_t ClusterPosition);
+
+    /*!
+      \brief start scanning a Cluster element whose head has already been read (e.g. with EbmlStream::FindNextID)
+    */
+    void StartCluster(const KaxCluster & Cluster);
+
+    /*!
+      \brief start scanning the next Cluster, skipping the other top level elements
+      \param EndPosition position where the search stops, usually the end of the Segment
+    */
+    bool NextCluster(std::uint64_t EndPosition);
+
+    /*!
+      \brief get the next Block of the current Cluster
+      \return false at the end of the Cluster or on invalid data, see IsValid()
+      \note at the end of the Cluster the input is positioned at the end of the Cluster
+    */
+    bool Next(KaxBlockRecord & Record);
+
+    /// reset the scanner to the given position in the stream, the next Cluster search starts from there
+    void Seek(std::uint64_t Position);
+
+    /// \return false when invalid data was found in the current Cluster
+    bool IsValid() const { return bValid; }
+
+    std::uint64_t ClusterPosition() const { return ClusterStart; }
+    /// \return the position of the first child of the current Cluster, CueRelativePosition values are relative to it
+    std::uint64_t ClusterDataStart() const { return ClusterData; }
+    /// \return the end of the current Cluster, found while scanning for Clusters of unknown size
+    std::uint64_t ClusterEnd() const { return ChildrenEnd; }
+    /// \return the ClusterTimestamp, not scaled
+    std::uint64_t ClusterTimestamp() const { return ClusterTimestampValue; }
+    bool IsClusterTimestampSet() const { return bClusterTimestampSet; }
+
+  private:
+    /// octets read at once for the element heads, enough for an element head and a Block head
+    static constexpr std::size_t WindowSize = 32;
+
+    libebml::IOCallback & Input;
+    const std::uint64_t TimestampScale;
+
+    /// octets read after Position, the input is WindowEnd - WindowStart octets after Position
+    libebml::binary Window[WindowSize];
+    std::size_t   WindowStart{0};
+    std::size_t   WindowEnd{0};
+
+    std::uint64_t Position{0};
+    std::uint64_t ClusterStart{0};
+    std::uint64_t ClusterData{0};
+    std::uint64_t ChildrenEnd{0};
+    std::uint64_t ClusterTimestampValue{0};
+    bool          bUnknownSize{false};
+    bool          bClusterTimestampSet{false};
+    bool          bInCluster{false};
+    bool          bValid{true};
+
+    void SetPosition(std::uint64_t NewPosition);
+    /// \return the number of octets available in the window, at least \a Size unless the stream ends
+    std::size_t Peek(std::size_t Size);
+    /// put the input back at Position, for the caller
+    void SyncInput();
+    bool ReadBytes(libebml::binary * Buffer, std::size_t Size);
+    bool ScanBlock(KaxBlockRecord & Record);
+    bool FindCluster(std::uint64_t EndPosition);
+    bool OpenCluster(std::uint64_t ClusterPosition);
+    bool ReadHead(std::uint32_t & Id, std::uint64_t & Size, bool & UnknownSize);
+    bool ReadUInt(std::uint64_t Size, std::uint64_t & Value);
+    bool ReadBlockHead(std::uint64_t BlockPosition, std::uint64_t BlockSize, KaxBlockRecord & Record);
+    bool ReadBlockGroup(std::uint64_t GroupEnd, KaxBlockRecord & Record);
+    void Invalidate();
+};
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_CLUSTER_BLOCK_SCANNER_H
@@ -0,0 +1,102 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_CLUSTER_PIPELINE_H
+#define LIBMATROSKA_CLUSTER_PIPELINE_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <ebml/IOCallback.h>
+#include <ebml/EbmlElement.h>
+
+#include "matroska/KaxConfig.h"
+
+namespace libmatroska {
+
+class KaxCluster;
+class KaxCues;
+
+/*!
+  \brief Render Clusters in memory on worker threads and write them in order
+
+  Each pushed Cluster is prepared on the calling thread (KaxCluster::PrepareRender())
+  to know where it will land in the output, then rendered by a worker thread in a
+  memory buffer. The buffers are written to the output in the order the Clusters were
+  pushed, on the calling thread, followed by the Cues update of the Cluster
+  (KaxCluster::UpdateCues()) and the commit callback.
+
+  \note the Clusters must stay alive and unmodified until they are committed,
+  the commit callback is the place to release/delete them
+  \note nothing else must be written to the output while Clusters are pending, see Flush()
+*/
+class MATROSKA_DLL_API KaxClusterPipeline {
+  public:
+    using CommitCallback = std::function<void(KaxCluster & Cluster, std::uint64_t ClusterSize)>;
+
+    /*!
+      \param aWorkers number of rendering threads, 0 to use the number of hardware threads
+      \param aMaxPending maximum number of Clusters not written yet, 0 for twice the number of workers
+    */
+    KaxClusterPipeline(libebml::IOCallback & aOutput, KaxCues & aCues,
+                       unsigned int aWorkers = 0, std::size_t aMaxPending = 0,
+                       libebml::EbmlElement::ShouldWrite aWriteFilter = libebml::EbmlElement::WriteSkipDefault);
+    /*!
+      \note pending Clusters are written but errors are lost, call Flush() before
+    */
+    ~KaxClusterPipeline();
+    KaxClusterPipeline(const KaxClusterPipeline &) = delete;
+    KaxClusterPipeline & operator=(const KaxClusterPipeline &) = delete;
+
+    void SetCommitCallback(CommitCallback aCallback) { OnCommit = std::move(aCallback); }
+
+    /*!
+      \brief queue a Cluster for rendering, may write previous Clusters
+      \return the position of the Cluster in the output
+      \note rendering errors of the previous Clusters are rethrown here
+    */
+    std::uint64_t Push(KaxCluster & Cluster);
+
+    /*!
+      \brief write all the pending Clusters
+    */
+    void Flush();
+
+    /// number of Clusters pushed and not written yet
+    std::size_t Pending() const;
+
+  private:
+    struct Job;
+
+    libebml::IOCallback & Output;
+    KaxCues & Cues;
+    const libebml::EbmlElement::ShouldWrite WriteFilter;
+    std::size_t MaxPending;
+    CommitCallback OnCommit;
+
+    std::uint64_t NextPosition{0};
+
+    mutable std::mutex Lock;
+    std::condition_variable WorkAvailable;
+    std::condition_variable WorkDone;
+    std::deque<std::unique_ptr<Job>> Jobs; ///< in output order
+    std::deque<Job *> Queue;               ///< not rendered yet
+    bool bStopping{false};
+    std::vector<std::thread> Workers;
+
+    void WorkerLoop();
+    bool CommitFront(bool bWait);
+};
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_CLUSTER_PIPELINE_H
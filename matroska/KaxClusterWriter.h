@@ -0,0 +1,137 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_CLUSTER_WRITER_H
+#define LIBMATROSKA_CLUSTER_WRITER_H
+
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <ebml/IOCallback.h>
+
+#include "matroska/KaxBlock.h"
+
+namespace libmatroska {
+
+class KaxCluster;
+class KaxCues;
+class KaxSegment;
+
+/*!
+  \brief Write frames in Clusters that are closed and written automatically
+
+  A Cluster is written, and all its memory released, before adding a frame
+  that would make it exceed the maximum duration or size, or that can't be
+  coded in a Block of the Cluster (relative timestamps are 16 bits). The
+  memory used doesn't depend on the length of the recording, only the Cues
+  grow by one entry per indexed keyframe.
+
+  Frames are written in SimpleBlocks, or in BlockGroups when they have a
+  duration. The keyframes of the cue tracks get a CuePoint.
+
+  In live mode the Clusters have an unknown size: the Cluster head is written
+  when it starts and each frame is written as soon as it's added, nothing is
+  kept in memory. The ClusterCallback gives the position and size of each
+  Cluster once it's ended, to build a fragment index.
+
+  \code
+  KaxClusterWriter writer(file, Segment, Cues, TimestampScale);
+  writer.AddFrame(VideoTrack, timestamp, FrameBuffer(std::move(data), size), bKeyframe);
+  ...
+  writer.Flush();
+  \endcode
+*/
+class MATROSKA_DLL_API KaxClusterWriter {
+  public:
+    /// called after a Cluster is written, with its position in the output and its size
+    using ClusterCallback = std::function<void(const KaxCluster & Cluster, std::uint64_t Position, std::uint64_t Size)>;
+
+    /*!
+      \param aOutput the Clusters are written at the current position
+      \param aTimestampScale the TimestampScale of the Segment, in nanoseconds
+    */
+    KaxClusterWriter(libebml::IOCallback & aOutput, const KaxSegment & aSegment, KaxCues & aCues, std::uint64_t aTimestampScale = 1000000);
+    /*!
+      \note the current Cluster is written, errors are ignored, call Flush() to get them
+    */
+    ~KaxClusterWriter();
+    KaxClusterWriter(const KaxClusterWriter &) = delete;
+    KaxClusterWriter & operator=(const KaxClusterWriter &) = delete;
+
+    /// maximum duration between the first and the last frame of a Cluster, in nanoseconds
+    void SetMaxClusterDuration(std::uint64_t aDuration) { MaxDuration = aDuration; }
+    /// maximum size of the frames in a Cluster, a larger frame gets a Cluster of its own
+    void SetMaxClusterSize(std::uint64_t aSize) { MaxSize = aSize; }
+    /*!
+      \brief write a CRC-32 in each Cluster, not used in live mode
+      \param bInPlace write the CRC-32 after the Cluster data, the output must be seekable,
+      otherwise each Cluster is rendered in memory first
+    */
+    void EnableClusterCrc32(bool bEnable = true, bool bInPlace = true) { bCrc32 = bEnable; bCrc32InPlace = bInPlace; }
+    /*!
+      \brief write each frame when it's added, in Clusters with an unknown size
+      \note must be set before the first frame is added
+    */
+    void SetLiveMode(bool bEnable = true) { bLive = bEnable; }
+
+    /*!
+      \brief add CuePoints for the keyframes of this track
+      \note all the tracks are indexed until a track is added
+    */
+    void AddCueTrack(std::uint64_t aTrackNumber) { CueTracks.push_back(aTrackNumber); }
+
+    void SetClusterCallback(ClusterCallback aCallback) { OnCluster = std::move(aCallback); }
+
+    /*!
+      \param timestamp in nanoseconds, relative to the beginning of the Segment
+      \param aDuration in nanoseconds, 0 to write no BlockDuration
+      \note the frames that are not keyframes reference the previous frame of the track
+    */
+    void AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, FrameBuffer && frame, bool bKeyframe = true, std::uint64_t aDuration = 0);
+
+    /// write the current Cluster, if any, in live mode the Cluster is ended
+    void Flush();
+
+    std::uint64_t ClustersWritten() const { return ClusterCount; }
+
+  private:
+    libebml::IOCallback & Output;
+    const KaxSegment &    Segment;
+    KaxCues &             Cues;
+    const std::uint64_t   TimestampScale;
+    std::uint64_t         MaxDuration{5000000000};
+    std::uint64_t         MaxSize{5 * 1024 * 1024};
+    bool                  bCrc32{false};
+    bool                  bCrc32InPlace{true};
+    bool                  bLive{false};
+    std::vector<std::uint64_t> CueTracks;
+    ClusterCallback       OnCluster;
+
+    std::unique_ptr<KaxCluster>                Cluster;
+    std::vector<std::unique_ptr<KaxBlockBlob>> Blobs;
+    std::uint64_t  ClusterTimestamp{0}; ///< in nanoseconds, a multiple of TimestampScale
+    std::uint64_t  ClusterPosition{0};  ///< position of the live Cluster in the output
+    std::uint64_t  LiveBlocks{0};       ///< Blocks written in the live Cluster, they are not in the Cluster
+    std::uint64_t  FirstTimestamp{0};
+    std::uint64_t  LastTimestamp{0};
+    std::uint64_t  FramesSize{0};
+    std::uint64_t  PreviousSize{0};
+    std::uint64_t  ClusterCount{0};
+    std::unordered_map<std::uint64_t, std::uint64_t> TrackTimestamps; ///< last timestamp of each track
+
+    bool Fits(std::uint64_t timestamp, std::uint64_t aSize) const;
+    void StartCluster(std::uint64_t timestamp);
+    void WriteLiveBlock(KaxBlockBlob & Blob);
+    void ReleaseCluster();
+    bool IsCueTrack(std::uint64_t aTrackNumber) const;
+};
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_CLUSTER_WRITER_H
@@ -0,0 +1,98 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_CRC32_H
+#define LIBMATROSKA_CRC32_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <ebml/EbmlTypes.h>
+#include <ebml/IOCallback.h>
+
+#include "matroska/KaxConfig.h"
+
+namespace libmatroska {
+
+/*!
+  \brief CRC-32 (IEEE 802.3) as used by the EBML CRC-32 element, computed incrementally
+
+  The fastest implementation available at runtime is used: carry-less
+  multiplication on x86 CPUs with PCLMULQDQ, the CRC32 instructions on ARMv8
+  builds that enable them, slicing-by-8 tables otherwise.
+  SSE4.2 CRC32 instructions compute CRC-32C, a different polynomial, they
+  can't be used.
+*/
+class MATROSKA_DLL_API KaxCrc32 {
+  public:
+    void Update(const void * Data, std::size_t Size);
+    /// \return the CRC-32 of all the data given to Update() since the last Reset()
+    std::uint32_t Value() const { return ~State; }
+    void Reset() { State = 0xFFFFFFFF; }
+
+    static std::uint32_t Compute(const void * Data, std::size_t Size);
+
+    /// CRC-32 element value, stored little-endian
+    static void Store(std::uint32_t Crc, libebml::binary (&Buffer)[4]);
+    static std::uint32_t Load(const libebml::binary * Buffer);
+
+  private:
+    std::uint32_t State{0xFFFFFFFF};
+};
+
+/*!
+  \brief IOCallback checking the CRC-32 of a master element with the data read while it's parsed
+
+  The data are not read twice, the CRC-32 is computed on the octets read
+  through this IOCallback. The check is only complete when all the data of the
+  master were read, e.g. with SCOPE_ALL_DATA, and not when some were skipped.
+  The Blocks read through it are copied, to check the data of a Cluster in a
+  KaxSharedMemReadIOCallback use KaxCluster::VerifyCrc32() on the memory.
+
+  \code
+  KaxCrc32IOCallback Checked(file);
+  EbmlStream CheckedStream(Checked);
+  Checked.Start(Cluster->GetDataStart(), Cluster->GetSize());
+  Cluster->Read(CheckedStream, EBML_CONTEXT(Cluster), UpperLevel, Found, true);
+  if (Checked.IsComplete() && !Checked.IsValid())
+    ... damaged Cluster
+  \endcode
+*/
+class MATROSKA_DLL_API KaxCrc32IOCallback : public libebml::IOCallback {
+  public:
+    explicit KaxCrc32IOCallback(libebml::IOCallback & aSource) :Source(aSource) {}
+    ~KaxCrc32IOCallback() override = default;
+
+    /// check the \a aDataSize octets of master data starting at the position \a aDataStart
+    void Start(std::uint64_t aDataStart, std::uint64_t aDataSize);
+
+    /// \return true if all the data of the master were read since Start()
+    bool IsComplete() const { return Checked == DataEnd; }
+    /*!
+      \return false if the data start with a CRC-32 element that doesn't match the rest of the data
+      \note only meaningful when IsComplete()
+    */
+    bool IsValid() const;
+
+    std::size_t read(void *Buffer, std::size_t Size) override;
+    void setFilePointer(std::int64_t Offset, libebml::seek_mode Mode = libebml::seek_beginning) override { Source.setFilePointer(Offset, Mode); }
+    std::size_t write(const void *Buffer, std::size_t Size) override { return Source.write(Buffer, Size); }
+    std::uint64_t getFilePointer() override { return Source.getFilePointer(); }
+    void close() override { Source.close(); }
+
+  private:
+    libebml::IOCallback & Source;
+    KaxCrc32              Crc;
+    libebml::binary       Head[6]{}; ///< the CRC-32 element, if the data start with one
+    std::uint64_t         DataStart{0};
+    std::uint64_t         DataEnd{0};
+    std::uint64_t         Checked{0}; ///< position of the first octet not given to the CRC-32 yet
+};
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_CRC32_H
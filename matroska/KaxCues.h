@@ -8,6 +8,8 @@
 #ifndef LIBMATROSKA_CUES_H
 #define LIBMATROSKA_CUES_H
 
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "matroska/KaxTypes.h"
@@ -18,19 +20,119 @@ namespace libmatroska {
 
 class KaxCuePoint;
 
+/*!
+  \brief flat description of a CueTrackPositions, see KaxCues::GetIndex()
+*/
+struct MATROSKA_DLL_API KaxCueIndexEntry {
+  std::uint64_t       Time;             ///< CueTime, not scaled
+  std::uint64_t       Track;
+  std::uint64_t       ClusterPosition;  ///< relative to the Segment data
+  std::uint64_t       RelativePosition; ///< CueRelativePosition, 0 if not set
+  const KaxCuePoint * Point;
+};
+
+/*!
+  \brief select the Blocks that get a CuePoint when their position is set, see KaxCues::SetCuePolicy()
+  \note by default all the Blocks added with KaxCues::AddBlockBlob() get a CuePoint
+*/
+struct MATROSKA_DLL_API KaxCuePolicy {
+  /// only cue keyframes, a SimpleBlock with the keyframe flag or a BlockGroup without references
+  bool          bKeyframesOnly{false};
+  /// minimum time between two CuePoints of a track, in nanoseconds
+  std::uint64_t MinInterval{0};
+  /// when not 0, the other tracks are cued with SecondaryInterval instead of MinInterval
+  std::uint64_t PrimaryTrack{0};
+  /// minimum time between two CuePoints of the other tracks, in nanoseconds, 0 to never cue them
+  std::uint64_t SecondaryInterval{0};
+
+  static KaxCuePolicy KeyframesOnly() {
+    KaxCuePolicy Policy;
+    Policy.bKeyframesOnly = true;
+    return Policy;
+  }
+  /// keyframes, at most one every \a aInterval nanoseconds in each track
+  static KaxCuePolicy KeyframesEvery(std::uint64_t aInterval) {
+    auto Policy = KeyframesOnly();
+    Policy.MinInterval = aInterval;
+    return Policy;
+  }
+  /// keyframes of \a aTrack, the other tracks are cued every \a aSecondaryInterval nanoseconds, or never
+  static KaxCuePolicy PrimaryTrackKeyframes(std::uint64_t aTrack, std::uint64_t aInterval = 0, std::uint64_t aSecondaryInterval = 0) {
+    auto Policy = KeyframesEvery(aInterval);
+    Policy.PrimaryTrack      = aTrack;
+    Policy.SecondaryInterval = aSecondaryInterval;
+    return Policy;
+  }
+};
+
 DECLARE_MKX_MASTER(KaxCues)
   public:
     ~KaxCues() override;
 
     //bool AddBlockGroup(const KaxBlockGroup & BlockReference); // deprecated
+    /*!
+      \note the track and timestamp of the Blob are read when its position is set
+    */
     bool AddBlockBlob(const KaxBlockBlob & BlockReference);
 
     /*!
       \brief Indicate that the position for this Block is set
+      \note a BlockGroup matches the Blob holding it, or else a Blob with the same track and timestamp
     */
     void PositionSet(const KaxBlockGroup & BlockReference);
     void PositionSet(const KaxBlockBlob & BlockReference);
 
+    /*!
+      \brief index the Blobs waiting for their position by BlockGroup, track and timestamp
+      \note the BlockGroup overload of PositionSet() uses this index, call it when the
+      track or timestamp of these Blobs changed, KaxCluster::UpdateCues() does
+    */
+    void IndexPendingBlocks();
+
+    /*!
+      \brief select the Blocks that get a CuePoint, the other ones are dropped when their position is set
+    */
+    void SetCuePolicy(const KaxCuePolicy & aPolicy) { myPolicy = aPolicy; }
+    const KaxCuePolicy & GetCuePolicy() const { return myPolicy; }
+
+    /*!
+      \brief (re)build the index of CuePoints used by the lookups
+      \note the index is built on demand after reading, adding or removing CuePoints with the
+      methods of this class, call this or InvalidateIndex() when the CuePoints are modified
+      by other means, e.g. through an EbmlMaster reference
+    */
+    void BuildIndex() const;
+    void InvalidateIndex() { bIndexValid = false; }
+
+    /// \note the index is rebuilt on the next lookup
+    void Read(libebml::EbmlStream & inDataStream, const libebml::EbmlSemanticContext & Context, int & UpperEltFound, libebml::EbmlElement * & FoundElt, bool AllowDummyElt, libebml::ScopeMode ReadFully = libebml::SCOPE_ALL_DATA) override;
+    /// same as the EbmlMaster versions, the index is rebuilt on the next lookup
+    void Remove(std::vector<libebml::EbmlElement *>::iterator & Itr);
+    void RemoveAll();
+
+    /*!
+      \return the CueTrackPositions of all the CuePoints, sorted by time and track
+    */
+    const std::vector<KaxCueIndexEntry> & GetIndex() const;
+
+    /*!
+      \brief find the last entry at or before \a aTimestamp
+      \param aTimestamp timestamp in nanoseconds
+      \param aTrack only look at entries of this track, 0 for any track
+      \return nullptr if there is no such entry
+    */
+    const KaxCueIndexEntry * FindIndexEntry(std::uint64_t aTimestamp, std::uint64_t aTrack = 0) const;
+
+    /*!
+      \brief find the Block of the last entry at or before \a aTimestamp
+      \param aTimestamp timestamp in nanoseconds
+      \param aTrack only look at entries of this track, 0 for any track
+      \param aClusterPosition the position of the Cluster, relative to the Segment data
+      \param aRelativePosition the position of the Block, relative to the Cluster data
+      \return false if there is no such entry or it doesn't have a CueRelativePosition
+    */
+    bool GetBlockPosition(std::uint64_t aTimestamp, std::uint64_t aTrack, std::uint64_t & aClusterPosition, std::uint64_t & aRelativePosition) const;
+
     /*!
       \brief override to sort by timestamp/track
     */
@@ -40,7 +142,9 @@ DECLARE_MKX_MASTER(KaxCues)
     }
 
     std::uint64_t GetTimestampPosition(std::uint64_t aTimestamp) const;
+    std::uint64_t GetTimestampPosition(std::uint64_t aTimestamp, std::uint64_t aTrack) const;
     const KaxCuePoint * GetTimestampPoint(std::uint64_t aTimestamp) const;
+    const KaxCuePoint * GetTimestampPoint(std::uint64_t aTimestamp, std::uint64_t aTrack) const;
 
     void SetGlobalTimestampScale(std::uint64_t aGlobalTimestampScale) {
       mGlobalTimestampScale = aGlobalTimestampScale;
@@ -52,9 +156,36 @@ DECLARE_MKX_MASTER(KaxCues)
     }
 
   protected:
-    std::vector<const KaxBlockBlob *> myTempReferences;
+    /// track number and global timestamp of a Block getting its position
+    struct BlockKey {
+      std::uint16_t Track;
+      std::uint64_t Timestamp;
+      bool operator==(const BlockKey & other) const { return Track == other.Track && Timestamp == other.Timestamp; }
+    };
+    struct BlockKeyHash {
+      std::size_t operator()(const BlockKey & key) const {
+        return std::hash<std::uint64_t>()(key.Timestamp ^ (static_cast<std::uint64_t>(key.Track) << 48));
+      }
+    };
+
+    std::unordered_set<const KaxBlockBlob *> myTempReferences; ///< Blobs waiting for their position
+    /// \see IndexPendingBlocks(), Blobs whose position is set are skipped
+    std::unordered_map<const KaxBlockGroup *, const KaxBlockBlob *>       myTempGroups;
+    std::unordered_multimap<BlockKey, const KaxBlockBlob *, BlockKeyHash> myTempKeys;
+    bool bTempIndexValid{false};
+    bool IsCued(const KaxBlockBlob & BlockReference, const BlockKey & Key);
+    /// add the CuePoint of a Blob whose position is set, if the policy selects it
+    void AddCuePoint(const KaxBlockBlob & BlockReference);
+
+    KaxCuePolicy myPolicy;
+    std::unordered_map<std::uint16_t, std::uint64_t> myLastCues; ///< timestamp of the last CuePoint of each track
     bool   bGlobalTimestampScaleIsSet;
     std::uint64_t mGlobalTimestampScale;
+
+    mutable std::vector<KaxCueIndexEntry> myIndex;
+    mutable std::vector<std::size_t>      myTrackIndex; ///< positions in myIndex sorted by track and time
+    mutable std::size_t                   myIndexedChildren{0};
+    mutable bool                          bIndexValid{false};
 };
 
 } // namespace libmatroska
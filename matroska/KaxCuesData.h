@@ -37,6 +37,7 @@ DECLARE_MKX_MASTER(KaxCuePoint)
 DECLARE_MKX_MASTER(KaxCueTrackPositions)
   public:
     std::uint64_t ClusterPosition() const;
+    std::uint64_t RelativePosition() const;
     std::uint16_t TrackNumber() const;
 };
 
@@ -44,6 +45,7 @@ DECLARE_MKX_MASTER(KaxCueReference)
   public:
     void AddReference(const KaxBlockGroup & BlockReferenced, std::uint64_t GlobalTimestampScale);
     void AddReference(const KaxBlockBlob & BlockReferenced, std::uint64_t GlobalTimestampScale);
+    void AddReference(const KaxInternalBlock & BlockReferenced, std::uint64_t GlobalTimestampScale);
 };
 
 } // namespace libmatroska
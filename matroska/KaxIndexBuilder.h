@@ -0,0 +1,163 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_INDEX_BUILDER_H
+#define LIBMATROSKA_INDEX_BUILDER_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <ebml/IOCallback.h>
+
+#include "matroska/KaxTypes.h"
+
+namespace libmatroska {
+
+class KaxClusterBlockScanner;
+class KaxCues;
+
+/*!
+  \brief a Cluster found by KaxIndexBuilder
+*/
+struct MATROSKA_DLL_API KaxIndexCluster {
+  std::uint64_t Position;  ///< absolute position of the Cluster element
+  std::uint64_t Size;      ///< size of the whole element, head included
+  std::uint64_t Timestamp; ///< ClusterTimestamp, not scaled
+};
+
+/*!
+  \brief a Block found by KaxIndexBuilder
+*/
+struct MATROSKA_DLL_API KaxIndexEntry {
+  std::uint64_t Timestamp;        ///< absolute timestamp in nanoseconds
+  std::uint64_t TrackNumber;
+  std::uint64_t ClusterPosition;  ///< absolute position of the Cluster element
+  std::uint64_t RelativePosition; ///< position of the SimpleBlock or BlockGroup in the Cluster data
+  std::uint64_t BlockNumber;      ///< 1 for the first Block of the Cluster
+  std::uint64_t Duration;         ///< BlockDuration in nanoseconds, 0 if not set
+};
+
+/*!
+  \brief the entries of one track in a KaxIndexLookup
+*/
+struct MATROSKA_DLL_API KaxIndexTrack {
+  std::uint64_t TrackNumber;
+  std::uint64_t First; ///< first position of the track in KaxIndexLookup::Positions
+  std::uint64_t Count; ///< number of entries of the track
+};
+
+/*!
+  \brief find KaxIndexEntry records by timestamp, of any track or of one track
+
+  The positions list the entries of each track in timestamp order, so looking
+  in one track is a binary search like looking in all of them. The records
+  are only referenced, see BuildTracks() to make the tracks and positions.
+*/
+struct MATROSKA_DLL_API KaxIndexLookup {
+  const KaxIndexEntry * Entries{nullptr};   ///< sorted by timestamp and track
+  std::size_t           EntryCount{0};
+  const KaxIndexTrack * Tracks{nullptr};    ///< sorted by track number
+  std::size_t           TrackCount{0};
+  const std::uint64_t * Positions{nullptr}; ///< indexes in Entries, grouped by track
+
+  /*!
+    \brief find the last entry at or before \a aTimestamp
+    \param aTimestamp timestamp in nanoseconds
+    \param aTrack only look at entries of this track, 0 for any track
+    \return nullptr if there is no such entry
+  */
+  const KaxIndexEntry * Find(std::uint64_t aTimestamp, std::uint64_t aTrack = 0) const;
+
+  /// fill \a Tracks and \a Positions with the entries of each track of \a aEntries
+  static void BuildTracks(const std::vector<KaxIndexEntry> & aEntries, std::vector<KaxIndexTrack> & Tracks, std::vector<std::uint64_t> & Positions);
+};
+
+/*!
+  \brief Index a whole Segment by scanning its Clusters on several threads
+
+  The Segment data is split in chunks. Each thread looks for the Cluster ID in a chunk
+  and walks the Clusters starting inside it with KaxClusterBlockScanner. The chunks are
+  then merged: a chunk is only kept from the Cluster the previous chunk ends on,
+  so false Cluster IDs found in frame data are dropped.
+
+  \code
+  KaxIndexBuilder builder([&] { return std::make_unique<StdIOCallback>(path, MODE_READ); },
+                          Segment.GetDataStart(), FileSize, TimestampScale);
+  builder.Build();
+  builder.FillCues(Cues);
+  \endcode
+*/
+class MATROSKA_DLL_API KaxIndexBuilder {
+  public:
+    /// create a new input on the file for each thread
+    using InputFactory = std::function<std::unique_ptr<libebml::IOCallback>()>;
+
+    /*!
+      \param aSegmentDataStart position of the first element in the Segment
+      \param aSegmentDataEnd end of the Segment, or of the file when the Segment has an unknown size
+      \param aTimestampScale the TimestampScale of the Segment, in nanoseconds
+    */
+    KaxIndexBuilder(InputFactory aOpenInput, std::uint64_t aSegmentDataStart, std::uint64_t aSegmentDataEnd,
+                    std::uint64_t aTimestampScale = 1000000);
+
+    /// number of threads, 0 to use the number of hardware threads
+    void SetThreads(unsigned int aThreads) { Threads = aThreads; }
+    /// size of the chunks scanned by each thread
+    void SetChunkSize(std::uint64_t aChunkSize) { ChunkSize = aChunkSize; }
+    /// only index keyframes (default) or all the Blocks
+    void SetKeyframesOnly(bool aKeyframesOnly) { bKeyframesOnly = aKeyframesOnly; }
+
+    /*!
+      \brief scan the Segment
+      \note errors of the inputs are rethrown here
+    */
+    void Build();
+
+    std::uint64_t GetSegmentDataStart() const { return SegmentDataStart; }
+    std::uint64_t GetTimestampScale() const { return TimestampScale; }
+
+    /// \return the Clusters found, in file order
+    const std::vector<KaxIndexCluster> & GetClusters() const { return Clusters; }
+    /// \return the Blocks indexed, sorted by timestamp and track
+    const std::vector<KaxIndexEntry> & GetEntries() const { return Entries; }
+
+    /*!
+      \brief add a CuePoint for each indexed timestamp
+      \note CueClusterPosition values are relative to the Segment data start given to the constructor
+    */
+    void FillCues(KaxCues & Cues) const;
+
+    /*!
+      \return the CueTrackPositions of \a Cues as entries, sorted by timestamp and track
+      \param aSegmentDataStart position of the first element in the Segment
+      \param aTimestampScale the TimestampScale of the Segment, in nanoseconds
+      \note the CueBlockNumber and CueDuration are not kept, they are 0 in the entries
+    */
+    static std::vector<KaxIndexEntry> CueEntries(const KaxCues & Cues, std::uint64_t aSegmentDataStart, std::uint64_t aTimestampScale);
+
+  private:
+    struct Chunk;
+
+    const InputFactory  OpenInput;
+    const std::uint64_t SegmentDataStart;
+    const std::uint64_t SegmentDataEnd;
+    const std::uint64_t TimestampScale;
+    unsigned int        Threads{0};
+    std::uint64_t       ChunkSize{64 * 1024 * 1024};
+    bool                bKeyframesOnly{true};
+
+    std::vector<KaxIndexCluster> Clusters;
+    std::vector<KaxIndexEntry>   Entries;
+
+    void ScanChunk(libebml::IOCallback & Input, Chunk & Range, bool bFromStart) const;
+    bool Resync(libebml::IOCallback & Input, KaxClusterBlockScanner & Scanner, std::uint64_t From, std::uint64_t Limit) const;
+};
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_INDEX_BUILDER_H
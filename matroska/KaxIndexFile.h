@@ -0,0 +1,128 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_INDEX_FILE_H
+#define LIBMATROSKA_INDEX_FILE_H
+
+#include <memory>
+#include <vector>
+
+#include <ebml/IOCallback.h>
+
+#include "matroska/KaxIndexBuilder.h"
+
+namespace libmatroska {
+
+class KaxCues;
+
+/*!
+  \brief identify the Matroska file an index file was made for
+  \note the values are chosen by the application, for example the size and
+  modification time of the file and a KaxCrc32 of its SeekHead
+*/
+struct MATROSKA_DLL_API KaxIndexFileKey {
+  std::uint64_t FileSize{0};
+  std::uint64_t ModificationTime{0};
+  std::uint64_t Checksum{0};
+
+  bool operator==(const KaxIndexFileKey & Other) const {
+    return FileSize == Other.FileSize && ModificationTime == Other.ModificationTime && Checksum == Other.Checksum;
+  }
+  bool operator!=(const KaxIndexFileKey & Other) const { return !(*this == Other); }
+};
+
+/*!
+  \brief sidecar file holding the index of a Matroska file, used in place when mapped in memory
+
+  The file has an 80 octets header followed by the KaxIndexCluster,
+  KaxIndexEntry and KaxIndexTrack records and the positions of the entries of
+  each track, as they are in memory, in the byte order of the host.
+  Opening it only checks the header and the tracks, the records are used
+  directly from the memory area without copy.
+
+  \code
+  KaxIndexFile::Write(sidecar, Key, builder);
+  ...
+  KaxIndexFile Index;
+  if (Index.Open(MappedData, MappedSize, Key)) {
+    const auto Entry = Index.FindEntry(Timestamp);
+    ...
+  }
+  \endcode
+*/
+class MATROSKA_DLL_API KaxIndexFile {
+  public:
+    /// version of the format written
+    static constexpr std::uint32_t Version = 2;
+
+    /*!
+      \brief write an index file
+      \param aSegmentDataStart position of the first element in the Segment
+      \param aTimestampScale the TimestampScale of the Segment, in nanoseconds
+      \param Entries the Blocks indexed, sorted by timestamp and track
+    */
+    static void Write(libebml::IOCallback & output, const KaxIndexFileKey & Key,
+                      std::uint64_t aSegmentDataStart, std::uint64_t aTimestampScale,
+                      const std::vector<KaxIndexCluster> & Clusters, const std::vector<KaxIndexEntry> & Entries);
+    /// write the Clusters and Blocks found by \a Builder
+    static void Write(libebml::IOCallback & output, const KaxIndexFileKey & Key, const KaxIndexBuilder & Builder);
+    /*!
+      \brief write the CuePoints of \a Cues, without Clusters
+      \note the CueBlockNumber and CueDuration of the CuePoints are not kept, they are 0 in the entries
+    */
+    static void Write(libebml::IOCallback & output, const KaxIndexFileKey & Key,
+                      std::uint64_t aSegmentDataStart, std::uint64_t aTimestampScale, const KaxCues & Cues);
+
+    /*!
+      \brief use an index file in memory, usually mapped from the sidecar file
+      \param aData the memory area, aligned on 8 octets, the shared_ptr deleter frees or unmaps it
+      \param Key the expected key of the Matroska file
+      \return false if the area isn't a valid index file of this version for \a Key
+    */
+    bool Open(std::shared_ptr<const libebml::binary> aData, std::size_t aSize, const KaxIndexFileKey & Key);
+    void Close();
+
+    bool IsOpen() const { return Data != nullptr; }
+
+    /*!
+      \brief check the CRC-32 of the records
+      \note this reads the whole index, it's not done by Open(), use it before
+      looking in the tracks of a file that may be damaged
+    */
+    bool Verify() const;
+
+    std::uint64_t GetSegmentDataStart() const { return SegmentDataStart; }
+    std::uint64_t GetTimestampScale() const { return TimestampScale; }
+
+    /// \return the Clusters, in file order
+    const KaxIndexCluster * GetClusters() const { return Clusters; }
+    std::size_t GetClusterCount() const { return ClusterCount; }
+    /// \return the Blocks, sorted by timestamp and track
+    const KaxIndexEntry * GetEntries() const { return Lookup.Entries; }
+    std::size_t GetEntryCount() const { return Lookup.EntryCount; }
+
+    /*!
+      \brief find the last entry at or before \a aTimestamp
+      \param aTimestamp timestamp in nanoseconds
+      \param aTrack only look at entries of this track, 0 for any track
+      \return nullptr if there is no such entry
+    */
+    const KaxIndexEntry * FindEntry(std::uint64_t aTimestamp, std::uint64_t aTrack = 0) const { return Lookup.Find(aTimestamp, aTrack); }
+
+  private:
+    std::shared_ptr<const libebml::binary> Data;
+    std::uint64_t           SegmentDataStart{0};
+    std::uint64_t           TimestampScale{0};
+    const KaxIndexCluster * Clusters{nullptr};
+    std::size_t             ClusterCount{0};
+    KaxIndexLookup          Lookup;
+    std::uint32_t           RecordsCrc{0};
+};
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_INDEX_FILE_H
@@ -0,0 +1,126 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_PREFETCH_IO_CALLBACK_H
+#define LIBMATROSKA_PREFETCH_IO_CALLBACK_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <ebml/IOCallback.h>
+
+#include "matroska/KaxConfig.h"
+
+namespace libmatroska {
+
+class KaxCluster;
+class KaxCues;
+class KaxSeekHead;
+class KaxSegment;
+
+/*!
+  \brief Read-only IOCallback reading ahead of the parser on a background thread
+
+  The source is only accessed by the background thread, in large page reads.
+  The parser is served from a bounded set of pages. The pages following the
+  last read are loaded in advance, and the Matroska structure can be used to
+  load in advance the data that will be needed soon:
+  - the whole Cluster about to be parsed, from its coded size,
+  - the elements listed in a SeekHead,
+  - the Clusters listed in the Cues after a seek.
+
+  \note meant for sources with a high latency, like HTTP range requests
+*/
+class MATROSKA_DLL_API KaxPrefetchIOCallback : public libebml::IOCallback {
+  public:
+    /*!
+      \param aPageSize size of the reads done on the source
+      \param aMaxPages number of pages kept in memory
+    */
+    KaxPrefetchIOCallback(libebml::IOCallback & aSource, std::size_t aPageSize = 256 * 1024, std::size_t aMaxPages = 32);
+    ~KaxPrefetchIOCallback() override;
+    KaxPrefetchIOCallback(const KaxPrefetchIOCallback &) = delete;
+    KaxPrefetchIOCallback & operator=(const KaxPrefetchIOCallback &) = delete;
+
+    /*!
+      \note errors of the source are rethrown here when the failed page is read
+    */
+    std::size_t read(void *Buffer, std::size_t Size) override;
+    void setFilePointer(std::int64_t Offset, libebml::seek_mode Mode = libebml::seek_beginning) override;
+    std::size_t write(const void *Buffer, std::size_t Size) override;
+    std::uint64_t getFilePointer() override { return Position; }
+    void close() override;
+
+    /// number of pages loaded after the one being read, 0 to disable
+    void SetReadAhead(std::size_t aPages) { ReadAhead = aPages; }
+
+    /*!
+      \brief load the given range of the source in the background
+      \note ranges that don't fit in the pages are truncated
+    */
+    void Prefetch(std::uint64_t aPosition, std::uint64_t aSize);
+
+    /*!
+      \brief load the whole Cluster whose head was just read, e.g. with EbmlStream::FindNextID
+      \note nothing is done for Clusters of unknown size, the read-ahead takes care of them
+    */
+    void Prefetch(const KaxCluster & Cluster);
+
+    /*!
+      \brief load the beginning of the top level elements listed in the SeekHead
+    */
+    void Prefetch(const KaxSegment & Segment, const KaxSeekHead & SeekHead);
+
+    /*!
+      \brief load the beginning of the Clusters found in the Cues from \a aTimestamp
+      \param aTimestamp in nanoseconds, usually the target of a seek
+      \param aClusters maximum number of Clusters to load
+    */
+    void Prefetch(const KaxSegment & Segment, const KaxCues & Cues, std::uint64_t aTimestamp, std::size_t aClusters = 4);
+
+    std::uint64_t CacheHits() const { return Hits; }
+    std::uint64_t CacheMisses() const { return Misses; }
+
+  private:
+    struct Page {
+      std::vector<libebml::binary> Data; ///< shorter than a page at the end of the source
+      std::exception_ptr           Error;
+      std::uint64_t                LastUse{0};
+      bool                         bReady{false};
+    };
+
+    libebml::IOCallback & Source;
+    const std::size_t     PageSize;
+    const std::size_t     MaxPages;
+    std::size_t           ReadAhead{2};
+    std::uint64_t         Position;
+    std::uint64_t         Hits{0};
+    std::uint64_t         Misses{0};
+    std::uint64_t         UseCounter{0};
+
+    std::mutex                               Lock;
+    std::mutex                               SourceLock; ///< held while the source is used
+    std::condition_variable                  PageRequested;
+    std::condition_variable                  PageLoaded;
+    std::unordered_map<std::uint64_t, Page>  Pages;
+    std::deque<std::uint64_t>                Requests;   ///< pages to load, in order
+    bool                                     bStopping{false};
+    std::thread                              Loader;
+
+    bool Request(std::uint64_t Index, bool bUrgent);
+    bool MakeRoom();
+    void LoaderLoop();
+};
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_PREFETCH_IO_CALLBACK_H
@@ -0,0 +1,132 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_PUSH_PARSER_H
+#define LIBMATROSKA_PUSH_PARSER_H
+
+#include <vector>
+
+#include <ebml/EbmlTypes.h>
+
+#include "matroska/KaxClusterBlockScanner.h"
+
+namespace libmatroska {
+
+/*!
+  \brief parse a Matroska stream from the byte chunks given to it, without blocking reads
+
+  The parser never reads from an IOCallback: the application feeds the data
+  as it arrives and gets the elements through a Handler. A chunk can end
+  anywhere, the parser keeps the partial element until the next chunk.
+  Elements fully contained in a chunk are given without copy.
+
+  The top level elements of the Segment other than Clusters are given whole
+  when the Handler asks for them, to be read with libebml from a
+  MemReadIOCallback. The Blocks are described with a KaxBlockRecord and their
+  whole SimpleBlock or BlockGroup element.
+
+  \code
+  KaxPushParser parser(handler);
+  while (auto Got = ReceiveSome(Buffer))
+    if (!parser.Feed(Buffer, Got))
+      break;
+  parser.Finish();
+  \endcode
+*/
+class MATROSKA_DLL_API KaxPushParser {
+  public:
+    /*!
+      \brief receive the elements found by the parser
+      \note the data pointers are only valid during the call
+    */
+    class MATROSKA_DLL_API Handler {
+      public:
+        virtual ~Handler() = default;
+
+        /// \param Size the size of the Segment data, unused if \a bUnknownSize is set
+        virtual void OnSegment(std::uint64_t /* Position */, std::uint64_t /* DataStart */, std::uint64_t /* Size */, bool /* bUnknownSize */) {}
+        virtual void OnSegmentEnd(std::uint64_t /* EndPosition */) {}
+
+        /*!
+          \brief an element outside Clusters was found: the EBML header or a top level element of the Segment
+          \param Size the size of the whole element, head included
+          \return true to get the whole element in OnElement(), false to skip it
+        */
+        virtual bool OnElementHead(std::uint32_t /* Id */, std::uint64_t /* Position */, std::uint64_t /* Size */) { return false; }
+        /// \param Data the whole element, head included
+        virtual void OnElement(std::uint32_t /* Id */, std::uint64_t /* Position */, const libebml::binary * /* Data */, std::size_t /* Size */) {}
+
+        virtual void OnCluster(std::uint64_t /* Position */, bool /* bUnknownSize */) {}
+        /// \param Timestamp the ClusterTimestamp, not scaled
+        virtual void OnClusterTimestamp(std::uint64_t /* Timestamp */) {}
+        /*!
+          \param Element the whole SimpleBlock or BlockGroup, the payload starts
+          at Record.PayloadPosition - Record.ElementPosition
+        */
+        virtual void OnBlock(const KaxBlockRecord & /* Record */, const libebml::binary * /* Element */, std::size_t /* ElementSize */) {}
+        virtual void OnClusterEnd(std::uint64_t /* EndPosition */) {}
+    };
+
+    /*!
+      \param aStartPosition position in the file of the first octet fed
+      \param aTimestampScale the TimestampScale of the Segment, in nanoseconds
+    */
+    explicit KaxPushParser(Handler & aHandler, std::uint64_t aStartPosition = 0, std::uint64_t aTimestampScale = 1000000);
+
+    /// change the TimestampScale, usually once the Info element is read
+    void SetTimestampScale(std::uint64_t aTimestampScale) { TimestampScale = aTimestampScale; }
+    /// the largest element kept in memory, larger top level elements are skipped, larger Blocks make the stream invalid
+    void SetMaxElementSize(std::size_t aMaxElementSize) { MaxElementSize = aMaxElementSize; }
+
+    /*!
+      \brief parse the next \a Size octets of the stream
+      \return false if the stream is not valid Matroska, the following data is ignored
+    */
+    bool Feed(const libebml::binary * Data, std::size_t Size);
+
+    /*!
+      \brief end the stream, Clusters and Segments with an unknown size are ended
+      \return false if the stream ended in the middle of an element
+    */
+    bool Finish();
+
+    /// \return the position in the file of the next octet to parse
+    std::uint64_t GetPosition() const { return Position; }
+    /// \return the number of octets received but not parsed yet
+    std::size_t GetPendingSize() const { return Pending.size(); }
+    bool IsValid() const { return !bError; }
+
+  private:
+    Handler &                    myHandler;
+    std::uint64_t                Position;
+    std::uint64_t                TimestampScale;
+    std::size_t                  MaxElementSize{16 * 1024 * 1024};
+    std::vector<libebml::binary> Pending; ///< octets received that start an incomplete element
+
+    std::uint64_t SkipRemaining{0};
+    std::uint64_t WantedPosition; ///< position of the element the Handler wants whole
+
+    bool          bInSegment{false};
+    bool          bSegmentUnknownSize{false};
+    std::uint64_t SegmentEnd{0};
+
+    bool          bInCluster{false};
+    bool          bClusterUnknownSize{false};
+    std::uint64_t ClusterEnd{0};
+    std::uint64_t ClusterTimestamp{0};
+
+    bool          bError{false};
+
+    std::size_t Process(const libebml::binary * Data, std::size_t Size);
+    bool ReadBlock(const libebml::binary * Element, std::size_t HeadSize, std::size_t ElementSize, bool bSimpleBlock, KaxBlockRecord & Record) const;
+    bool ReadBlockHead(const libebml::binary * Block, std::size_t Size, std::uint64_t DataStart, KaxBlockRecord & Record) const;
+    void EndCluster();
+};
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_PUSH_PARSER_H
@@ -8,6 +8,9 @@
 #ifndef LIBMATROSKA_SEEK_HEAD_H
 #define LIBMATROSKA_SEEK_HEAD_H
 
+#include <unordered_map>
+#include <vector>
+
 #include "matroska/KaxTypes.h"
 #include <ebml/EbmlMaster.h>
 #include <ebml/EbmlBinary.h>
@@ -23,6 +26,8 @@ DECLARE_MKX_MASTER(KaxSeek)
     std::int64_t Location() const;
     bool IsEbmlId(const libebml::EbmlId & aId) const;
     bool IsEbmlId(const KaxSeek & aPoint) const;
+    /// \return the value of the SeekID, 0 if it's missing or invalid
+    std::uint32_t GetIdValue() const;
 };
 
 DECLARE_MKX_MASTER(KaxSeekHead)
@@ -32,9 +37,39 @@ DECLARE_MKX_MASTER(KaxSeekHead)
       \note the element should already be written in the file
     */
     KaxSeek * IndexThis(const EbmlElement & aElt, const KaxSegment & ParentSegment);
+    /*!
+      \brief add an element to index at \a aRelativePosition in the Segment
+      \note useful when the element is rendered in memory before it's written
+    */
+    KaxSeek * IndexThis(const libebml::EbmlId & aId, std::uint64_t aRelativePosition);
 
     KaxSeek * FindFirstOf(const libebml::EbmlCallbacks & Callbacks) const;
     KaxSeek * FindNextOf(const KaxSeek &aPrev) const;
+
+    /*!
+      \note the index used by the lookups is rebuilt after reading, adding or removing Seek
+      entries with the methods of this class, call this when the entries are modified by
+      other means, e.g. through an EbmlMaster reference
+    */
+    void InvalidateIndex() { bIndexValid = false; }
+
+    /// \note the index is rebuilt on the next lookup
+    void Read(libebml::EbmlStream & inDataStream, const libebml::EbmlSemanticContext & Context, int & UpperEltFound, libebml::EbmlElement * & FoundElt, bool AllowDummyElt, libebml::ScopeMode ReadFully = libebml::SCOPE_ALL_DATA) override;
+    /// same as the EbmlMaster versions, the index is rebuilt on the next lookup
+    void Remove(std::vector<libebml::EbmlElement *>::iterator & Itr);
+    void RemoveAll();
+
+  protected:
+    struct IndexPosition {
+      std::uint32_t Id;
+      std::size_t   Rank; ///< position in the list of entries with the same ID
+    };
+    mutable std::unordered_map<std::uint32_t, std::vector<KaxSeek *>> myIndex;
+    mutable std::unordered_map<const KaxSeek *, IndexPosition>         myIndexPositions;
+    mutable std::size_t                                                myIndexedChildren{0};
+    mutable bool                                                       bIndexValid{false};
+
+    void BuildIndex() const;
 };
 
 } // namespace libmatroska
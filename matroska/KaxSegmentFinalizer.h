@@ -0,0 +1,92 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_SEGMENT_FINALIZER_H
+#define LIBMATROSKA_SEGMENT_FINALIZER_H
+
+#include <ebml/IOCallback.h>
+
+#include "matroska/KaxConfig.h"
+#include "matroska/KaxSeekHead.h"
+
+namespace libmatroska {
+
+class KaxCues;
+class KaxSegment;
+
+/*!
+  \brief Reserve room for the SeekHead and the Cues and patch them in place when the Segment is closed
+
+  The Segment head is written with a size coded on 8 octets, followed by Void
+  elements reserving room for the SeekHead and the Cues. When the Segment is
+  done, each of them is rendered in memory and written in a single write,
+  with a Void head covering what is left of its reserved room. Only the
+  elements that don't fit are appended at the end of the Segment.
+
+  The Cues are filled while the Clusters are written, for example with a
+  KaxClusterWriter.
+
+  \code
+  KaxSegmentFinalizer finalizer(file, Segment, Cues);
+  finalizer.Start(KaxSegmentFinalizer::EstimateCuesSize(Duration, 1.0, 1));
+  Info.Render(file);   finalizer.Index(Info);
+  Tracks.Render(file); finalizer.Index(Tracks);
+  ... write the Clusters
+  finalizer.Finish();
+  \endcode
+*/
+class MATROSKA_DLL_API KaxSegmentFinalizer {
+  public:
+    KaxSegmentFinalizer(libebml::IOCallback & aOutput, KaxSegment & aSegment, KaxCues & aCues);
+    KaxSegmentFinalizer(const KaxSegmentFinalizer &) = delete;
+    KaxSegmentFinalizer & operator=(const KaxSegmentFinalizer &) = delete;
+
+    /*!
+      \brief estimate the room needed by the Cues of a Segment
+      \param aDuration the duration of the Segment, in nanoseconds
+      \param aCuePointsPerSecond usually the keyframe rate of the video track
+      \param aTracks the number of tracks indexed in each CuePoint
+    */
+    static std::uint64_t EstimateCuesSize(std::uint64_t aDuration, double aCuePointsPerSecond, unsigned int aTracks = 1);
+
+    /*!
+      \brief write the Segment head and reserve room for the SeekHead and the Cues
+      \param aCuesSize the room for the Cues, 0 to write them at the end
+      \note must be called once, at the position where the Segment starts
+    */
+    void Start(std::uint64_t aCuesSize, std::uint64_t aSeekHeadSize = 256);
+
+    /*!
+      \brief add an element to the SeekHead
+      \note the element should already be written in the file
+    */
+    void Index(const libebml::EbmlElement & aElt);
+
+    /*!
+      \brief write the SeekHead, the Cues and the Segment size
+      \return false if the Cues or the SeekHead didn't fit in their room and were appended
+      \note the output is left at the end of the Segment
+    */
+    bool Finish();
+
+  private:
+    libebml::IOCallback & Output;
+    KaxSegment &          Segment;
+    KaxCues &             Cues;
+    KaxSeekHead           SeekHead;
+
+    std::uint64_t SeekHeadPosition{0};
+    std::uint64_t SeekHeadRoom{0};
+    std::uint64_t CuesPosition{0};
+    std::uint64_t CuesRoom{0};
+
+    void Reserve(std::uint64_t aSize);
+};
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_SEGMENT_FINALIZER_H
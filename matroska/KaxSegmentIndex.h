@@ -0,0 +1,136 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_SEGMENT_INDEX_H
+#define LIBMATROSKA_SEGMENT_INDEX_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "matroska/KaxIndexBuilder.h"
+
+namespace libmatroska {
+
+class KaxCues;
+class KaxSeekHead;
+class KaxTracks;
+
+/*!
+  \brief the values of a TrackEntry kept in a KaxSegmentIndex
+*/
+struct MATROSKA_DLL_API KaxSegmentIndexTrack {
+  std::uint64_t                Number{0};
+  std::uint64_t                UID{0};
+  std::uint64_t                Type{0};
+  std::string                  CodecID;
+  std::vector<libebml::binary> CodecPrivate;
+  std::uint64_t                DefaultDuration{0}; ///< in nanoseconds, 0 if not set
+  std::uint64_t                CodecDelay{0};      ///< in nanoseconds
+  std::uint64_t                SeekPreRoll{0};     ///< in nanoseconds
+  bool                         bLacing{true};
+};
+
+/*!
+  \brief a top level element of the Segment found in a SeekHead
+*/
+struct MATROSKA_DLL_API KaxSegmentIndexSeek {
+  std::uint32_t Id;
+  std::uint64_t Position; ///< absolute position in the file
+};
+
+/*!
+  \brief read-only copy of the Tracks, Cues, SeekHead and Clusters of a Segment
+
+  The elements of a Segment update some of their values on first use and
+  can't be shared between threads. This index copies what they hold once
+  and is never modified, any number of threads can use it at the same time
+  without locking, each reading the file with its own IOCallback.
+
+  \code
+  auto Index = KaxSegmentIndex::Create(Segment.GetDataStart(), TimestampScale,
+                                       Tracks, Cues, SeekHead, builder.GetClusters());
+  for (auto & Worker : Workers)
+    Worker.Start(Index); // std::shared_ptr<const KaxSegmentIndex>
+  \endcode
+*/
+class MATROSKA_DLL_API KaxSegmentIndex {
+  public:
+    /*!
+      \brief build an index from the elements read from a Segment
+      \param aSegmentDataStart position of the first element in the Segment
+      \param aTimestampScale the TimestampScale of the Segment, in nanoseconds
+      \param aTracks,aCues,aSeekHead the elements read, or nullptr if they are missing
+      \param aClusters the Clusters of the Segment in file order, usually from KaxIndexBuilder
+      \note the elements are only read during the call, they are not referenced later
+    */
+    static std::shared_ptr<const KaxSegmentIndex> Create(std::uint64_t aSegmentDataStart, std::uint64_t aTimestampScale,
+                                                         const KaxTracks * aTracks, const KaxCues * aCues, const KaxSeekHead * aSeekHead,
+                                                         std::vector<KaxIndexCluster> aClusters = {});
+
+    std::uint64_t GetSegmentDataStart() const { return SegmentDataStart; }
+    std::uint64_t GetTimestampScale() const { return TimestampScale; }
+
+    /// \return the tracks, sorted by track number
+    const std::vector<KaxSegmentIndexTrack> & GetTracks() const { return Tracks; }
+    /// \return nullptr if there is no track with this number
+    const KaxSegmentIndexTrack * FindTrack(std::uint64_t aNumber) const;
+
+    /*!
+      \return the CueTrackPositions, sorted by timestamp and track
+      \note the CueBlockNumber and CueDuration are not kept, they are 0 in the entries
+    */
+    const std::vector<KaxIndexEntry> & GetCues() const { return Cues; }
+    /*!
+      \brief find the last CuePoint at or before \a aTimestamp
+      \param aTimestamp timestamp in nanoseconds
+      \param aTrack only look at entries of this track, 0 for any track
+      \return nullptr if there is no such entry
+    */
+    const KaxIndexEntry * FindCue(std::uint64_t aTimestamp, std::uint64_t aTrack = 0) const;
+
+    /// \return the elements of the SeekHead, sorted by ID and position
+    const std::vector<KaxSegmentIndexSeek> & GetSeekEntries() const { return SeekEntries; }
+    /// \return the position in the file of the first element with this ID, 0 if it's unknown
+    std::uint64_t FindSeek(std::uint32_t aId) const;
+
+    /// \return the Clusters, in file order
+    const std::vector<KaxIndexCluster> & GetClusters() const { return Clusters; }
+    /*!
+      \brief find the last Cluster starting at or before \a aTimestamp
+      \param aTimestamp timestamp in nanoseconds
+      \note the Clusters are expected in timestamp order, as in most files
+      \return nullptr if there is no such Cluster
+    */
+    const KaxIndexCluster * FindCluster(std::uint64_t aTimestamp) const;
+    /// \return the Cluster containing the position \a aPosition in the file, nullptr if none
+    const KaxIndexCluster * FindClusterAt(std::uint64_t aPosition) const;
+
+    /*!
+      \return the timestamp in nanoseconds of a Block of \a Cluster with the
+      timestamp \a aRelativeTimestamp in the Block head
+    */
+    std::uint64_t GlobalTimestamp(const KaxIndexCluster & Cluster, std::int16_t aRelativeTimestamp) const {
+      return static_cast<std::uint64_t>(static_cast<std::int64_t>(Cluster.Timestamp) + aRelativeTimestamp) * TimestampScale;
+    }
+
+  private:
+    KaxSegmentIndex() = default;
+
+    std::uint64_t                     SegmentDataStart{0};
+    std::uint64_t                     TimestampScale{0};
+    std::vector<KaxSegmentIndexTrack> Tracks;
+    std::vector<KaxIndexEntry>        Cues;
+    std::vector<KaxIndexTrack>        CueTracks;    ///< the CueTrackPositions of each track
+    std::vector<std::uint64_t>        CuePositions; ///< indexes in Cues, grouped by track
+    std::vector<KaxSegmentIndexSeek>  SeekEntries;
+    std::vector<KaxIndexCluster>      Clusters;
+};
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_SEGMENT_INDEX_H
@@ -0,0 +1,96 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_SEGMENT_LOADER_H
+#define LIBMATROSKA_SEGMENT_LOADER_H
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <ebml/EbmlStream.h>
+
+#include "matroska/KaxConfig.h"
+
+namespace libmatroska {
+
+class KaxSeekHead;
+class KaxSegment;
+
+/*!
+  \brief Load the top level elements of a Segment on demand
+
+  The SeekHead found at the start of the Segment and the SeekHeads it points to
+  give the position of the top level elements. Only the requested elements are
+  read, the others (Clusters, Tags, Attachments...) are not touched.
+  Elements missing from the SeekHeads are searched by walking the top level
+  element heads from the last position walked.
+
+  The loaded elements are added to the Segment, which owns them.
+
+  \code
+  KaxSegmentLoader loader(stream, *Segment);
+  loader.ReadSeekHeads();
+  auto Info   = loader.Load<KaxInfo>();
+  auto Tracks = loader.Load<KaxTracks>();
+  \endcode
+*/
+class MATROSKA_DLL_API KaxSegmentLoader {
+  public:
+    /// a top level element found in a SeekHead or while walking the Segment
+    struct Entry {
+      std::uint32_t Id;
+      std::uint64_t Position; ///< position in the file
+    };
+
+    /*!
+      \param aSegment a Segment whose head has been read from \a aStream
+    */
+    KaxSegmentLoader(libebml::EbmlStream & aStream, KaxSegment & aSegment);
+
+    /*!
+      \brief read the first SeekHead of the Segment and the SeekHeads it references
+      \return false if no SeekHead was found before the first Cluster
+    */
+    bool ReadSeekHeads();
+
+    /*!
+      \return the position in the file of the first element of this type known, 0 if it's unknown
+    */
+    std::uint64_t GetPosition(const libebml::EbmlCallbacks & Callbacks) const;
+
+    /*!
+      \brief read the first element of this type, once
+      \return nullptr if the element is not found
+    */
+    libebml::EbmlElement * Load(const libebml::EbmlCallbacks & Callbacks);
+    template <typename Type>
+    Type * Load() { return static_cast<Type *>(Load(EBML_INFO(Type))); }
+
+    /// \return the top level elements known so far, in the order they were found
+    const std::vector<Entry> & GetEntries() const { return Entries; }
+
+  private:
+    libebml::EbmlStream & Stream;
+    KaxSegment &          Segment;
+    std::vector<Entry>    Entries;
+    std::unordered_set<std::uint64_t>                   EntryPositions; ///< positions in Entries
+    std::unordered_map<std::uint32_t, std::uint64_t>    FirstPositions; ///< position of the first entry of each ID
+    std::unordered_map<std::uint32_t, libebml::EbmlElement *> Loaded;
+    std::unordered_set<std::uint64_t> SeekHeadsRead;
+    std::uint64_t         WalkPosition;
+    bool                  bWalkDone{false};
+
+    void AddEntry(std::uint32_t Id, std::uint64_t Position);
+    std::uint64_t MaxDataSize(std::uint64_t Position) const;
+    libebml::EbmlElement * ReadElementAt(std::uint64_t Position, const libebml::EbmlCallbacks & Callbacks);
+    bool Walk(std::uint32_t TargetId, bool bStopAtCluster);
+};
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_SEGMENT_LOADER_H
@@ -0,0 +1,60 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_SHARED_MEM_READ_IO_CALLBACK_H
+#define LIBMATROSKA_SHARED_MEM_READ_IO_CALLBACK_H
+
+#include <memory>
+
+#include <ebml/IOCallback.h>
+
+#include "matroska/KaxConfig.h"
+
+namespace libmatroska {
+
+/*!
+  \brief Read-only IOCallback over a reference counted memory area
+
+  The area can be a caller owned slab or a memory mapped file: the shared_ptr
+  deleter is in charge of freeing/unmapping it. Blocks read with SCOPE_ALL_DATA
+  from this callback don't copy their payload, their frames point directly in
+  the area and keep a reference on it until the frames are released.
+
+  \note the frames of such Blocks must be considered read-only
+*/
+class MATROSKA_DLL_API KaxSharedMemReadIOCallback : public libebml::IOCallback {
+  public:
+    /*!
+      \param aData the memory area to read from
+      \param aSize size of the memory area
+      \param aBaseOffset file position of the first byte of the area,
+             reported by getFilePointer() and used for frame positions
+    */
+    KaxSharedMemReadIOCallback(std::shared_ptr<const libebml::binary> aData, std::size_t aSize, std::uint64_t aBaseOffset = 0);
+    ~KaxSharedMemReadIOCallback() override = default;
+
+    std::size_t read(void *Buffer, std::size_t Size) override;
+    void setFilePointer(std::int64_t Offset, libebml::seek_mode Mode = libebml::seek_beginning) override;
+    std::size_t write(const void *Buffer, std::size_t Size) override;
+    std::uint64_t getFilePointer() override { return BaseOffset + Position; }
+    void close() override {}
+
+    const std::shared_ptr<const libebml::binary> & GetSharedData() const { return Data; }
+    /// pointer to the current reading position
+    const libebml::binary * GetCurrentData() const { return Data.get() + Position; }
+    std::size_t GetRemainingBytes() const { return DataSize - Position; }
+
+  private:
+    std::shared_ptr<const libebml::binary> Data;
+    std::size_t DataSize;
+    std::size_t Position{0};
+    std::uint64_t BaseOffset;
+};
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_SHARED_MEM_READ_IO_CALLBACK_H
@@ -0,0 +1,220 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_SMALL_VECTOR_H
+#define LIBMATROSKA_SMALL_VECTOR_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace libmatroska {
+
+/*!
+  \brief vector-like container keeping up to \a N items inside the object
+
+  The heap is only used when more than \a N items are stored.
+  \note as with std::vector, growing past the capacity invalidates pointers to the items
+*/
+template <typename T, std::size_t N>
+class KaxSmallVector {
+  public:
+    using value_type = T;
+    using iterator = T *;
+    using const_iterator = const T *;
+
+    KaxSmallVector() = default;
+    KaxSmallVector(const KaxSmallVector & Other)
+    {
+      reserve(Other.mySize);
+      for (const auto & Item : Other)
+        push_back(Item);
+    }
+    KaxSmallVector(KaxSmallVector && Other) noexcept(std::is_nothrow_move_constructible<T>::value)
+    {
+      steal(Other);
+    }
+    KaxSmallVector & operator=(const KaxSmallVector & Other)
+    {
+      if (this != &Other) {
+        clear();
+        reserve(Other.mySize);
+        for (const auto & Item : Other)
+          push_back(Item);
+      }
+      return *this;
+    }
+    KaxSmallVector & operator=(KaxSmallVector && Other) noexcept(std::is_nothrow_move_constructible<T>::value)
+    {
+      if (this != &Other) {
+        clear();
+        freeHeap();
+        steal(Other);
+      }
+      return *this;
+    }
+    ~KaxSmallVector()
+    {
+      clear();
+      freeHeap();
+    }
+
+    std::size_t size() const { return mySize; }
+    std::size_t capacity() const { return myCapacity; }
+    bool empty() const { return mySize == 0; }
+    bool is_inline() const { return myData == inlineData(); }
+
+    T * data() { return myData; }
+    const T * data() const { return myData; }
+    iterator begin() { return myData; }
+    iterator end() { return myData + mySize; }
+    const_iterator begin() const { return myData; }
+    const_iterator end() const { return myData + mySize; }
+
+    T & operator[](std::size_t Index) { assert(Index < mySize); return myData[Index]; }
+    const T & operator[](std::size_t Index) const { assert(Index < mySize); return myData[Index]; }
+    T & back() { assert(mySize); return myData[mySize - 1]; }
+    const T & back() const { assert(mySize); return myData[mySize - 1]; }
+
+    /// \return true if \a Item is stored in this container
+    bool owns(const T * Item) const { return Item >= myData && Item < myData + mySize; }
+
+    void reserve(std::size_t NewCapacity)
+    {
+      if (NewCapacity <= myCapacity)
+        return;
+      relocate(static_cast<T *>(::operator new(NewCapacity * sizeof(T))), NewCapacity);
+    }
+
+    void push_back(const T & Item) { emplace_back(Item); }
+    void push_back(T && Item) { emplace_back(std::move(Item)); }
+
+    /// \note the arguments may refer to items of this container
+    template <typename... Args>
+    T & emplace_back(Args &&... args)
+    {
+      if (mySize < myCapacity) {
+        T * Item = new (myData + mySize) T(std::forward<Args>(args)...);
+        mySize++;
+        return *Item;
+      }
+
+      // build the new item before moving the old ones out of the storage the arguments may point to
+      const std::size_t NewCapacity = myCapacity * 2;
+      T * NewData = static_cast<T *>(::operator new(NewCapacity * sizeof(T)));
+      T * Item;
+      try {
+        Item = new (NewData + mySize) T(std::forward<Args>(args)...);
+      } catch (...) {
+        ::operator delete(NewData);
+        throw;
+      }
+      relocate(NewData, NewCapacity);
+      mySize++;
+      return *Item;
+    }
+
+    /// append \a Count items copied from \a Items, which may be items of this container
+    void append(const T * Items, std::size_t Count)
+    {
+      if (mySize + Count <= myCapacity) {
+        for (std::size_t i = 0; i < Count; i++)
+          new (myData + mySize + i) T(Items[i]);
+        mySize += Count;
+        return;
+      }
+
+      const std::size_t NewCapacity = std::max(mySize + Count, myCapacity * 2);
+      T * NewData = static_cast<T *>(::operator new(NewCapacity * sizeof(T)));
+      std::size_t Copied = 0;
+      try {
+        for (; Copied < Count; Copied++)
+          new (NewData + mySize + Copied) T(Items[Copied]);
+      } catch (...) {
+        while (Copied)
+          NewData[mySize + --Copied].~T();
+        ::operator delete(NewData);
+        throw;
+      }
+      relocate(NewData, NewCapacity);
+      mySize += Count;
+    }
+
+    void pop_back()
+    {
+      assert(mySize);
+      myData[--mySize].~T();
+    }
+
+    void resize(std::size_t NewSize)
+    {
+      reserve(NewSize);
+      while (mySize > NewSize)
+        pop_back();
+      while (mySize < NewSize)
+        emplace_back();
+    }
+
+    void clear()
+    {
+      while (mySize)
+        pop_back();
+    }
+
+  private:
+    alignas(T) unsigned char myInline[N * sizeof(T)];
+    T *       myData{inlineData()};
+    std::size_t mySize{0};
+    std::size_t myCapacity{N};
+
+    T * inlineData() { return reinterpret_cast<T *>(myInline); }
+    const T * inlineData() const { return reinterpret_cast<const T *>(myInline); }
+
+    /// move the items to \a NewData, with room for \a NewCapacity items
+    void relocate(T * NewData, std::size_t NewCapacity)
+    {
+      for (std::size_t i = 0; i < mySize; i++) {
+        new (NewData + i) T(std::move_if_noexcept(myData[i]));
+        myData[i].~T();
+      }
+      freeHeap();
+      myData = NewData;
+      myCapacity = NewCapacity;
+    }
+
+    void freeHeap()
+    {
+      if (!is_inline()) {
+        ::operator delete(myData);
+        myData = inlineData();
+        myCapacity = N;
+      }
+    }
+
+    void steal(KaxSmallVector & Other)
+    {
+      if (Other.is_inline()) {
+        for (std::size_t i = 0; i < Other.mySize; i++)
+          push_back(std::move(Other.myData[i]));
+        Other.clear();
+      } else {
+        myData = Other.myData;
+        mySize = Other.mySize;
+        myCapacity = Other.myCapacity;
+        Other.myData = Other.inlineData();
+        Other.mySize = 0;
+        Other.myCapacity = N;
+      }
+    }
+};
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_SMALL_VECTOR_H
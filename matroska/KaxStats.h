@@ -0,0 +1,142 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_STATS_H
+#define LIBMATROSKA_STATS_H
+
+#include <array>
+#include <chrono>
+#include <map>
+
+#include <ebml/IOCallback.h>
+
+#include "matroska/KaxConfig.h"
+
+namespace libmatroska {
+
+/// the values counted by KaxStats
+enum KaxStatsCounter {
+  STATS_IO_READS,              ///< calls to read() of a KaxStatsIOCallback
+  STATS_IO_READ_BYTES,         ///< octets read by a KaxStatsIOCallback
+  STATS_IO_WRITES,             ///< calls to write() of a KaxStatsIOCallback
+  STATS_IO_WRITE_BYTES,        ///< octets written by a KaxStatsIOCallback
+  STATS_READ_DATA_COPIES,      ///< Blocks copied in memory by KaxInternalBlock::ReadData()
+  STATS_READ_DATA_COPY_BYTES,  ///< octets copied by KaxInternalBlock::ReadData()
+  STATS_FRAMES_READ,           ///< frames found in the Blocks read, laced or not
+  STATS_DATA_BUFFER_ALLOCS,    ///< frame buffers allocated by the library
+  STATS_DATA_BUFFER_BYTES,     ///< octets of the frame buffers allocated by the library
+  STATS_CLUSTER_RENDERS,       ///< calls to KaxCluster::Render()
+  STATS_CLUSTER_RENDER_NS,     ///< nanoseconds spent in KaxCluster::Render()
+  STATS_COUNTER_COUNT
+};
+
+/// the counters of all the threads at a given time
+struct MATROSKA_DLL_API KaxStatsSnapshot {
+  std::array<std::uint64_t, STATS_COUNTER_COUNT> Counters{};
+  std::map<std::uint32_t, std::uint64_t>         Elements; ///< elements read or created by the library, by EBML ID
+
+  std::uint64_t operator[](KaxStatsCounter Counter) const { return Counters[Counter]; }
+};
+
+/*!
+  \brief statistics of the parsing and muxing done by the library
+
+  Each thread counts in its own counters, they are only merged when a
+  snapshot is asked, the counting doesn't lock. The counting in the library
+  is only built when the library is configured with ENABLE_STATS, otherwise
+  the hooks compile to nothing and only KaxStatsIOCallback counts.
+
+  The elements counted are the Blocks read, the children of the Clusters and
+  BlockGroups read with their Read() method, the top level elements found by
+  KaxSegmentLoader and the Blocks created by KaxBlockBlob. The other elements
+  read through libebml are not counted.
+*/
+class MATROSKA_DLL_API KaxStats {
+  public:
+    /*!
+      \brief receive the start and end of the traced library calls
+      \param Name static string naming the call, like "KaxCluster::Render"
+      \param bBegin true when the call starts, false when it ends
+    */
+    using TraceCallback = void (*)(void * Opaque, const char * Name, bool bBegin);
+
+    /// \return true if the library was built with its statistics hooks
+    static bool IsEnabled();
+
+    static void Add(KaxStatsCounter Counter, std::uint64_t Value);
+    /// count one element created with the EBML ID \a Id
+    static void AddElement(std::uint32_t Id);
+
+    /// \return the counters of all the threads, including the ones that ended
+    static KaxStatsSnapshot Collect();
+    /// \note counts done by other threads at the same time may be lost
+    static void Reset();
+
+    /// \return the name of \a Counter, for display
+    static const char * CounterName(KaxStatsCounter Counter);
+
+    /*!
+      \brief route the traced calls to \a Callback, nullptr to stop tracing
+      \note set it when no other thread uses the library
+    */
+    static void SetTraceCallback(TraceCallback Callback, void * Opaque = nullptr);
+    static void TraceBegin(const char * Name);
+    static void TraceEnd(const char * Name);
+};
+
+/*!
+  \brief trace a call for its lifetime and add its duration to a counter
+*/
+class MATROSKA_DLL_API KaxStatsScope {
+  public:
+    /// \param aCounter the counter receiving the nanoseconds spent, STATS_COUNTER_COUNT for none
+    explicit KaxStatsScope(const char * aName, KaxStatsCounter aCounter = STATS_COUNTER_COUNT);
+    ~KaxStatsScope();
+
+    KaxStatsScope(const KaxStatsScope &) = delete;
+    KaxStatsScope & operator=(const KaxStatsScope &) = delete;
+
+  private:
+    const char * const                          Name;
+    const KaxStatsCounter                       Counter;
+    const std::chrono::steady_clock::time_point Start;
+};
+
+/*!
+  \brief IOCallback counting the reads and writes done on another IOCallback
+  \note the counting is done even when the library is built without ENABLE_STATS
+*/
+class MATROSKA_DLL_API KaxStatsIOCallback : public libebml::IOCallback {
+  public:
+    explicit KaxStatsIOCallback(libebml::IOCallback & aSource) :Source(aSource) {}
+    ~KaxStatsIOCallback() override = default;
+
+    std::size_t read(void *Buffer, std::size_t Size) override;
+    void setFilePointer(std::int64_t Offset, libebml::seek_mode Mode = libebml::seek_beginning) override;
+    std::size_t write(const void *Buffer, std::size_t Size) override;
+    std::uint64_t getFilePointer() override { return Source.getFilePointer(); }
+    void close() override { Source.close(); }
+
+  private:
+    libebml::IOCallback & Source;
+};
+
+} // namespace libmatroska
+
+#if defined(MATROSKA_STATS)
+#define MATROSKA_STATS_ADD(counter, value)   libmatroska::KaxStats::Add(libmatroska::counter, value)
+#define MATROSKA_STATS_ELEMENT(id)           libmatroska::KaxStats::AddElement(id)
+#define MATROSKA_STATS_SCOPE(name, counter)  libmatroska::KaxStatsScope MatroskaStatsScope(name, libmatroska::counter)
+#define MATROSKA_TRACE_SCOPE(name)           libmatroska::KaxStatsScope MatroskaStatsScope(name)
+#else // MATROSKA_STATS
+#define MATROSKA_STATS_ADD(counter, value)   do {} while (0)
+#define MATROSKA_STATS_ELEMENT(id)           do {} while (0)
+#define MATROSKA_STATS_SCOPE(name, counter)  do {} while (0)
+#define MATROSKA_TRACE_SCOPE(name)           do {} while (0)
+#endif // MATROSKA_STATS
+
+#endif // LIBMATROSKA_STATS_H
@@ -0,0 +1,105 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_TRACK_ENCODING_H
+#define LIBMATROSKA_TRACK_ENCODING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <ebml/EbmlTypes.h>
+
+#include "matroska/KaxConfig.h"
+
+namespace libmatroska {
+
+class DataBuffer;
+class KaxTrackEntry;
+
+/*!
+  \brief a frame decoded with the ContentEncodings of its track, in up to 2 parts
+  \note the parts point in the frame, the stripped header of the track or the
+  buffer of the KaxTrackEncoding, they are valid until the next Decode()
+*/
+struct MATROSKA_DLL_API KaxFrameView {
+  const libebml::binary * Prefix{nullptr}; ///< the header removed by header stripping, if any
+  std::size_t             PrefixSize{0};
+  const libebml::binary * Data{nullptr};
+  std::size_t             DataSize{0};
+
+  std::size_t Size() const { return PrefixSize + DataSize; }
+  /// copy the whole frame in \a Buffer which must hold Size() octets
+  void CopyTo(libebml::binary * Buffer) const;
+};
+
+/*!
+  \brief decode the frames of a track with its ContentEncodings
+
+  The ContentEncodings of the track are read once. Header stripping is decoded
+  without copy, the stripped header and the frame are given as two parts of a
+  KaxFrameView. The other compressions are decoded with the Decompressor set by
+  the application in a buffer reused for all the frames, libmatroska doesn't
+  depend on the compression libraries.
+
+  \code
+  KaxTrackEncoding Encoding(Track);
+  Encoding.SetDecompressor(MyZlibInflate);
+  KaxFrameView Frame;
+  if (Block.GetDecodedFrame(0, Encoding, Frame))
+    ...
+  \endcode
+*/
+class MATROSKA_DLL_API KaxTrackEncoding {
+  public:
+    /*!
+      \brief decompress \a InputSize octets of \a Input with the ContentCompAlgo \a Algo into \a Output
+      \param Output the buffer to fill, its memory is reused between the frames
+      \return false if the data can't be decompressed
+    */
+    using Decompressor = std::function<bool(std::uint64_t Algo, const libebml::binary * Input, std::size_t InputSize, std::vector<libebml::binary> & Output)>;
+
+    /// ContentCompAlgo values
+    enum CompressionAlgo : std::uint64_t {
+      COMPRESSION_ZLIB         = 0,
+      COMPRESSION_BZLIB        = 1,
+      COMPRESSION_LZO1X        = 2,
+      COMPRESSION_HEADER_STRIP = 3,
+    };
+
+    explicit KaxTrackEncoding(const KaxTrackEntry & Track);
+
+    /// \return true if the frames of the track are stored as they are
+    bool IsPassthrough() const { return Steps.empty(); }
+    /// \return true if the frames can be decoded, encryption and missing decompressors aren't supported
+    bool IsSupported() const;
+
+    void SetDecompressor(Decompressor aDecompressor) { myDecompressor = std::move(aDecompressor); }
+
+    /*!
+      \brief decode a frame of the track
+      \return false if the frame can't be decoded
+    */
+    bool Decode(const DataBuffer & Frame, KaxFrameView & View);
+    bool Decode(const libebml::binary * Frame, std::size_t FrameSize, KaxFrameView & View);
+
+  private:
+    /// a ContentEncoding that applies to the frames
+    struct Step {
+      bool                         bEncrypted;
+      std::uint64_t                Algo;
+      std::vector<libebml::binary> Settings; ///< the stripped header for COMPRESSION_HEADER_STRIP
+    };
+    std::vector<Step>            Steps; ///< in decoding order
+    Decompressor                 myDecompressor;
+    std::vector<libebml::binary> Buffers[2]; ///< decoded data, alternated between steps
+};
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_TRACK_ENCODING_H
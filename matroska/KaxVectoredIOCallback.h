@@ -0,0 +1,56 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_VECTORED_IO_CALLBACK_H
+#define LIBMATROSKA_VECTORED_IO_CALLBACK_H
+
+#include <cstddef>
+
+#include <ebml/IOCallback.h>
+
+#include "matroska/KaxConfig.h"
+
+namespace libmatroska {
+
+/*!
+  \brief one buffer of a scatter-gather write
+*/
+struct KaxIOVector {
+  const void * Buffer;
+  std::size_t  Size;
+};
+
+/*!
+  \brief optional interface of an IOCallback able to write several buffers at once
+
+  Add it as a second base of an IOCallback (e.g. on top of writev(2)) and the
+  Blocks will write their head and all their frames in a single call.
+
+  \code
+  class MyFile : public libebml::StdIOCallback, public KaxVectoredIOCallback { ... };
+  \endcode
+*/
+class MATROSKA_DLL_API KaxVectoredIOCallback {
+  public:
+    virtual ~KaxVectoredIOCallback() = default;
+
+    /*!
+      \brief write all the buffers in order
+      \note like IOCallback::writeFully it must throw if not everything could be written
+    */
+    virtual void writeFullyV(const KaxIOVector * Vectors, std::size_t Count) = 0;
+};
+
+/*!
+  \brief write the buffers with KaxVectoredIOCallback::writeFullyV() when \a output supports it,
+  with one IOCallback::writeFully() per buffer otherwise
+*/
+MATROSKA_DLL_API void WriteVectors(libebml::IOCallback & output, const KaxIOVector * Vectors, std::size_t Count);
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_VECTORED_IO_CALLBACK_H
@@ -0,0 +1,189 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+#include "matroska/KaxAttachmentStream.h"
+#include "matroska/KaxSegment.h"
+#include "matroska/KaxSemantic.h"
+
+using namespace libebml;
+
+namespace libmatroska {
+
+namespace {
+
+/// octets copied at once from the FileData sources
+constexpr std::size_t CopyChunkSize = 64 * 1024;
+
+/*!
+  \brief write the head of an element with its size coded on 8 octets
+  \return the size of the head
+*/
+std::size_t WriteHead8(IOCallback & output, const EbmlId & Id, std::uint64_t Size)
+{
+  binary Head[4 + 8];
+  Id.Fill(Head);
+  const std::size_t IdLength = EBML_ID_LENGTH(Id);
+  Head[IdLength] = 0x01;
+  for (std::size_t i = 1; i < 8; i++)
+    Head[IdLength + i] = static_cast<binary>(Size >> (8 * (7 - i)));
+  output.writeFully(Head, IdLength + 8);
+  return IdLength + 8;
+}
+
+} // namespace
+
+std::size_t KaxFileDataIOCallback::read(void *Buffer, std::size_t aSize)
+{
+  if (Position >= Size)
+    return 0;
+  const auto Available = static_cast<std::size_t>(std::min<std::uint64_t>(aSize, Size - Position));
+  Source.setFilePointer(Start + Position, seek_beginning);
+  const std::size_t Read = Source.read(Buffer, Available);
+  Position += Read;
+  return Read;
+}
+
+void KaxFileDataIOCallback::setFilePointer(std::int64_t Offset, seek_mode Mode)
+{
+  std::int64_t Target;
+  switch (Mode) {
+    case seek_current: Target = static_cast<std::int64_t>(Position) + Offset; break;
+    case seek_end:     Target = static_cast<std::int64_t>(Size) + Offset; break;
+    case seek_beginning:
+    default:           Target = Offset; break;
+  }
+  Position = static_cast<std::uint64_t>(std::clamp<std::int64_t>(Target, 0, static_cast<std::int64_t>(Size)));
+}
+
+std::size_t KaxFileDataIOCallback::write(const void * /* Buffer */, std::size_t /* Size */)
+{
+  throw std::runtime_error("KaxFileDataIOCallback is read-only");
+}
+
+KaxAttachmentReader::KaxAttachmentReader(EbmlStream & aStream, const KaxSegment & aSegment)
+  :Stream(aStream)
+  ,Segment(aSegment)
+{
+}
+
+bool KaxAttachmentReader::Read(std::uint64_t Position)
+{
+  auto & Input = Stream.I_O();
+  Input.setFilePointer(Position, seek_beginning);
+  int UpperLevel = 0;
+  std::unique_ptr<EbmlElement> Element(Stream.FindNextElement(EBML_CONTEXT(&Segment), UpperLevel, UINT64_MAX, false));
+  if (!Element || UpperLevel != 0 || Element->GetElementPosition() != Position ||
+      EbmlId(*Element) != EBML_ID(KaxAttachments) || !Element->IsFiniteSize())
+    return false;
+
+  const std::uint64_t End = Element->GetEndPosition();
+  std::uint64_t ChildPosition = Element->GetDataStart();
+  while (ChildPosition < End) {
+    Input.setFilePointer(ChildPosition, seek_beginning);
+    std::unique_ptr<EbmlElement> Child(Stream.FindNextElement(EBML_CONTEXT(Element), UpperLevel, End - ChildPosition, true));
+    if (!Child || UpperLevel != 0 || !Child->IsFiniteSize())
+      break;
+    if (EbmlId(*Child) == EBML_ID(KaxAttached))
+      ReadAttached(*Child);
+    ChildPosition = Child->GetEndPosition();
+  }
+  return true;
+}
+
+/*!
+  \brief read the children of an AttachedFile, except its FileData
+*/
+void KaxAttachmentReader::ReadAttached(const EbmlElement & Attached)
+{
+  auto & Input = Stream.I_O();
+  KaxAttachmentEntry Entry;
+
+  const std::uint64_t End = Attached.GetEndPosition();
+  std::uint64_t ChildPosition = Attached.GetDataStart();
+  while (ChildPosition < End) {
+    Input.setFilePointer(ChildPosition, seek_beginning);
+    int UpperLevel = 0;
+    std::unique_ptr<EbmlElement> Child(Stream.FindNextElement(EBML_CONTEXT(&Attached), UpperLevel, End - ChildPosition, true));
+    if (!Child || UpperLevel != 0 || !Child->IsFiniteSize())
+      break;
+    ChildPosition = Child->GetEndPosition();
+
+    const EbmlId & Id = *Child;
+    if (Id == EBML_ID(KaxFileData)) {
+      Entry.DataPosition = Child->GetDataStart();
+      Entry.DataSize     = Child->GetSize();
+      continue;
+    }
+    if (Id != EBML_ID(KaxFileName) && Id != EBML_ID(KaxMimeType) && Id != EBML_ID(KaxFileDescription) && Id != EBML_ID(KaxFileUID))
+      continue;
+
+    Child->ReadData(Input);
+    if (Id == EBML_ID(KaxFileName))
+      Entry.Name = static_cast<const KaxFileName &>(*Child).GetValueUTF8();
+    else if (Id == EBML_ID(KaxMimeType))
+      Entry.MediaType = static_cast<const KaxMimeType &>(*Child).GetValue();
+    else if (Id == EBML_ID(KaxFileDescription))
+      Entry.Description = static_cast<const KaxFileDescription &>(*Child).GetValueUTF8();
+    else
+      Entry.UID = static_cast<const KaxFileUID &>(*Child).GetValue();
+  }
+
+  Attachments.push_back(std::move(Entry));
+}
+
+KaxFileDataIOCallback KaxAttachmentReader::OpenData(const KaxAttachmentEntry & Entry) const
+{
+  return KaxFileDataIOCallback(Stream.I_O(), Entry.DataPosition, Entry.DataSize);
+}
+
+void KaxAttachmentWriter::AddFile(KaxAttached & aAttached, IOCallback & aData, std::uint64_t aSize)
+{
+  Files.push_back({&aAttached, &aData, aSize});
+}
+
+std::uint64_t KaxAttachmentWriter::Render(IOCallback & output, const ShouldWrite & writeFilter)
+{
+  const std::size_t AttachedHeadSize = EBML_ID_LENGTH(EBML_ID(KaxAttached)) + 8;
+  const std::size_t FileDataHeadSize = EBML_ID_LENGTH(EBML_ID(KaxFileData)) + 8;
+
+  // the FileData is mandatory, it's not in the AttachedFile yet
+  std::vector<std::uint64_t> AttachedSizes;
+  std::uint64_t AttachmentsSize = 0;
+  for (const auto & f : Files) {
+    f.Attached->UpdateSize(writeFilter, true);
+    AttachedSizes.push_back(f.Attached->GetSize() + FileDataHeadSize + f.Size);
+    AttachmentsSize += AttachedHeadSize + AttachedSizes.back();
+  }
+
+  std::uint64_t Written = WriteHead8(output, EBML_ID(KaxAttachments), AttachmentsSize);
+  std::vector<binary> Chunk;
+  for (std::size_t i = 0; i < Files.size(); i++) {
+    const auto & f = Files[i];
+    Written += WriteHead8(output, EBML_ID(KaxAttached), AttachedSizes[i]);
+    for (const auto & Child : *f.Attached)
+      Written += Child->Render(output, writeFilter, false, true);
+
+    Written += WriteHead8(output, EBML_ID(KaxFileData), f.Size);
+    Chunk.resize(static_cast<std::size_t>(std::min<std::uint64_t>(f.Size, CopyChunkSize)));
+    for (std::uint64_t Remaining = f.Size; Remaining != 0;) {
+      const auto Size = static_cast<std::size_t>(std::min<std::uint64_t>(Remaining, Chunk.size()));
+      if (f.Data->read(Chunk.data(), Size) != Size)
+        throw std::runtime_error("the attached file is shorter than its size");
+      output.writeFully(Chunk.data(), Size);
+      Remaining -= Size;
+    }
+    Written += f.Size;
+  }
+
+  return Written;
+}
+
+} // namespace libmatroska
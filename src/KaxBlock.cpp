@@ -7,7 +7,9 @@
   \author Julien Coloos    <suiryc @ users.sf.net>
   \author Moritz Bunkus <moritz@bunkus.org>
 */
+#include <algorithm>
 #include <cassert>
+#include <new>
 
 //#include <streams.h>
 
@@ -19,6 +21,10 @@
 #include "matroska/KaxBlockData.h"
 #include "matroska/KaxCluster.h"
 #include "matroska/KaxDefines.h"
+#include "matroska/KaxSharedMemReadIOCallback.h"
+#include "matroska/KaxStats.h"
+#include "matroska/KaxTrackEncoding.h"
+#include "matroska/KaxVectoredIOCallback.h"
 
 using namespace libebml;
 
@@ -29,6 +35,8 @@ DataBuffer * DataBuffer::Clone()
   auto ClonedData = static_cast<binary *>(malloc(mySize * sizeof(binary)));
   assert(ClonedData);
   memcpy(ClonedData, myBuffer ,mySize );
+  MATROSKA_STATS_ADD(STATS_DATA_BUFFER_ALLOCS, 1);
+  MATROSKA_STATS_ADD(STATS_DATA_BUFFER_BYTES, mySize);
 
   auto result = new SimpleDataBuffer(ClonedData, mySize, 0);
   result->bValidValue = bValidValue;
@@ -40,6 +48,8 @@ SimpleDataBuffer::SimpleDataBuffer(const SimpleDataBuffer & ToClone)
 {
   assert(myBuffer);
   memcpy(myBuffer, ToClone.myBuffer ,mySize );
+  MATROSKA_STATS_ADD(STATS_DATA_BUFFER_ALLOCS, 1);
+  MATROSKA_STATS_ADD(STATS_DATA_BUFFER_BYTES, mySize);
   bValidValue = ToClone.bValidValue;
 }
 
@@ -60,6 +70,40 @@ KaxInternalBlock::KaxInternalBlock(const KaxInternalBlock & ElementToClone)
   myBuffers.reserve(ElementToClone.myBuffers.size());
   for (const auto& buffer : ElementToClone.myBuffers)
     myBuffers.push_back(buffer->Clone());
+
+  SizeList           = ElementToClone.SizeList;
+  FrameOffsets       = ElementToClone.FrameOffsets;
+  FirstFrameLocation = ElementToClone.FirstFrameLocation;
+  mLacing            = ElementToClone.mLacing;
+  mInvisible         = ElementToClone.mInvisible;
+
+  if (ElementToClone.myRawPayload != nullptr) {
+    // the frames read are in the shared memory or in our copy of the Block data
+    SharedData = ElementToClone.SharedData;
+    const auto Rebase = [&](const binary * Data) -> const binary * {
+      if (SharedData)
+        return Data;
+      return EbmlBinary::GetBuffer() + (Data - ElementToClone.EbmlBinary::GetBuffer());
+    };
+    myRawPayload     = Rebase(ElementToClone.myRawPayload);
+    myRawPayloadSize = ElementToClone.myRawPayloadSize;
+    if (ElementToClone.myFrameData != nullptr)
+      myFrameData = Rebase(ElementToClone.myFrameData);
+  }
+
+  // the frames loaded after a partial read get their own copy, the others stay unloaded
+  if (ElementToClone.myFrameData != nullptr)
+    return; // the DataBuffer of the frames read are created again when needed
+  myReadFrames.reserve(ElementToClone.myReadFrames.size());
+  for (const auto & Frame : ElementToClone.myReadFrames) {
+    if (Frame.Buffer() == nullptr) {
+      myReadFrames.emplace_back(static_cast<binary *>(nullptr), 0);
+      continue;
+    }
+    std::unique_ptr<binary[]> FrameData(new binary[Frame.Size()]);
+    memcpy(FrameData.get(), Frame.Buffer(), Frame.Size());
+    myReadFrames.emplace_back(std::move(FrameData), Frame.Size());
+  }
 }
 
 
@@ -148,6 +192,116 @@ static std::int64_t ReadSignedVINT(const binary * InBuffer, std::uint32_t & Buff
   return Result - SignedVINTSizeToShift(BufferSize);
 }
 
+/// length of an EBML coded value indexed by its first octet, 0 if invalid
+static constexpr struct VINTLengthTable {
+  std::uint8_t Length[256];
+  constexpr VINTLengthTable() : Length() {
+    for (unsigned int Byte = 1; Byte < 256; Byte++) {
+      std::uint8_t Len = 1;
+      for (unsigned int Mask = 0x80; !(Byte & Mask); Mask >>= 1)
+        Len++;
+      Length[Byte] = Len;
+    }
+  }
+} VINTLengths;
+
+/*!
+  \brief read an EBML coded value of \a Length octets, the length marker removed
+*/
+static std::uint64_t ReadVINTValue(const binary * InBuffer, unsigned int Length)
+{
+  std::uint64_t Result = InBuffer[0] & (0xFF >> Length);
+  for (unsigned int i = 1; i < Length; i++)
+    Result = (Result << 8) | InBuffer[i];
+  return Result;
+}
+
+/// returned by the lace size readers when the lace sizes go past the octets available
+static constexpr std::size_t TruncatedLaceHead = ~std::size_t(0);
+
+/*!
+  \brief read the Xiph lace sizes of \a FrameNum frames
+  \param LaceHead the lace sizes, \a Available octets can be read
+  \param LacedSize size of the lace sizes and frames in the Block
+  \param Sizes receives the \a FrameNum sizes
+  \param Total receives the sum of the \a FrameNum sizes
+  \return the number of octets used by the lace sizes, TruncatedLaceHead if more octets are needed
+  \note throws SafeReadIOCallback::EndOfStreamX if the sizes don't fit in the Block
+*/
+static std::size_t ReadXiphLaceSizes(const binary * LaceHead, std::size_t Available, std::uint64_t LacedSize, unsigned int FrameNum, std::int32_t * Sizes, std::uint64_t & Total)
+{
+  std::size_t Position = 0;
+  Total = 0;
+  for (unsigned int Index = 0; Index < FrameNum; Index++) {
+    std::uint64_t FrameSize = 0;
+    // skip the runs of 0xFF 8 octets at a time
+    while (Position + sizeof(std::uint64_t) <= Available) {
+      std::uint64_t Word;
+      memcpy(&Word, LaceHead + Position, sizeof(Word));
+      if (Word != ~std::uint64_t(0))
+        break;
+      FrameSize += 8 * 0xFF;
+      Position += sizeof(Word);
+      // a run of 0xFF going past the Block is invalid, even if it's not read fully
+      if (Total + FrameSize + Position > LacedSize)
+        throw SafeReadIOCallback::EndOfStreamX(0);
+    }
+    binary Value;
+    do {
+      if (Position >= Available)
+        return TruncatedLaceHead;
+      Value = LaceHead[Position++];
+      FrameSize += Value;
+    } while (Value == 0xFF);
+
+    Total += FrameSize;
+    if (Total + Position > LacedSize)
+      throw SafeReadIOCallback::EndOfStreamX(0);
+    Sizes[Index] = static_cast<std::int32_t>(FrameSize);
+  }
+  return Position;
+}
+
+/*!
+  \brief read the EBML lace sizes of \a FrameNum frames
+  \param LaceHead the lace sizes, \a Available octets can be read
+  \param LacedSize size of the lace sizes and frames in the Block
+  \param Sizes receives the \a FrameNum sizes
+  \param Total receives the sum of the \a FrameNum sizes
+  \return the number of octets used by the lace sizes, TruncatedLaceHead if more octets are needed
+  \note throws SafeReadIOCallback::EndOfStreamX if a size is invalid or the sizes don't fit in the Block
+*/
+static std::size_t ReadEbmlLaceSizes(const binary * LaceHead, std::size_t Available, std::uint64_t LacedSize, unsigned int FrameNum, std::int32_t * Sizes, std::uint64_t & Total)
+{
+  std::size_t Position = 0;
+  std::int64_t FrameSize = 0;
+  Total = 0;
+  for (unsigned int Index = 0; Index < FrameNum; Index++) {
+    if (Position >= Available)
+      return TruncatedLaceHead;
+    const unsigned int Length = VINTLengths.Length[LaceHead[Position]];
+    if (Length == 0)
+      throw SafeReadIOCallback::EndOfStreamX(0);
+    if (Position + Length > Available)
+      return TruncatedLaceHead;
+
+    const auto Value = ReadVINTValue(LaceHead + Position, Length);
+    if (Index == 0)
+      FrameSize = static_cast<std::int64_t>(Value);
+    else
+      FrameSize += static_cast<std::int64_t>(Value) - ((std::int64_t(1) << (7 * Length - 1)) - 1);
+    Position += Length;
+
+    if (FrameSize <= 0)
+      throw SafeReadIOCallback::EndOfStreamX(Length);
+    Total += static_cast<std::uint64_t>(FrameSize);
+    if (Total + Position > LacedSize)
+      throw SafeReadIOCallback::EndOfStreamX(Length);
+    Sizes[Index] = static_cast<std::int32_t>(FrameSize);
+  }
+  return Position;
+}
+
 /*!
   \todo handle flags
   \todo hardcoded limit of the number of frames in a lace should be a parameter
@@ -156,6 +310,9 @@ static std::int64_t ReadSignedVINT(const binary * InBuffer, std::uint32_t & Buff
 bool KaxInternalBlock::AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, DataBuffer & buffer, LacingType lacing, bool invisible)
 {
   SetValueIsSet();
+  if (myBuffers.empty() && (myFrameData != nullptr || !myReadFrames.empty()))
+    KeepReadFrames();
+  myRawPayload = nullptr;
   if (myBuffers.empty()) {
     // first frame
     Timestamp = timestamp;
@@ -164,6 +321,7 @@ bool KaxInternalBlock::AddFrame(const KaxTrackEntry & track, std::uint64_t times
     mLacing = lacing;
   }
   myBuffers.push_back(&buffer);
+  bLacingPrepared = false;
 
   // we don't allow more than 8 frames in a Block because the overhead improvement is minimal
   if (myBuffers.size() >= 8 || lacing == LACING_NONE)
@@ -178,6 +336,54 @@ bool KaxInternalBlock::AddFrame(const KaxTrackEntry & track, std::uint64_t times
   return true;
 }
 
+bool KaxInternalBlock::AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, FrameBuffer && buffer, LacingType lacing, bool invisible)
+{
+  return AddFrame(track, timestamp, StoreFrame(std::move(buffer)), lacing, invisible);
+}
+
+DataBuffer & KaxInternalBlock::StoreFrame(FrameBuffer && buffer)
+{
+  if (myFrames.size() < myFrames.capacity())
+    return myFrames.emplace_back(std::move(buffer));
+
+  // the stored frames are about to move out of the Block, remember which ones are used
+  KaxSmallVector<std::size_t, InlineFrames> Stored;
+  for (const auto Buffer : myBuffers) {
+    std::size_t Index = 0;
+    while (Index < myFrames.size() && Buffer != &myFrames[Index])
+      Index++;
+    Stored.push_back(Index);
+  }
+
+  auto & Result = myFrames.emplace_back(std::move(buffer));
+  for (std::size_t i = 0; i < Stored.size(); i++) {
+    if (Stored[i] < myFrames.size() - 1)
+      myBuffers[i] = &myFrames[Stored[i]];
+  }
+  return Result;
+}
+
+bool KaxInternalBlock::OwnsFrame(const DataBuffer * Buffer) const
+{
+  for (const auto & Frame : myFrames) {
+    if (Buffer == &Frame)
+      return true;
+  }
+  return false;
+}
+
+void KaxInternalBlock::KeepReadFrames()
+{
+  for (std::size_t Index = 0; Index < SizeList.size(); Index++) {
+    if (myFrameData != nullptr)
+      myBuffers.push_back(&StoreFrame(FrameBuffer(const_cast<binary *>(myFrameData) + FrameOffsets[Index], SizeList[Index])));
+    else if (Index < myReadFrames.size() && myReadFrames[Index].Buffer() != nullptr)
+      myBuffers.push_back(&StoreFrame(std::move(myReadFrames[Index])));
+  }
+  myReadFrames.clear();
+  myFrameData = nullptr;
+}
+
 /*!
   \return Returns the lacing type that produces the smallest footprint.
 */
@@ -206,55 +412,102 @@ LacingType KaxInternalBlock::GetBestLacingType() const {
   return LACING_EBML;
 }
 
-filepos_t KaxInternalBlock::UpdateSize(const ShouldWrite &, bool /* bForceRender */)
+/*!
+  \brief compute the lacing used to write the frames and the matching lace head, if not done yet
+*/
+void KaxInternalBlock::PrepareLacing()
 {
-  LacingType LacingHere;
-  assert(!EbmlBinary::GetBuffer()); // Data is not used for KaxInternalBlock
-  assert(TrackNumber < 0x4000); // no more allowed for the moment
+  if (bLacingPrepared)
+    return;
+
   unsigned int i;
 
-  // compute the final size of the data
-  switch (myBuffers.size()) {
-    case 0:
-      SetSize_(0);
-      break;
-    case 1:
-      SetSize_(4 + myBuffers[0]->Size());
+  if (myBuffers.size() <= 1)
+    myRenderLacing = LACING_NONE;
+  else if (mLacing == LACING_NONE)
+    myRenderLacing = LACING_EBML; // supposedly the best of all
+  else if (mLacing == LACING_AUTO)
+    myRenderLacing = GetBestLacingType();
+  else
+    myRenderLacing = mLacing;
+
+  myLaceHead.clear();
+  if (myRenderLacing != LACING_NONE) {
+    // number of laces
+    myLaceHead.push_back(static_cast<binary>(myBuffers.size()-1));
+  }
+
+  switch (myRenderLacing) {
+    case LACING_XIPH:
+      // set the size of each member in the lace
+      for (i=0; i<myBuffers.size()-1; i++) {
+        std::uint32_t tmpSize = myBuffers[i]->Size();
+        while (tmpSize >= 0xFF) {
+          myLaceHead.push_back(0xFF);
+          tmpSize -= 0xFF;
+        }
+        myLaceHead.push_back(static_cast<binary>(tmpSize));
+      }
       break;
-    default:
-      SetSize_(4 + 1); // 1 for the lacing head
-      if (mLacing == LACING_AUTO)
-        LacingHere = GetBestLacingType();
-      else
-        LacingHere = mLacing;
-      switch (LacingHere) {
-        case LACING_XIPH:
-          for (i=0; i<myBuffers.size()-1; i++) {
-            SetSize_(GetSize() + myBuffers[i]->Size() + (myBuffers[i]->Size() / 0xFF + 1));
-          }
-          break;
-        case LACING_EBML:
-          SetSize_(GetSize() + myBuffers[0]->Size() + CodedSizeLength(myBuffers[0]->Size(), 0, IsFiniteSize()));
-          for (i=1; i<myBuffers.size()-1; i++) {
-            SetSize_(GetSize() + myBuffers[i]->Size() + SignedVINTLength(static_cast<std::int64_t>(myBuffers[i]->Size()) - static_cast<std::int64_t>(myBuffers[i-1]->Size())));
-          }
-          break;
-        case LACING_FIXED:
-          for (i=0; i<myBuffers.size()-1; i++) {
-            SetSize_(GetSize() + myBuffers[i]->Size());
-          }
-          break;
-        default:
-          i = 0;
-          assert(0);
+    case LACING_EBML:
+      {
+        std::int64_t _Size;
+        int _CodedSize;
+        binary _FinalHead[8]; // 64 bits max coded size
+
+        _Size = myBuffers[0]->Size();
+
+        _CodedSize = CodedSizeLength(_Size, 0, IsFiniteSize());
+
+        // first size in the lace is not a signed
+        CodedValueLength(_Size, _CodedSize, _FinalHead);
+        myLaceHead.append(_FinalHead, _CodedSize);
+
+        // set the size of each member in the lace
+        for (i=1; i<myBuffers.size()-1; i++) {
+          _Size = static_cast<std::int64_t>(myBuffers[i]->Size()) - static_cast<std::int64_t>(myBuffers[i-1]->Size());
+          _CodedSize = SignedVINTLength(_Size);
+          SignedVINTValue(_Size, _CodedSize, _FinalHead);
+          myLaceHead.append(_FinalHead, _CodedSize);
+        }
       }
-      // Size of the last frame (not in lace)
-      SetSize_(GetSize() + myBuffers[i]->Size());
       break;
+    case LACING_FIXED:
+    case LACING_NONE:
+      break;
+    default:
+      assert(0);
+  }
+
+  myFramesSize = 0;
+  for (const auto& myBuf : myBuffers)
+    myFramesSize += myBuf->Size();
+
+  bLacingPrepared = true;
+}
+
+/*!
+  \note the lacing is computed once, until frames are added or released
+*/
+filepos_t KaxInternalBlock::UpdateSize(const ShouldWrite &, bool /* bForceRender */)
+{
+  // the Data of a Block read fully only holds what was read, it's not rendered
+  assert(TrackNumber < 0x4000); // no more allowed for the moment
+
+  if (!myRawPayload && myBuffers.empty()) {
+    SetSize_(0);
+    return 0;
   }
 
-  if (TrackNumber >= 0x80)
-    SetSize_(GetSize() + 1); // the size will be coded with one more octet
+  // Block head, the track number may be coded with one more octet
+  std::uint64_t BlockSize = (TrackNumber >= 0x80) ? 5 : 4;
+  if (myRawPayload)
+    BlockSize += myRawPayloadSize;
+  else {
+    PrepareLacing();
+    BlockSize += myLaceHead.size() + myFramesSize;
+  }
+  SetSize_(BlockSize);
 
   return GetSize();
 }
@@ -306,30 +559,10 @@ filepos_t KaxBlockVirtual::UpdateSize(const ShouldWrite &, bool /* bForceRender
   return GetSize();
 }
 
-/*!
-  \todo more optimisation is possible (render the Block head and don't copy the buffer in memory, care should be taken with the allocation of Data)
-  \todo the actual timestamp to write should be retrieved from the Cluster from here
-*/
-filepos_t KaxInternalBlock::RenderData(IOCallback & output, bool /* bForceRender */, const ShouldWrite &)
+std::size_t KaxInternalBlock::RenderHead(binary (&BlockHead)[5]) const
 {
-  if (myBuffers.empty())
-    return 0;
-
   assert(TrackNumber < 0x4000);
-  binary BlockHead[5];
   auto cursor = BlockHead;
-  unsigned int i;
-
-  if (myBuffers.size() == 1) {
-    SetSize_(4);
-    mLacing = LACING_NONE;
-  } else {
-    if (mLacing == LACING_NONE)
-      mLacing = LACING_EBML; // supposedly the best of all
-    SetSize_(4 + 1); // 1 for the lacing head (number of laced elements)
-  }
-  if (TrackNumber >= 0x80)
-    SetSize_(GetSize() + 1);
 
   // write Block Head
   if (TrackNumber < 0x80) {
@@ -346,10 +579,6 @@ filepos_t KaxInternalBlock::RenderData(IOCallback & output, bool /* bForceRender
 
   *cursor = 0; // flags
 
-  if (mLacing == LACING_AUTO) {
-    mLacing = GetBestLacingType();
-  }
-
   // invisible flag
   if (mInvisible)
     *cursor = 0x08;
@@ -374,77 +603,72 @@ filepos_t KaxInternalBlock::RenderData(IOCallback & output, bool /* bForceRender
       *cursor++ |= 0x04;
       break;
     case LACING_NONE:
+      cursor++;
       break;
     default:
       assert(0);
   }
 
-  output.writeFully(BlockHead, 4 + ((TrackNumber >= 0x80) ? 1 : 0));
-
-  binary tmpValue;
-  switch (mLacing) {
-    case LACING_XIPH:
-      // number of laces
-      tmpValue = myBuffers.size()-1;
-      output.writeFully(&tmpValue, 1);
-
-      // set the size of each member in the lace
-      for (i=0; i<myBuffers.size()-1; i++) {
-        tmpValue = 0xFF;
-        std::uint16_t tmpSize = myBuffers[i]->Size();
-        while (tmpSize >= 0xFF) {
-          output.writeFully(&tmpValue, 1);
-          SetSize_(GetSize() + 1);
-          tmpSize -= 0xFF;
-        }
-        tmpValue = static_cast<binary>(tmpSize);
-        output.writeFully(&tmpValue, 1);
-        SetSize_(GetSize() + 1);
-      }
-      break;
-    case LACING_EBML:
-      // number of laces
-      tmpValue = myBuffers.size()-1;
-      output.writeFully(&tmpValue, 1);
-      {
-        std::int64_t _Size;
-        int _CodedSize;
-        binary _FinalHead[8]; // 64 bits max coded size
-
-        _Size = myBuffers[0]->Size();
+  return cursor - BlockHead;
+}
 
-        _CodedSize = CodedSizeLength(_Size, 0, IsFiniteSize());
+/*!
+  \todo the actual timestamp to write should be retrieved from the Cluster from here
+*/
+filepos_t KaxInternalBlock::RenderData(IOCallback & output, bool /* bForceRender */, const ShouldWrite &)
+{
+  if (!myRawPayload && myBuffers.empty())
+    return 0;
 
-        // first size in the lace is not a signed
-        CodedValueLength(_Size, _CodedSize, _FinalHead);
-        output.writeFully(_FinalHead, _CodedSize);
-        SetSize_(GetSize() + _CodedSize);
+  if (!myRawPayload) {
+    PrepareLacing();
+    mLacing = myRenderLacing;
+  }
 
-        // set the size of each member in the lace
-        for (i=1; i<myBuffers.size()-1; i++) {
-          _Size = static_cast<std::int64_t>(myBuffers[i]->Size()) - static_cast<std::int64_t>(myBuffers[i-1]->Size());
-          _CodedSize = SignedVINTLength(_Size);
-          SignedVINTValue(_Size, _CodedSize, _FinalHead);
-          output.writeFully(_FinalHead, _CodedSize);
-          SetSize_(GetSize() + _CodedSize);
-        }
-      }
-      break;
-    case LACING_FIXED:
-      // number of laces
-      tmpValue = myBuffers.size()-1;
-      output.writeFully(&tmpValue, 1);
-      break;
-    case LACING_NONE:
-      break;
-    default:
-      assert(0);
+  binary BlockHead[5];
+  const std::size_t BlockHeadSize = RenderHead(BlockHead);
+  auto VectoredOutput = dynamic_cast<KaxVectoredIOCallback *>(&output);
+
+  if (myRawPayload) {
+    // passthrough, the lace head and frames are written as read
+    SetSize_(BlockHeadSize + myRawPayloadSize);
+    if (VectoredOutput) {
+      const KaxIOVector Vectors[2] = {{BlockHead, BlockHeadSize}, {myRawPayload, myRawPayloadSize}};
+      VectoredOutput->writeFullyV(Vectors, 2);
+    } else if (GetSize() <= RenderBufferSize) {
+      KaxSmallVector<binary, RenderBufferSize> Head;
+      Head.append(BlockHead, BlockHeadSize);
+      Head.append(myRawPayload, myRawPayloadSize);
+      output.writeFully(Head.data(), Head.size());
+    } else {
+      output.writeFully(BlockHead, BlockHeadSize);
+      output.writeFully(myRawPayload, myRawPayloadSize);
+    }
+    return GetSize();
   }
 
-  // put the data of each frame
-  for (const auto& myBuf : myBuffers) {
-    output.writeFully(myBuf->Buffer(), myBuf->Size());
-    SetSize_(GetSize() + myBuf->Size());
+  // the Block head and the lace head are written at once
+  KaxSmallVector<binary, RenderBufferSize> Head;
+  Head.append(BlockHead, BlockHeadSize);
+  Head.append(myLaceHead.data(), myLaceHead.size());
+
+  SetSize_(Head.size() + myFramesSize);
+
+  if (VectoredOutput) {
+    KaxSmallVector<KaxIOVector, InlineFrames + 1> Vectors;
+    Vectors.push_back({Head.data(), Head.size()});
+    for (const auto& myBuf : myBuffers)
+      Vectors.push_back({myBuf->Buffer(), myBuf->Size()});
+    VectoredOutput->writeFullyV(Vectors.data(), Vectors.size());
+  } else if (GetSize() <= RenderBufferSize) {
+    // small Block, a single write
+    for (const auto& myBuf : myBuffers)
+      Head.append(myBuf->Buffer(), myBuf->Size());
+    output.writeFully(Head.data(), Head.size());
+  } else {
+    output.writeFully(Head.data(), Head.size());
+    for (const auto& myBuf : myBuffers)
+      output.writeFully(myBuf->Buffer(), myBuf->Size());
   }
 
   return GetSize();
@@ -481,263 +705,160 @@ std::uint64_t KaxInternalBlock::ReadInternalHead(IOCallback & input)
   return Result;
 }
 
-/*!
-  \todo better zero copy handling
-*/
-filepos_t KaxInternalBlock::ReadData(IOCallback & input, ScopeMode ReadFully)
+std::size_t KaxInternalBlock::DecodeHead(const binary * Buffer, std::size_t Available)
 {
-  filepos_t Result;
+  SafeReadIOCallback Mem(Buffer, Available);
+  std::uint8_t BlockHeadSize = 4;
 
-  FirstFrameLocation = input.getFilePointer(); // will be updated accordingly below
+  // update internal values
+  TrackNumber = Mem.GetUInt8();
+  if ((TrackNumber & 0x80) == 0) {
+    // there is extra data
+    if ((TrackNumber & 0x40) == 0) {
+      // We don't support track numbers that large !
+      throw SafeReadIOCallback::EndOfStreamX(0);
+    }
+    TrackNumber = (TrackNumber & 0x3F) << 8;
+    TrackNumber += Mem.GetUInt8();
+    BlockHeadSize++;
+  } else {
+    TrackNumber &= 0x7F;
+  }
 
-  SetValueIsSet(false);
+  LocalTimestamp = static_cast<std::int16_t>(Mem.GetUInt16BE());
+  bLocalTimestampUsed = true;
 
-  try {
-    if (ReadFully == SCOPE_ALL_DATA) {
-      Result = EbmlBinary::ReadData(input, ReadFully);
-      if (Result != GetSize())
-        throw SafeReadIOCallback::EndOfStreamX(GetSize() - Result);
+  const std::uint8_t Flags = Mem.GetUInt8();
+  if (static_cast<const EbmlId&>(*this) == EBML_ID(KaxSimpleBlock)) {
+    auto *s = reinterpret_cast<KaxSimpleBlock*>(this);
+    s->SetKeyframe( (Flags & 0x80) != 0 );
+    s->SetDiscardable( (Flags & 0x01) != 0 );
+  }
+  mInvisible = (Flags & 0x08) >> 3;
+  mLacing = static_cast<LacingType>((Flags & 0x06) >> 1);
+
+  if (mLacing == LACING_NONE) {
+    SizeList.resize(1);
+    SizeList[0] = GetSize() - BlockHeadSize;
+    return Mem.GetPosition();
+  }
 
-      binary *const BufferStart = EbmlBinary::GetBuffer();
+  // read the number of frames in the lace
+  const std::uint8_t FrameNum = Mem.GetUInt8(); // number of frames in the lace - 1
+  const std::uint32_t LastBufferSize = GetSize() - BlockHeadSize - 1; // 1 for number of frame
 
-      SafeReadIOCallback Mem(*this);
-      std::uint8_t BlockHeadSize = 4;
+  SizeList.resize(FrameNum + 1);
 
-      // update internal values
-      TrackNumber = Mem.GetUInt8();
-      if ((TrackNumber & 0x80) == 0) {
-        // there is extra data
-        if ((TrackNumber & 0x40) == 0) {
-          // We don't support track numbers that large !
-          throw SafeReadIOCallback::EndOfStreamX(0);
-        }
-        TrackNumber = (TrackNumber & 0x3F) << 8;
-        TrackNumber += Mem.GetUInt8();
-        BlockHeadSize++;
-      } else {
-        TrackNumber &= 0x7F;
+  // decode all the sizes at once from the memory buffer
+  const binary * LaceHead = Buffer + Mem.GetPosition();
+  const std::size_t LaceAvailable = Available - Mem.GetPosition();
+  std::uint64_t LacedSize = 0;
+  std::size_t LaceHeadSize = 0;
+  switch (mLacing) {
+    case LACING_XIPH:
+      LaceHeadSize = ReadXiphLaceSizes(LaceHead, LaceAvailable, LastBufferSize, FrameNum, SizeList.data(), LacedSize);
+      if (LaceHeadSize == TruncatedLaceHead)
+        return 0;
+      SizeList[FrameNum] = static_cast<std::int32_t>(LastBufferSize - LaceHeadSize - LacedSize);
+      break;
+    case LACING_EBML:
+      LaceHeadSize = ReadEbmlLaceSizes(LaceHead, LaceAvailable, LastBufferSize, FrameNum, SizeList.data(), LacedSize);
+      if (LaceHeadSize == TruncatedLaceHead)
+        return 0;
+      SizeList[FrameNum] = static_cast<std::int32_t>(LastBufferSize - LaceHeadSize - LacedSize);
+      break;
+    case LACING_FIXED:
+      for (std::size_t Index=0; Index<=FrameNum; Index++) {
+        // get the size of the frame
+        SizeList[Index] = LastBufferSize / (FrameNum + 1);
       }
+      break;
+    default: // other lacing not supported
+      assert(0);
+  }
 
-      LocalTimestamp = static_cast<std::int16_t>(Mem.GetUInt16BE());
-      bLocalTimestampUsed = true;
+  return Mem.GetPosition() + LaceHeadSize;
+}
 
-      const std::uint8_t Flags = Mem.GetUInt8();
-      if (static_cast<const EbmlId&>(*this) == EBML_ID(KaxSimpleBlock)) {
-        auto *s = reinterpret_cast<KaxSimpleBlock*>(this);
-        s->SetKeyframe( (Flags & 0x80) != 0 );
-        s->SetDiscardable( (Flags & 0x01) != 0 );
-      }
-      mInvisible = (Flags & 0x08) >> 3;
-      mLacing = static_cast<LacingType>((Flags & 0x06) >> 1);
-
-      // put all Frames in the list
-      if (mLacing == LACING_NONE) {
-        FirstFrameLocation += Mem.GetPosition();
-        auto soloFrame = new DataBuffer(BufferStart + Mem.GetPosition(), GetSize() - BlockHeadSize);
-        myBuffers.push_back(soloFrame);
-        SizeList.resize(1);
-        SizeList[0] = GetSize() - BlockHeadSize;
-      } else {
-        // read the number of frames in the lace
-        std::uint32_t LastBufferSize = GetSize() - BlockHeadSize - 1; // 1 for number of frame
-        const std::uint8_t FrameNum = Mem.GetUInt8(); // number of frames in the lace - 1
-        // read the list of frame sizes
-        std::uint8_t Index;
-        std::int32_t FrameSize;
-        std::uint32_t SizeRead;
-        std::uint64_t SizeUnknown;
-
-        SizeList.resize(FrameNum + 1);
-
-        switch (mLacing) {
-          case LACING_XIPH:
-            for (Index=0; Index<FrameNum; Index++) {
-              // get the size of the frame
-              FrameSize = 0;
-              std::uint8_t Value;
-              do {
-                Value = Mem.GetUInt8();
-                FrameSize += Value;
-                LastBufferSize--;
-              } while (Value == 0xFF);
-              SizeList[Index] = FrameSize;
-              LastBufferSize -= FrameSize;
-            }
-            SizeList[Index] = LastBufferSize;
-            break;
-          case LACING_EBML:
-            SizeRead = LastBufferSize;
-            FrameSize = ReadCodedSizeValue(BufferStart + Mem.GetPosition(), SizeRead, SizeUnknown);
-            if (!FrameSize || (static_cast<std::uint32_t>(FrameSize + SizeRead) > LastBufferSize))
-              throw SafeReadIOCallback::EndOfStreamX(SizeRead);
-            SizeList[0] = FrameSize;
-            Mem.Skip(SizeRead);
-            LastBufferSize -= FrameSize + SizeRead;
-
-            for (Index=1; Index<FrameNum; Index++) {
-              // get the size of the frame
-              SizeRead = LastBufferSize;
-              FrameSize += ReadSignedVINT(BufferStart + Mem.GetPosition(), SizeRead);
-              if (!FrameSize || (static_cast<std::uint32_t>(FrameSize + SizeRead) > LastBufferSize))
-                throw SafeReadIOCallback::EndOfStreamX(SizeRead);
-              SizeList[Index] = FrameSize;
-              Mem.Skip(SizeRead);
-              LastBufferSize -= FrameSize + SizeRead;
-            }
-            if (Index <= FrameNum) // Safety check if FrameNum == 0
-              SizeList[Index] = LastBufferSize;
-            break;
-          case LACING_FIXED:
-            for (Index=0; Index<=FrameNum; Index++) {
-              // get the size of the frame
-              SizeList[Index] = LastBufferSize / (FrameNum + 1);
-            }
-            break;
-          default: // other lacing not supported
-            assert(0);
-        }
+filepos_t KaxInternalBlock::ReadData(IOCallback & input, ScopeMode ReadFully)
+{
+  MATROSKA_TRACE_SCOPE("KaxInternalBlock::ReadData");
+  MATROSKA_STATS_ELEMENT(EbmlId(*this).GetValue());
+  filepos_t Result;
 
-        FirstFrameLocation += Mem.GetPosition();
+  FirstFrameLocation = input.getFilePointer(); // will be updated accordingly below
 
-        for (Index=0; Index<=FrameNum; Index++) {
-          auto lacedFrame = new DataBuffer(BufferStart + Mem.GetPosition(), SizeList[Index]);
-          myBuffers.push_back(lacedFrame);
-          Mem.Skip(SizeList[Index]);
-        }
-      }
+  SetValueIsSet(false);
 
-      const auto BufferEnd = BufferStart + GetSize();
-      const std::size_t NumFrames  = myBuffers.size();
+  // drop the frames of a previous read
+  ReleaseFrames();
+  myBuffers.clear();
+  SizeList.clear();
+  FrameOffsets.clear();
 
-      // Sanity checks for frame pointers and boundaries.
-      for (std::size_t Index = 0; Index < NumFrames; ++Index) {
-        const auto FrameStart  = myBuffers[Index]->Buffer();
-        const auto FrameEnd    = FrameStart + myBuffers[Index]->Size();
-        const auto ExpectedEnd = (Index + 1) < NumFrames ? myBuffers[Index + 1]->Buffer() : BufferEnd;
+  try {
+    if (ReadFully == SCOPE_ALL_DATA) {
+      binary *BufferStart;
+      auto SharedInput = dynamic_cast<KaxSharedMemReadIOCallback *>(&input);
+      if (SharedInput && SharedInput->GetRemainingBytes() >= GetSize()) {
+        // zero copy: the frames point in the shared memory
+        SharedData = SharedInput->GetSharedData();
+        BufferStart = const_cast<binary *>(SharedInput->GetCurrentData());
+        SharedInput->setFilePointer(GetSize(), seek_current);
+        Result = GetSize();
+      } else {
+        Result = EbmlBinary::ReadData(input, ReadFully);
+        if (Result != GetSize())
+          throw SafeReadIOCallback::EndOfStreamX(GetSize() - Result);
 
-        if ((FrameStart < BufferStart) || (FrameEnd > BufferEnd) || (FrameEnd != ExpectedEnd))
-          throw SafeReadIOCallback::EndOfStreamX(0);
+        BufferStart = EbmlBinary::GetBuffer();
+        MATROSKA_STATS_ADD(STATS_READ_DATA_COPIES, 1);
+        MATROSKA_STATS_ADD(STATS_READ_DATA_COPY_BYTES, Result);
       }
 
+      // all the Block is available, lace sizes going past it are invalid
+      const std::size_t HeadSize = DecodeHead(BufferStart, GetSize());
+      if (HeadSize == 0)
+        throw SafeReadIOCallback::EndOfStreamX(0);
+      FirstFrameLocation += HeadSize;
+
+      // the track number is coded on 1 or 2 octets
+      const std::size_t BlockHeadSize = (BufferStart[0] & 0x80) ? 4 : 5;
+
+      // the frames are only described by their size and offset, they must end with the Block
+      if (!SetFrameOffsets(GetSize() - HeadSize))
+        throw SafeReadIOCallback::EndOfStreamX(0);
+      MATROSKA_STATS_ADD(STATS_FRAMES_READ, SizeList.size());
+
+      myFrameData      = BufferStart + HeadSize;
+      myRawPayload     = BufferStart + BlockHeadSize;
+      myRawPayloadSize = GetSize() - BlockHeadSize;
       SetValueIsSet();
     } else if (ReadFully == SCOPE_PARTIAL_DATA) {
-      binary _TempHead[5];
-      Result = input.read(_TempHead, 5);
-      if (Result != 5)
+      // read the Block head and lace sizes in one call, more only for unusually large lace heads
+      KaxSmallVector<binary, PartialReadSize> Head;
+      Head.resize(static_cast<std::size_t>(std::min<std::uint64_t>(GetSize(), PartialReadSize)));
+      if (input.read(Head.data(), Head.size()) != Head.size())
         throw SafeReadIOCallback::EndOfStreamX(0);
-      binary *cursor = _TempHead;
-      binary *_tmpBuf;
-      std::uint8_t BlockHeadSize = 4;
-
-      // update internal values
-      TrackNumber = *cursor++;
-      if ((TrackNumber & 0x80) == 0) {
-        // there is extra data
-        if ((TrackNumber & 0x40) == 0) {
-          // We don't support track numbers that large !
-          return Result;
-        }
-        TrackNumber = (TrackNumber & 0x3F) << 8;
-        TrackNumber += *cursor++;
-        BlockHeadSize++;
-      } else {
-        TrackNumber &= 0x7F;
+
+      // invalid data throw right away, only a lace head longer than what was read is read again
+      std::size_t HeadSize;
+      while ((HeadSize = DecodeHead(Head.data(), Head.size())) == 0) {
+        if (Head.size() >= GetSize())
+          throw SafeReadIOCallback::EndOfStreamX(0); // the lace sizes go past the Block
+        const std::size_t Read = Head.size();
+        Head.resize(static_cast<std::size_t>(std::min<std::uint64_t>(GetSize(), 2 * Read)));
+        if (input.read(Head.data() + Read, Head.size() - Read) != Head.size() - Read)
+          throw SafeReadIOCallback::EndOfStreamX(0);
       }
 
-      LocalTimestamp = endian::from_big16(cursor);
-      bLocalTimestampUsed = true;
-      cursor += 2;
+      if (!SetFrameOffsets(GetSize() - HeadSize))
+        throw SafeReadIOCallback::EndOfStreamX(0);
 
-      if (static_cast<const EbmlId&>(*this) == EBML_ID(KaxSimpleBlock)) {
-        auto *s = reinterpret_cast<KaxSimpleBlock*>(this);
-        s->SetKeyframe( (*cursor & 0x80) != 0 );
-        s->SetDiscardable( (*cursor & 0x01) != 0 );
-      }
-      mInvisible = (*cursor & 0x08) >> 3;
-      mLacing = static_cast<LacingType>((*cursor++ & 0x06) >> 1);
-      if (cursor == &_TempHead[4]) {
-        _TempHead[0] = _TempHead[4];
-      } else {
-        Result += input.read(_TempHead, 1);
-      }
+      // leave the input at the start of the first frame
+      FirstFrameLocation += HeadSize;
+      input.setFilePointer(FirstFrameLocation, seek_beginning);
 
-      FirstFrameLocation += cursor - _TempHead;
-
-      // put all Frames in the list
-      if (mLacing != LACING_NONE) {
-        // read the number of frames in the lace
-        const std::uint32_t TotalLacedSize = GetSize() - BlockHeadSize - 1; // 1 for number of frame
-        std::uint32_t LastBufferSize = TotalLacedSize;
-        const std::uint8_t FrameNum = _TempHead[0]; // number of frames in the lace - 1
-        // read the list of frame sizes
-        std::uint8_t Index;
-        std::uint32_t FrameSize;
-        std::uint32_t SizeRead;
-        std::uint64_t SizeUnknown;
-
-        SizeList.resize(FrameNum + 1);
-
-        switch (mLacing) {
-          case LACING_XIPH:
-            for (Index=0; Index<FrameNum; Index++) {
-              // get the size of the frame
-              FrameSize = 0;
-              do {
-                Result += input.read(_TempHead, 1);
-                FrameSize += static_cast<std::uint8_t>(_TempHead[0]);
-                if (FrameSize > TotalLacedSize)
-                  throw SafeReadIOCallback::EndOfStreamX(0);
-                LastBufferSize--;
-
-                FirstFrameLocation++;
-              } while (_TempHead[0] == 0xFF);
-
-              FirstFrameLocation++;
-              SizeList[Index] = FrameSize;
-              LastBufferSize -= FrameSize;
-            }
-            SizeList[Index] = LastBufferSize;
-            break;
-          case LACING_EBML:
-            SizeRead = LastBufferSize;
-            cursor = _tmpBuf = new binary[FrameNum*4]; /// \warning assume the mean size will be coded in less than 4 bytes
-            Result += input.read(cursor, FrameNum*4);
-            FrameSize = ReadCodedSizeValue(cursor, SizeRead, SizeUnknown);
-            if (FrameSize > TotalLacedSize)
-              throw SafeReadIOCallback::EndOfStreamX(0);
-            SizeList[0] = FrameSize;
-            cursor += SizeRead;
-            LastBufferSize -= FrameSize + SizeRead;
-
-            for (Index=1; Index<FrameNum; Index++) {
-              // get the size of the frame
-              SizeRead = LastBufferSize;
-              FrameSize += ReadSignedVINT(cursor, SizeRead);
-              if (FrameSize > TotalLacedSize)
-                throw SafeReadIOCallback::EndOfStreamX(0);
-              SizeList[Index] = FrameSize;
-              cursor += SizeRead;
-              LastBufferSize -= FrameSize + SizeRead;
-            }
-
-            FirstFrameLocation += cursor - _tmpBuf;
-
-            SizeList[Index] = LastBufferSize;
-            delete [] _tmpBuf;
-            break;
-          case LACING_FIXED:
-            for (Index=0; Index<=FrameNum; Index++) {
-              // get the size of the frame
-              SizeList[Index] = LastBufferSize / (FrameNum + 1);
-            }
-            break;
-          default: // other lacing not supported
-            assert(0);
-        }
-      } else {
-        SizeList.resize(1);
-        SizeList[0] = GetSize() - BlockHeadSize;
-      }
       SetValueIsSet(false);
       Result = GetSize();
     } else {
@@ -745,11 +866,19 @@ filepos_t KaxInternalBlock::ReadData(IOCallback & input, ScopeMode ReadFully)
       Result = GetSize();
     }
 
+    // the Cluster is already known, e.g. when the Block is read again
+    if (ParentCluster != nullptr && bLocalTimestampUsed) {
+      Timestamp = ParentCluster->GetBlockGlobalTimestamp(LocalTimestamp);
+      bLocalTimestampUsed = false;
+    }
+
   } catch (const SafeReadIOCallback::EndOfStreamX&) {
     SetValueIsSet(false);
 
+    ReleaseFrames();
     myBuffers.clear();
     SizeList.clear();
+    FrameOffsets.clear();
     Timestamp          = 0;
     LocalTimestamp      = 0;
     TrackNumber        = 0;
@@ -762,6 +891,19 @@ filepos_t KaxInternalBlock::ReadData(IOCallback & input, ScopeMode ReadFully)
   return Result;
 }
 
+void KaxBlockGroup::Read(EbmlStream & inDataStream, const EbmlSemanticContext & Context, int & UpperEltFound, EbmlElement * & FoundElt, bool AllowDummyElt, ScopeMode ReadFully)
+{
+  EbmlMaster::Read(inDataStream, Context, UpperEltFound, FoundElt, AllowDummyElt, ReadFully);
+#if defined(MATROSKA_STATS)
+  // the Block counts itself when it's read
+  MATROSKA_STATS_ELEMENT(EBML_ID(KaxBlockGroup).GetValue());
+  for (const auto & Child : *this) {
+    if (EbmlId(*Child) != EBML_ID(KaxBlock))
+      MATROSKA_STATS_ELEMENT(EbmlId(*Child).GetValue());
+  }
+#endif
+}
+
 bool KaxBlockGroup::AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, DataBuffer & buffer, LacingType lacing)
 {
   auto & theBlock = GetChild<KaxBlock>(*this);
@@ -828,6 +970,21 @@ bool KaxBlockGroup::AddFrame(const KaxTrackEntry & track, std::uint64_t timestam
   return bRes;
 }
 
+bool KaxBlockGroup::AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, FrameBuffer && buffer, LacingType lacing)
+{
+  return AddFrame(track, timestamp, GetChild<KaxBlock>(*this).StoreFrame(std::move(buffer)), lacing);
+}
+
+bool KaxBlockGroup::AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, FrameBuffer && buffer, const KaxBlockGroup & PastBlock, LacingType lacing)
+{
+  return AddFrame(track, timestamp, GetChild<KaxBlock>(*this).StoreFrame(std::move(buffer)), PastBlock, lacing);
+}
+
+bool KaxBlockGroup::AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, FrameBuffer && buffer, const KaxBlockGroup & PastBlock, const KaxBlockGroup & ForwBlock, LacingType lacing)
+{
+  return AddFrame(track, timestamp, GetChild<KaxBlock>(*this).StoreFrame(std::move(buffer)), PastBlock, ForwBlock, lacing);
+}
+
 /*!
   \todo we may cache the reference to the timestamp block
 */
@@ -894,10 +1051,17 @@ void KaxInternalBlock::ReleaseFrames()
   for (int i=myBuffers.size()-1; i>=0; i--) {
     if (myBuffers[i]) {
       myBuffers[i]->FreeBuffer(*myBuffers[i]);
-      delete myBuffers[i];
+      if (!OwnsFrame(myBuffers[i]))
+        delete myBuffers[i];
       myBuffers[i] = nullptr;
     }
   }
+  myFrames.clear();
+  myReadFrames.clear();
+  SharedData.reset();
+  myFrameData  = nullptr;
+  myRawPayload = nullptr;
+  bLacingPrepared = false;
 }
 
 void KaxBlockGroup::SetBlockDuration(std::uint64_t TimeLength)
@@ -947,16 +1111,99 @@ std::int64_t KaxInternalBlock::GetDataPosition(std::size_t FrameNumber)
 {
   std::int64_t _Result = -1;
 
-  if (ValueIsSet() && FrameNumber < SizeList.size()) {
-    _Result = FirstFrameLocation;
+  // the sizes are also known after a SCOPE_PARTIAL_DATA read
+  if (FrameNumber < FrameOffsets.size())
+    _Result = FirstFrameLocation + FrameOffsets[FrameNumber];
 
-    std::size_t _Idx = 0;
-    while(FrameNumber--) {
-      _Result += SizeList[_Idx++];
-    }
+  return _Result;
+}
+
+bool KaxInternalBlock::SetFrameOffsets(std::uint64_t PayloadSize)
+{
+  FrameOffsets.resize(SizeList.size());
+  std::uint64_t Offset = 0;
+  for (std::size_t Index = 0; Index < SizeList.size(); Index++) {
+    if (SizeList[Index] < 0)
+      return false;
+    FrameOffsets[Index] = static_cast<std::uint32_t>(Offset);
+    Offset += SizeList[Index];
   }
+  return Offset == PayloadSize;
+}
 
-  return _Result;
+DataBuffer & KaxInternalBlock::LoadFrame(IOCallback & input, unsigned int iIndex)
+{
+  assert(iIndex < SizeList.size());
+  if (IsFrameLoaded(iIndex))
+    return GetBuffer(iIndex);
+
+  const auto FrameSize = static_cast<std::uint32_t>(SizeList[iIndex]);
+  std::unique_ptr<binary[]> FrameData(new binary[FrameSize]);
+  MATROSKA_STATS_ADD(STATS_DATA_BUFFER_ALLOCS, 1);
+  MATROSKA_STATS_ADD(STATS_DATA_BUFFER_BYTES, FrameSize);
+
+  input.setFilePointer(GetDataPosition(iIndex), seek_beginning);
+  const std::size_t Read = input.read(FrameData.get(), FrameSize);
+  if (Read != FrameSize)
+    throw SafeReadIOCallback::EndOfStreamX(FrameSize - Read);
+
+  // the loaded frames are kept apart from the frames to render, the ones not loaded have no data
+  if (myReadFrames.size() < SizeList.size()) {
+    myReadFrames.reserve(SizeList.size());
+    while (myReadFrames.size() < SizeList.size())
+      myReadFrames.emplace_back(static_cast<binary *>(nullptr), 0);
+  }
+  myReadFrames[iIndex] = FrameBuffer(std::move(FrameData), FrameSize);
+  return myReadFrames[iIndex];
+}
+
+bool KaxInternalBlock::IsFrameLoaded(unsigned int iIndex) const
+{
+  if (iIndex < myBuffers.size())
+    return true;
+  if (myFrameData != nullptr)
+    return iIndex < SizeList.size();
+  return iIndex < myReadFrames.size() && myReadFrames[iIndex].Buffer() != nullptr;
+}
+
+DataBuffer & KaxInternalBlock::GetBuffer(unsigned int iIndex)
+{
+  if (iIndex < myBuffers.size())
+    return *myBuffers[iIndex];
+  assert(IsFrameLoaded(iIndex));
+
+  if (myFrameData != nullptr && myReadFrames.empty()) {
+    // a single allocation for the DataBuffer of all the frames read
+    myReadFrames.reserve(SizeList.size());
+    for (std::size_t Index = 0; Index < SizeList.size(); Index++)
+      myReadFrames.emplace_back(const_cast<binary *>(myFrameData) + FrameOffsets[Index], SizeList[Index]);
+  }
+  return myReadFrames[iIndex];
+}
+
+const binary * KaxInternalBlock::GetFrameData(unsigned int iIndex, std::uint32_t & Size) const
+{
+  if (iIndex < myBuffers.size()) {
+    Size = myBuffers[iIndex]->Size();
+    return myBuffers[iIndex]->Buffer();
+  }
+  if (!IsFrameLoaded(iIndex))
+    return nullptr;
+  if (myFrameData != nullptr) {
+    Size = SizeList[iIndex];
+    return myFrameData + FrameOffsets[iIndex];
+  }
+  Size = myReadFrames[iIndex].Size();
+  return myReadFrames[iIndex].Buffer();
+}
+
+bool KaxInternalBlock::GetDecodedFrame(unsigned int iIndex, KaxTrackEncoding & Encoding, KaxFrameView & View) const
+{
+  std::uint32_t FrameSize;
+  const auto Frame = GetFrameData(iIndex, FrameSize);
+  if (Frame == nullptr)
+    return false;
+  return Encoding.Decode(Frame, FrameSize, View);
 }
 
 std::int64_t KaxInternalBlock::GetFrameSize(std::size_t FrameNumber)
@@ -999,6 +1246,7 @@ bool KaxBlockBlob::AddFrameAuto(const KaxTrackEntry & track, std::uint64_t times
     assert(bUseSimpleBlock == true);
     if (!Block.simpleblock) {
       Block.simpleblock = new KaxSimpleBlock();
+      MATROSKA_STATS_ELEMENT(EBML_ID(KaxSimpleBlock).GetValue());
       Block.simpleblock->SetParent(*ParentCluster);
     }
 
@@ -1022,6 +1270,24 @@ bool KaxBlockBlob::AddFrameAuto(const KaxTrackEntry & track, std::uint64_t times
   return bResult;
 }
 
+bool KaxBlockBlob::AddFrameAuto(const KaxTrackEntry & track, std::uint64_t timestamp, FrameBuffer && buffer, LacingType lacing, const KaxBlockBlob * PastBlock, const KaxBlockBlob * ForwBlock)
+{
+  // create the Block the frame is stored in
+  if ((SimpleBlockMode == BLOCK_BLOB_ALWAYS_SIMPLE) || (SimpleBlockMode == BLOCK_BLOB_SIMPLE_AUTO && !PastBlock && !ForwBlock)) {
+    assert(bUseSimpleBlock == true);
+    if (!Block.simpleblock) {
+      Block.simpleblock = new KaxSimpleBlock();
+      MATROSKA_STATS_ELEMENT(EBML_ID(KaxSimpleBlock).GetValue());
+      Block.simpleblock->SetParent(*ParentCluster);
+    }
+    return AddFrameAuto(track, timestamp, Block.simpleblock->StoreFrame(std::move(buffer)), lacing, PastBlock, ForwBlock);
+  }
+
+  if (!ReplaceSimpleByGroup())
+    return false;
+  return AddFrameAuto(track, timestamp, GetChild<KaxBlock>(*Block.group).StoreFrame(std::move(buffer)), lacing, PastBlock, ForwBlock);
+}
+
 void KaxBlockBlob::SetParent(KaxCluster & aParentCluster)
 {
   ParentCluster = &aParentCluster;
@@ -1041,6 +1307,7 @@ bool KaxBlockBlob::ReplaceSimpleByGroup()
   if (!bUseSimpleBlock) {
     if (!Block.group) {
       Block.group = new KaxBlockGroup();
+      MATROSKA_STATS_ELEMENT(EBML_ID(KaxBlockGroup).GetValue());
     }
   }
   else {
@@ -1048,12 +1315,14 @@ bool KaxBlockBlob::ReplaceSimpleByGroup()
     if (Block.simpleblock) {
       auto old_simpleblock = Block.simpleblock;
       Block.group = new KaxBlockGroup();
+      MATROSKA_STATS_ELEMENT(EBML_ID(KaxBlockGroup).GetValue());
       // _TODO_ : move all the data to the blockgroup
       assert(false);
       // -> while(frame) AddFrame(myBuffer)
       delete old_simpleblock;
     } else {
       Block.group = new KaxBlockGroup();
+      MATROSKA_STATS_ELEMENT(EBML_ID(KaxBlockGroup).GetValue());
     }
   }
   if (ParentCluster)
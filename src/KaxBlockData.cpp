@@ -17,8 +17,28 @@ using namespace libebml;
 
 namespace libmatroska {
 
+namespace {
+
+/// KaxBlockBlob giving access to a BlockGroup it doesn't own
+class BlockGroupView : public KaxBlockBlob {
+  public:
+    explicit BlockGroupView(const KaxBlockGroup & Group)
+      :KaxBlockBlob(BLOCK_BLOB_NO_SIMPLE)
+    {
+      SetBlockGroup(const_cast<KaxBlockGroup &>(Group));
+    }
+    ~BlockGroupView() { Block.group = nullptr; }
+};
+
+} // namespace
+
 const KaxBlockBlob & KaxReferenceBlock::RefBlock() const
 {
+  if (RefdGroup) {
+    if (!GroupBlob)
+      GroupBlob = std::make_shared<const BlockGroupView>(*RefdGroup);
+    return *GroupBlob;
+  }
   assert(RefdBlock);
   return *RefdBlock;
 }
@@ -35,47 +55,43 @@ KaxReferenceBlock::KaxReferenceBlock(const KaxReferenceBlock & ElementToClone)
 {
 }
 
-KaxReferenceBlock::~KaxReferenceBlock()
+const KaxInternalBlock * KaxReferenceBlock::ReferencedBlock() const
 {
-  FreeBlob();
-}
-
-void KaxReferenceBlock::FreeBlob()
-{
-  if (bOurBlob && RefdBlock)
-    delete RefdBlock;
-  RefdBlock = nullptr;
+  if (RefdGroup)
+    return FindChild<const KaxBlock>(*RefdGroup);
+  if (RefdBlock)
+    return &static_cast<KaxInternalBlock &>(*RefdBlock);
+  return nullptr;
 }
 
 filepos_t KaxReferenceBlock::UpdateSize(const ShouldWrite & writeFilter, bool bForceRender)
 {
   if (!bTimestampSet) {
-    assert(RefdBlock);
+    const auto block = ReferencedBlock();
+    assert(block);
     assert(ParentBlock);
 
-    auto &block = static_cast<KaxInternalBlock&>(*RefdBlock);
-    SetValue(static_cast<std::int64_t>(block.GlobalTimestamp()) - static_cast<std::int64_t>(ParentBlock->GlobalTimestamp()) / static_cast<std::int64_t>(ParentBlock->GlobalTimestampScale()));
+    SetValue((static_cast<std::int64_t>(block->GlobalTimestamp()) - static_cast<std::int64_t>(ParentBlock->GlobalTimestamp())) / static_cast<std::int64_t>(ParentBlock->GlobalTimestampScale()));
   }
   return EbmlSInteger::UpdateSize(writeFilter, bForceRender);
 }
 
 void KaxReferenceBlock::SetReferencedBlock(const KaxBlockBlob * aRefdBlock)
 {
-  assert(!RefdBlock);
   assert(aRefdBlock);
-  FreeBlob();
   RefdBlock = aRefdBlock;
-  bOurBlob = true;
+  RefdGroup = nullptr;
+  GroupBlob.reset();
+  bTimestampSet = false;
   SetValueIsSet();
 }
 
 void KaxReferenceBlock::SetReferencedBlock(const KaxBlockGroup & aRefdBlock)
 {
-  FreeBlob();
-  auto block_blob = new KaxBlockBlob(BLOCK_BLOB_NO_SIMPLE);
-  block_blob->SetBlockGroup(*const_cast<KaxBlockGroup*>(&aRefdBlock));
-  RefdBlock = block_blob;
-  bOurBlob = true;
+  RefdBlock = nullptr;
+  RefdGroup = &aRefdBlock;
+  GroupBlob.reset();
+  bTimestampSet = false;
   SetValueIsSet();
 }
 
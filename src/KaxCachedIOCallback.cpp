@@ -0,0 +1,113 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "matroska/KaxCachedIOCallback.h"
+
+using namespace libebml;
+
+namespace libmatroska {
+
+KaxCachedIOCallback::KaxCachedIOCallback(IOCallback & aSource, std::size_t aPageSize, std::size_t aMaxPages)
+  :Source(aSource)
+  ,PageSize(std::max<std::size_t>(aPageSize, 512))
+  ,MaxPages(std::max<std::size_t>(aMaxPages, 1))
+  ,Position(aSource.getFilePointer())
+{
+}
+
+const KaxCachedIOCallback::Page & KaxCachedIOCallback::GetPage(std::uint64_t Index)
+{
+  const auto Found = PageMap.find(Index);
+  if (Found != PageMap.end()) {
+    Hits++;
+    Pages.splice(Pages.begin(), Pages, Found->second);
+    return Pages.front();
+  }
+
+  Misses++;
+  if (Pages.size() >= MaxPages) {
+    PageMap.erase(Pages.back().Index);
+    Pages.pop_back();
+  }
+
+  Pages.push_front(Page{Index, std::vector<binary>(PageSize)});
+  auto & NewPage = Pages.front();
+  try {
+    Source.setFilePointer(Index * PageSize, seek_beginning);
+    NewPage.Data.resize(Source.read(NewPage.Data.data(), PageSize));
+  } catch (...) {
+    Pages.pop_front();
+    throw;
+  }
+  PageMap[Index] = Pages.begin();
+  return NewPage;
+}
+
+std::size_t KaxCachedIOCallback::read(void *Buffer, std::size_t Size)
+{
+  if (Size >= PageSize) {
+    // large reads would only evict the useful pages
+    Source.setFilePointer(Position, seek_beginning);
+    const std::size_t Read = Source.read(Buffer, Size);
+    Position += Read;
+    return Read;
+  }
+
+  auto Output = static_cast<binary *>(Buffer);
+  std::size_t Read = 0;
+  while (Read < Size) {
+    const auto & Current = GetPage(Position / PageSize);
+    const auto Offset = static_cast<std::size_t>(Position % PageSize);
+    if (Offset >= Current.Data.size())
+      break; // end of the source
+    const std::size_t Copy = std::min(Size - Read, Current.Data.size() - Offset);
+    memcpy(Output + Read, Current.Data.data() + Offset, Copy);
+    Read     += Copy;
+    Position += Copy;
+  }
+  return Read;
+}
+
+void KaxCachedIOCallback::setFilePointer(std::int64_t Offset, seek_mode Mode)
+{
+  switch (Mode) {
+    case seek_current:
+      Position = static_cast<std::uint64_t>(std::max<std::int64_t>(0, static_cast<std::int64_t>(Position) + Offset));
+      break;
+    case seek_end:
+      Source.setFilePointer(Offset, seek_end);
+      Position = Source.getFilePointer();
+      break;
+    case seek_beginning:
+    default:
+      Position = static_cast<std::uint64_t>(std::max<std::int64_t>(0, Offset));
+      break;
+  }
+}
+
+std::size_t KaxCachedIOCallback::write(const void * /* Buffer */, std::size_t /* Size */)
+{
+  throw std::runtime_error("KaxCachedIOCallback is read-only");
+}
+
+void KaxCachedIOCallback::close()
+{
+  Invalidate();
+  Source.close();
+}
+
+void KaxCachedIOCallback::Invalidate()
+{
+  Pages.clear();
+  PageMap.clear();
+}
+
+} // namespace libmatroska
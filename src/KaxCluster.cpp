@@ -5,17 +5,74 @@
   \file
   \author Steve Lhomme     <robux4 @ users.sf.net>
 */
+#include <algorithm>
+#include <exception>
+#include <vector>
+
 #include "matroska/KaxCluster.h"
 #include "matroska/KaxBlock.h"
 #include "matroska/KaxContexts.h"
+#include "matroska/KaxCrc32.h"
 #include "matroska/KaxSegment.h"
 #include "matroska/KaxDefines.h"
+#include "matroska/KaxStats.h"
+#include "matroska/KaxVectoredIOCallback.h"
 
 using namespace libebml;
 
 // sub elements
 namespace libmatroska {
 
+namespace {
+
+/// CRC-32 element with a 4 octets value
+constexpr binary Crc32Head[2] = {0xBF, 0x84};
+
+/*!
+  \brief compute the CRC-32 of the data written to another output
+*/
+class Crc32Output : public IOCallback, public KaxVectoredIOCallback {
+  public:
+    explicit Crc32Output(IOCallback & aOutput) :Output(aOutput) {}
+
+    std::size_t read(void * Buffer, std::size_t Size) override { return Output.read(Buffer, Size); }
+    void setFilePointer(std::int64_t Offset, seek_mode Mode = seek_beginning) override { Output.setFilePointer(Offset, Mode); }
+    std::uint64_t getFilePointer() override { return Output.getFilePointer(); }
+    void close() override {}
+
+    std::size_t write(const void * Buffer, std::size_t Size) override
+    {
+      Crc.Update(Buffer, Size);
+      return Output.write(Buffer, Size);
+    }
+
+    void writeFullyV(const KaxIOVector * Vectors, std::size_t Count) override
+    {
+      for (std::size_t i = 0; i < Count; i++)
+        Crc.Update(Vectors[i].Buffer, Vectors[i].Size);
+      WriteVectors(Output, Vectors, Count);
+    }
+
+    std::uint32_t Value() const { return Crc.Value(); }
+
+  private:
+    IOCallback & Output;
+    KaxCrc32     Crc;
+};
+
+/// \return true if \a output can go back to write the CRC-32 value
+bool CanSeek(IOCallback & output)
+{
+  try {
+    output.setFilePointer(0, seek_current);
+    return true;
+  } catch (const std::exception &) {
+    return false;
+  }
+}
+
+} // namespace
+
 KaxCluster::KaxCluster()
   :EbmlMaster(KaxCluster::ClassInfos)
 {}
@@ -41,7 +98,7 @@ bool KaxCluster::AddBlockBlob(KaxBlockBlob * NewBlob)
   return true;
 }
 
-bool KaxCluster::AddFrameInternal(const KaxTrackEntry & track, std::uint64_t timestamp, DataBuffer & buffer, KaxBlockGroup * & MyNewBlock, const KaxBlockGroup * PastBlock, const KaxBlockGroup * ForwBlock, LacingType lacing)
+bool KaxCluster::AddFrameInternal(const KaxTrackEntry & track, std::uint64_t timestamp, DataBuffer * buffer, FrameBuffer * frame, KaxBlockGroup * & MyNewBlock, const KaxBlockGroup * PastBlock, const KaxBlockGroup * ForwBlock, LacingType lacing)
 {
   if (!bFirstFrameInside) {
     bFirstFrameInside = true;
@@ -65,9 +122,12 @@ bool KaxCluster::AddFrameInternal(const KaxTrackEntry & track, std::uint64_t tim
     MyNewBlock = currentNewBlock = &aNewBlock;
   }
 
+  if (buffer == nullptr)
+    buffer = &GetChild<KaxBlock>(*currentNewBlock).StoreFrame(std::move(*frame));
+
   if (PastBlock) {
     if (ForwBlock) {
-      if (currentNewBlock->AddFrame(track, timestamp, buffer, *PastBlock, *ForwBlock, lacing)) {
+      if (currentNewBlock->AddFrame(track, timestamp, *buffer, *PastBlock, *ForwBlock, lacing)) {
         // more data are allowed in this Block
         return true;
       }
@@ -75,7 +135,7 @@ bool KaxCluster::AddFrameInternal(const KaxTrackEntry & track, std::uint64_t tim
       currentNewBlock = nullptr;
       return false;
     }
-    if (currentNewBlock->AddFrame(track, timestamp, buffer, *PastBlock, lacing)) {
+    if (currentNewBlock->AddFrame(track, timestamp, *buffer, *PastBlock, lacing)) {
         // more data are allowed in this Block
         return true;
       }
@@ -83,7 +143,7 @@ bool KaxCluster::AddFrameInternal(const KaxTrackEntry & track, std::uint64_t tim
     return false;
   }
 
-  if (currentNewBlock->AddFrame(track, timestamp, buffer, lacing)) {
+  if (currentNewBlock->AddFrame(track, timestamp, *buffer, lacing)) {
     // more data are allowed in this Block
     return true;
   }
@@ -95,19 +155,37 @@ bool KaxCluster::AddFrameInternal(const KaxTrackEntry & track, std::uint64_t tim
 bool KaxCluster::AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, DataBuffer & buffer, KaxBlockGroup * & MyNewBlock, LacingType lacing)
 {
   assert(Blobs.empty()); // mutually exclusive for the moment
-  return AddFrameInternal(track, timestamp, buffer, MyNewBlock, nullptr, nullptr, lacing);
+  return AddFrameInternal(track, timestamp, &buffer, nullptr, MyNewBlock, nullptr, nullptr, lacing);
 }
 
 bool KaxCluster::AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, DataBuffer & buffer, KaxBlockGroup * & MyNewBlock, const KaxBlockGroup & PastBlock, LacingType lacing)
 {
   assert(Blobs.empty()); // mutually exclusive for the moment
-  return AddFrameInternal(track, timestamp, buffer, MyNewBlock, &PastBlock, nullptr, lacing);
+  return AddFrameInternal(track, timestamp, &buffer, nullptr, MyNewBlock, &PastBlock, nullptr, lacing);
 }
 
 bool KaxCluster::AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, DataBuffer & buffer, KaxBlockGroup * & MyNewBlock, const KaxBlockGroup & PastBlock, const KaxBlockGroup & ForwBlock, LacingType lacing)
 {
   assert(Blobs.empty()); // mutually exclusive for the moment
-  return AddFrameInternal(track, timestamp, buffer, MyNewBlock, &PastBlock, &ForwBlock, lacing);
+  return AddFrameInternal(track, timestamp, &buffer, nullptr, MyNewBlock, &PastBlock, &ForwBlock, lacing);
+}
+
+bool KaxCluster::AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, FrameBuffer && buffer, KaxBlockGroup * & MyNewBlock, LacingType lacing)
+{
+  assert(Blobs.empty()); // mutually exclusive for the moment
+  return AddFrameInternal(track, timestamp, nullptr, &buffer, MyNewBlock, nullptr, nullptr, lacing);
+}
+
+bool KaxCluster::AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, FrameBuffer && buffer, KaxBlockGroup * & MyNewBlock, const KaxBlockGroup & PastBlock, LacingType lacing)
+{
+  assert(Blobs.empty()); // mutually exclusive for the moment
+  return AddFrameInternal(track, timestamp, nullptr, &buffer, MyNewBlock, &PastBlock, nullptr, lacing);
+}
+
+bool KaxCluster::AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, FrameBuffer && buffer, KaxBlockGroup * & MyNewBlock, const KaxBlockGroup & PastBlock, const KaxBlockGroup & ForwBlock, LacingType lacing)
+{
+  assert(Blobs.empty()); // mutually exclusive for the moment
+  return AddFrameInternal(track, timestamp, nullptr, &buffer, MyNewBlock, &PastBlock, &ForwBlock, lacing);
 }
 
 /*!
@@ -115,42 +193,151 @@ bool KaxCluster::AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp,
 */
 filepos_t KaxCluster::Render(IOCallback & output, KaxCues & CueToUpdate, const ShouldWrite& writeFilter)
 {
-  filepos_t Result = 0;
+  MATROSKA_STATS_SCOPE("KaxCluster::Render", STATS_CLUSTER_RENDER_NS);
+  MATROSKA_STATS_ADD(STATS_CLUSTER_RENDERS, 1);
+  const filepos_t Result = RenderBlocks(output, writeFilter);
+  UpdateCues(CueToUpdate);
+  return Result;
+}
+
+filepos_t KaxCluster::RenderData(IOCallback & output, bool bForceRender, const ShouldWrite & writeFilter)
+{
+  if (!HasChecksum() || !bChecksumInPlace || bForceRender || !CanSeek(output))
+    return EbmlMaster::RenderData(output, bForceRender, writeFilter);
+
+  // no copy of the Cluster in memory, the value is written once the children are
+  const std::uint64_t CrcPosition = output.getFilePointer();
+  const binary Placeholder[6] = {Crc32Head[0], Crc32Head[1], 0, 0, 0, 0};
+  output.writeFully(Placeholder, sizeof(Placeholder));
+
+  Crc32Output Checked(output);
+  for (const auto & Element : *this)
+    Element->Render(Checked, writeFilter, false, bForceRender);
+
+  const std::uint64_t End = output.getFilePointer();
+  binary Value[4];
+  KaxCrc32::Store(Checked.Value(), Value);
+  output.setFilePointer(CrcPosition + sizeof(Crc32Head));
+  output.writeFully(Value, sizeof(Value));
+  output.setFilePointer(End);
+
+  return End - CrcPosition;
+}
+
+bool KaxCluster::VerifyCrc32(const binary * Data, std::size_t Size)
+{
+  if (Size < 6 || Data[0] != Crc32Head[0] || Data[1] != Crc32Head[1])
+    return true;
+  return KaxCrc32::Compute(Data + 6, Size - 6) == KaxCrc32::Load(Data + 2);
+}
+
+bool KaxCluster::VerifyCrc32(IOCallback & input, std::uint64_t DataSize)
+{
+  binary Head[6];
+  if (DataSize < sizeof(Head)) {
+    input.setFilePointer(DataSize, seek_current);
+    return true;
+  }
+  if (input.read(Head, sizeof(Head)) != sizeof(Head))
+    return false;
+  DataSize -= sizeof(Head);
+  if (Head[0] != Crc32Head[0] || Head[1] != Crc32Head[1]) {
+    input.setFilePointer(DataSize, seek_current);
+    return true;
+  }
+
+  KaxCrc32 Crc;
+  std::vector<binary> Chunk(static_cast<std::size_t>(std::min<std::uint64_t>(DataSize, 256 * 1024)));
+  while (DataSize != 0) {
+    const auto Size = static_cast<std::size_t>(std::min<std::uint64_t>(DataSize, Chunk.size()));
+    if (input.read(Chunk.data(), Size) != Size)
+      return false;
+    Crc.Update(Chunk.data(), Size);
+    DataSize -= Size;
+  }
+  return Crc.Value() == KaxCrc32::Load(Head + 2);
+}
+
+void KaxCluster::PrepareChildren()
+{
+  if (bRenderPrepared)
+    return;
 
   // update the timestamp of the Cluster before writing
   auto ClusterTimestamp = FindChild<KaxClusterTimestamp>(*this);
   ClusterTimestamp->SetValue(GlobalTimestamp() / GlobalTimestampScale());
 
+  // new school, using KaxBlockBlob
+  for (const auto& blob : Blobs) {
+    if (blob->IsSimpleBlock())
+      PushElement( static_cast<KaxSimpleBlock&>(*blob));
+    else
+      PushElement( static_cast<KaxBlockGroup&>(*blob));
+  }
+  bRenderPrepared = true;
+}
+
+void KaxCluster::Read(EbmlStream & inDataStream, const EbmlSemanticContext & Context, int & UpperEltFound, EbmlElement * & FoundElt, bool AllowDummyElt, ScopeMode ReadFully)
+{
+  EbmlMaster::Read(inDataStream, Context, UpperEltFound, FoundElt, AllowDummyElt, ReadFully);
+#if defined(MATROSKA_STATS)
+  // the BlockGroups and SimpleBlocks count themselves when they are read
+  MATROSKA_STATS_ELEMENT(EBML_ID(KaxCluster).GetValue());
+  for (const auto & Child : *this) {
+    if (EbmlId(*Child) != EBML_ID(KaxBlockGroup) && EbmlId(*Child) != EBML_ID(KaxSimpleBlock))
+      MATROSKA_STATS_ELEMENT(EbmlId(*Child).GetValue());
+  }
+#endif
+}
+
+std::uint64_t KaxCluster::PrepareRender(const ShouldWrite& writeFilter)
+{
+  PrepareChildren();
+  UpdateSize(writeFilter);
+  return ElementSize(writeFilter);
+}
+
+filepos_t KaxCluster::RenderBlocks(IOCallback & output, const ShouldWrite& writeFilter)
+{
+  PrepareChildren();
+  return EbmlMaster::Render(output, writeFilter);
+}
+
+void KaxCluster::UpdateCues(KaxCues & CueToUpdate)
+{
+  // number the Blocks once for the CueBlockNumber of all the cue entries
+  std::uint64_t BlockNumber = 0;
+  BlockNumbers.clear();
+  BlockNumbers.reserve(GetElementList().size());
+  for (const auto& element : GetElementList()) {
+    if (EbmlId(*element) == EBML_ID(KaxSimpleBlock) || EbmlId(*element) == EBML_ID(KaxBlockGroup))
+      BlockNumbers[element] = ++BlockNumber;
+  }
+
   if (Blobs.empty()) {
     // old-school direct KaxBlockGroup
-
-    Result = EbmlMaster::Render(output, writeFilter);
     // For all Blocks add their position on the CueEntry
-
+    CueToUpdate.IndexPendingBlocks();
     for (const auto& element : GetElementList()) {
       if (EbmlId(*element) == EBML_ID(KaxBlockGroup)) {
         CueToUpdate.PositionSet(*static_cast<const KaxBlockGroup *>(element));
       }
     }
   } else {
-    // new school, using KaxBlockBlob
-    for (const auto& blob : Blobs) {
-      if (blob->IsSimpleBlock())
-        PushElement( static_cast<KaxSimpleBlock&>(*blob));
-      else
-        PushElement( static_cast<KaxBlockGroup&>(*blob));
-    }
-
-    Result = EbmlMaster::Render(output, writeFilter);
-
     // For all Blocks add their position on the CueEntry
     for (const auto& blob : Blobs)
       CueToUpdate.PositionSet(*blob);
 
     Blobs.clear();
   }
+  BlockNumbers.clear();
+  bRenderPrepared = false;
+}
 
-  return Result;
+std::uint64_t KaxCluster::GetBlockNumber(const EbmlElement & Block) const
+{
+  const auto Found = BlockNumbers.find(&Block);
+  return Found == BlockNumbers.end() ? 0 : Found->second;
 }
 
 /*!
@@ -0,0 +1,125 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include <atomic>
+#include <cassert>
+#include <new>
+
+#include "matroska/KaxClusterArena.h"
+
+namespace libmatroska {
+
+namespace {
+
+/// stored in front of each object, to know the arena it comes from without a lookup
+struct alignas(std::max_align_t) AllocationHeader {
+  KaxClusterArena *Arena; ///< nullptr for the objects allocated outside an arena
+};
+
+constexpr std::size_t AlignedSize(std::size_t size)
+{
+  return (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+}
+
+thread_local KaxClusterArena *CurrentArena = nullptr;
+
+} // namespace
+
+KaxClusterArena::KaxClusterArena(std::size_t aChunkSize)
+  :ChunkSize(AlignedSize(aChunkSize))
+{
+}
+
+KaxClusterArena::~KaxClusterArena()
+{
+  assert(LiveObjects() == 0); // elements still using the arena memory
+  assert(CurrentArena != this);
+  for (auto Chunk : Chunks)
+    ::operator delete(Chunk);
+}
+
+KaxClusterArena::Scope::Scope(KaxClusterArena & arena)
+  :Previous(CurrentArena)
+{
+  CurrentArena = &arena;
+}
+
+KaxClusterArena::Scope::~Scope()
+{
+  CurrentArena = Previous;
+}
+
+KaxClusterArena *KaxClusterArena::Current()
+{
+  return CurrentArena;
+}
+
+void KaxClusterArena::Reset()
+{
+  assert(LiveObjects() == 0); // elements still using the arena memory
+  // keep the first chunk for the next use
+  for (std::size_t i = 1; i < Chunks.size(); i++)
+    ::operator delete(Chunks[i]);
+  if (Chunks.size() > 1)
+    Chunks.resize(1);
+  if (!Chunks.empty()) {
+    ChunkCursor = Chunks[0];
+    ChunkEnd = Chunks[0] + ChunkSize;
+  }
+  Used = 0;
+}
+
+void *KaxClusterArena::AllocateLocal(std::size_t size)
+{
+  size = AlignedSize(size);
+  if (static_cast<std::size_t>(ChunkEnd - ChunkCursor) < size) {
+    if (size > ChunkSize) {
+      // dedicated chunk, the current one can still be used
+      auto Chunk = static_cast<char *>(::operator new(size));
+      Chunks.push_back(Chunk);
+      Used += size;
+      return Chunk;
+    }
+    auto Chunk = static_cast<char *>(::operator new(ChunkSize));
+    Chunks.push_back(Chunk);
+    ChunkCursor = Chunk;
+    ChunkEnd = Chunk + ChunkSize;
+  }
+  auto Result = ChunkCursor;
+  ChunkCursor += size;
+  Used += size;
+  return Result;
+}
+
+void *KaxClusterArena::Allocate(std::size_t size)
+{
+  auto Arena = CurrentArena;
+  AllocationHeader *Header;
+  if (!Arena)
+    Header = static_cast<AllocationHeader *>(::operator new(sizeof(AllocationHeader) + size));
+  else {
+    Header = static_cast<AllocationHeader *>(Arena->AllocateLocal(sizeof(AllocationHeader) + size));
+    Arena->LiveCount.fetch_add(1, std::memory_order_relaxed);
+  }
+  Header->Arena = Arena;
+  return Header + 1;
+}
+
+void KaxClusterArena::Free(void *ptr) noexcept
+{
+  if (!ptr)
+    return;
+  auto Header = static_cast<AllocationHeader *>(ptr) - 1;
+  if (!Header->Arena) {
+    ::operator delete(Header);
+    return;
+  }
+  assert(Header->Arena->LiveObjects() != 0);
+  Header->Arena->LiveCount.fetch_sub(1, std::memory_order_release);
+}
+
+} // namespace libmatroska
@@ -0,0 +1,340 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "matroska/KaxClusterBlockScanner.h"
+#include "matroska/KaxBlock.h"
+#include "matroska/KaxBlockData.h"
+#include "matroska/KaxCluster.h"
+#include "matroska/KaxSemantic.h"
+#include "KaxParseHelpers.h"
+
+using namespace libebml;
+
+namespace libmatroska {
+
+KaxClusterBlockScanner::KaxClusterBlockScanner(IOCallback & aInput, std::uint64_t aTimestampScale)
+  :Input(aInput)
+  ,TimestampScale(aTimestampScale)
+  ,Position(aInput.getFilePointer())
+  ,ChildrenEnd(Position)
+{
+}
+
+void KaxClusterBlockScanner::SetPosition(std::uint64_t NewPosition)
+{
+  // small elements are skipped in the window
+  if (NewPosition >= Position && NewPosition - Position <= WindowEnd - WindowStart) {
+    WindowStart += static_cast<std::size_t>(NewPosition - Position);
+    Position = NewPosition;
+    return;
+  }
+  Input.setFilePointer(NewPosition, seek_beginning);
+  Position = NewPosition;
+  WindowStart = WindowEnd = 0;
+}
+
+std::size_t KaxClusterBlockScanner::Peek(std::size_t Size)
+{
+  const std::size_t Buffered = WindowEnd - WindowStart;
+  if (Buffered < Size) {
+    memmove(Window, Window + WindowStart, Buffered);
+    WindowStart = 0;
+    WindowEnd = Buffered + Input.read(Window + Buffered, WindowSize - Buffered);
+  }
+  return WindowEnd - WindowStart;
+}
+
+void KaxClusterBlockScanner::SyncInput()
+{
+  if (WindowStart != WindowEnd) {
+    Input.setFilePointer(Position, seek_beginning);
+    WindowStart = WindowEnd = 0;
+  }
+}
+
+void KaxClusterBlockScanner::Seek(std::uint64_t NewPosition)
+{
+  Input.setFilePointer(NewPosition, seek_beginning);
+  Position = ChildrenEnd = NewPosition;
+  WindowStart = WindowEnd = 0;
+  bInCluster = false;
+  bValid = true;
+}
+
+void KaxClusterBlockScanner::Invalidate()
+{
+  bValid = false;
+  bInCluster = false;
+}
+
+bool KaxClusterBlockScanner::ReadBytes(binary * Buffer, std::size_t Size)
+{
+  if (Size <= WindowSize)
+    Peek(Size);
+  const std::size_t Buffered = std::min(Size, WindowEnd - WindowStart);
+  memcpy(Buffer, Window + WindowStart, Buffered);
+  WindowStart += Buffered;
+  Position += Buffered;
+  if (Buffered == Size)
+    return true;
+
+  const std::size_t Read = Input.read(Buffer + Buffered, Size - Buffered);
+  Position += Read;
+  return Read == Size - Buffered;
+}
+
+bool KaxClusterBlockScanner::ReadHead(std::uint32_t & Id, std::uint64_t & Size, bool & UnknownSize)
+{
+  // EBML ID on 4 octets max + coded size on 8 octets max, decoded from memory
+  const std::size_t Available = Peek(12);
+  const binary * Head = Window + WindowStart;
+  if (Available == 0)
+    return false;
+
+  const unsigned int IdLength = internal::VINTLength(Head[0]);
+  if (IdLength == 0 || IdLength > 4 || IdLength >= Available)
+    return false;
+  Id = 0;
+  for (unsigned int i = 0; i < IdLength; i++)
+    Id = (Id << 8) | Head[i];
+
+  const unsigned int SizeLength = internal::VINTLength(Head[IdLength]);
+  if (SizeLength == 0 || IdLength + SizeLength > Available)
+    return false;
+  Size = Head[IdLength] & (0xFF >> SizeLength);
+  for (unsigned int i = 1; i < SizeLength; i++)
+    Size = (Size << 8) | Head[IdLength + i];
+  UnknownSize = (Size == (std::uint64_t(1) << (7 * SizeLength)) - 1);
+
+  WindowStart += IdLength + SizeLength;
+  Position += IdLength + SizeLength;
+  return true;
+}
+
+bool KaxClusterBlockScanner::ReadUInt(std::uint64_t Size, std::uint64_t & Value)
+{
+  binary Buffer[8];
+  if (Size > sizeof(Buffer) || !ReadBytes(Buffer, Size))
+    return false;
+  Value = 0;
+  for (std::uint64_t i = 0; i < Size; i++)
+    Value = (Value << 8) | Buffer[i];
+  return true;
+}
+
+bool KaxClusterBlockScanner::StartCluster(std::uint64_t aClusterPosition)
+{
+  const bool Result = OpenCluster(aClusterPosition);
+  SyncInput();
+  return Result;
+}
+
+bool KaxClusterBlockScanner::OpenCluster(std::uint64_t aClusterPosition)
+{
+  Seek(aClusterPosition);
+
+  std::uint32_t Id;
+  std::uint64_t Size;
+  bool UnknownSize;
+  if (!ReadHead(Id, Size, UnknownSize) || Id != EBML_ID(KaxCluster).GetValue()) {
+    Invalidate();
+    return false;
+  }
+
+  ClusterStart          = aClusterPosition;
+  ClusterData           = Position;
+  bUnknownSize          = UnknownSize;
+  ChildrenEnd           = UnknownSize ? std::numeric_limits<std::uint64_t>::max() : Position + Size;
+  bClusterTimestampSet  = false;
+  ClusterTimestampValue = 0;
+  bInCluster            = true;
+  return true;
+}
+
+void KaxClusterBlockScanner::StartCluster(const KaxCluster & Cluster)
+{
+  Seek(Cluster.GetDataStart());
+
+  ClusterStart          = Cluster.GetElementPosition();
+  ClusterData           = Cluster.GetDataStart();
+  bUnknownSize          = !Cluster.IsFiniteSize();
+  ChildrenEnd           = bUnknownSize ? std::numeric_limits<std::uint64_t>::max() : Cluster.GetDataStart() + Cluster.GetSize();
+  bClusterTimestampSet  = false;
+  ClusterTimestampValue = 0;
+  bInCluster            = true;
+}
+
+bool KaxClusterBlockScanner::NextCluster(std::uint64_t EndPosition)
+{
+  const bool Result = FindCluster(EndPosition);
+  SyncInput();
+  return Result;
+}
+
+bool KaxClusterBlockScanner::FindCluster(std::uint64_t EndPosition)
+{
+  if (bInCluster) {
+    // finish the current Cluster to know where it ends
+    KaxBlockRecord Skipped;
+    while (ScanBlock(Skipped)) {}
+  }
+  if (!bValid)
+    return false;
+
+  SetPosition(ChildrenEnd);
+  while (Position < EndPosition) {
+    const std::uint64_t ElementPosition = Position;
+    std::uint32_t Id;
+    std::uint64_t Size;
+    bool UnknownSize;
+    if (!ReadHead(Id, Size, UnknownSize))
+      return false;
+
+    if (Id == EBML_ID(KaxCluster).GetValue())
+      return OpenCluster(ElementPosition);
+
+    if (UnknownSize)
+      return false; // can't skip it
+    SetPosition(Position + Size);
+  }
+  return false;
+}
+
+bool KaxClusterBlockScanner::ReadBlockHead(std::uint64_t DataStart, std::uint64_t Size, KaxBlockRecord & Record)
+{
+  // track number (8 octets max) + timestamp + flags + number of laced frames
+  binary Head[12];
+  const std::size_t HeadRead = static_cast<std::size_t>(std::min<std::uint64_t>(sizeof(Head), Size));
+  if (HeadRead < 4 || !ReadBytes(Head, HeadRead))
+    return false;
+
+  const std::size_t HeadSize = internal::DecodeBlockHead(Head, HeadRead, Record);
+  if (HeadSize == 0)
+    return false;
+
+  Record.PayloadPosition = DataStart + HeadSize;
+  Record.PayloadSize     = Size - HeadSize;
+  Record.Timestamp       = static_cast<std::uint64_t>((static_cast<std::int64_t>(ClusterTimestampValue) + Record.RelativeTimestamp) * static_cast<std::int64_t>(TimestampScale));
+  return true;
+}
+
+bool KaxClusterBlockScanner::ReadBlockGroup(std::uint64_t GroupEnd, KaxBlockRecord & Record)
+{
+  bool BlockFound = false;
+  Record.IsKeyframe = true;
+
+  while (Position < GroupEnd) {
+    const std::uint64_t ElementPosition = Position;
+    std::uint32_t Id;
+    std::uint64_t Size;
+    bool UnknownSize;
+    if (!ReadHead(Id, Size, UnknownSize) || UnknownSize)
+      return false;
+    const std::uint64_t DataStart = Position;
+    if (DataStart + Size > GroupEnd)
+      return false;
+
+    if (Id == EBML_ID(KaxBlock).GetValue()) {
+      if (BlockFound)
+        return false;
+      Record.BlockPosition = ElementPosition;
+      if (!ReadBlockHead(DataStart, Size, Record))
+        return false;
+      BlockFound = true;
+    } else if (Id == EBML_ID(KaxReferenceBlock).GetValue()) {
+      Record.IsKeyframe = false;
+    } else if (Id == EBML_ID(KaxBlockDuration).GetValue()) {
+      std::uint64_t Duration;
+      if (!ReadUInt(Size, Duration))
+        return false;
+      Record.Duration    = Duration * TimestampScale;
+      Record.HasDuration = true;
+    }
+    SetPosition(DataStart + Size);
+  }
+  return BlockFound;
+}
+
+bool KaxClusterBlockScanner::Next(KaxBlockRecord & Record)
+{
+  const bool Result = ScanBlock(Record);
+  SyncInput();
+  return Result;
+}
+
+bool KaxClusterBlockScanner::ScanBlock(KaxBlockRecord & Record)
+{
+  if (!bInCluster || !bValid)
+    return false;
+
+  while (bUnknownSize || Position < ChildrenEnd) {
+    const std::uint64_t ElementPosition = Position;
+    std::uint32_t Id;
+    std::uint64_t Size;
+    bool UnknownSize;
+    if (!ReadHead(Id, Size, UnknownSize)) {
+      if (bUnknownSize) {
+        // end of the stream
+        ChildrenEnd = ElementPosition;
+        SetPosition(ElementPosition);
+        bInCluster = false;
+      } else
+        Invalidate();
+      return false;
+    }
+
+    if (bUnknownSize && internal::IsTopLevelId(Id)) {
+      // beginning of the next top level element
+      ChildrenEnd = ElementPosition;
+      SetPosition(ElementPosition);
+      bInCluster = false;
+      return false;
+    }
+
+    const std::uint64_t DataStart = Position;
+    if (UnknownSize || (!bUnknownSize && DataStart + Size > ChildrenEnd)) {
+      Invalidate();
+      return false;
+    }
+
+    if (Id == EBML_ID(KaxClusterTimestamp).GetValue()) {
+      if (!ReadUInt(Size, ClusterTimestampValue)) {
+        Invalidate();
+        return false;
+      }
+      bClusterTimestampSet = true;
+    } else if (Id == EBML_ID(KaxSimpleBlock).GetValue() || Id == EBML_ID(KaxBlockGroup).GetValue()) {
+      Record = KaxBlockRecord{};
+      Record.ElementPosition = ElementPosition;
+      Record.IsSimpleBlock   = (Id == EBML_ID(KaxSimpleBlock).GetValue());
+      bool bRead;
+      if (Record.IsSimpleBlock) {
+        Record.BlockPosition = ElementPosition;
+        bRead = ReadBlockHead(DataStart, Size, Record);
+      } else
+        bRead = ReadBlockGroup(DataStart + Size, Record);
+      if (!bRead) {
+        Invalidate();
+        return false;
+      }
+      SetPosition(DataStart + Size);
+      return true;
+    }
+    // CRC-32, Void, Position, PrevSize, etc.
+    SetPosition(DataStart + Size);
+  }
+
+  SetPosition(ChildrenEnd);
+  bInCluster = false;
+  return false;
+}
+
+} // namespace libmatroska
@@ -0,0 +1,196 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+#include <ebml/MemIOCallback.h>
+#include "matroska/KaxClusterPipeline.h"
+#include "matroska/KaxCluster.h"
+#include "matroska/KaxCues.h"
+
+using namespace libebml;
+
+namespace libmatroska {
+
+namespace {
+
+/*!
+  \brief memory output reporting the positions the data will have in the final output
+*/
+class OffsetMemIOCallback : public MemIOCallback {
+  public:
+    OffsetMemIOCallback(std::uint64_t aBaseOffset, std::uint64_t aSize)
+      :MemIOCallback(aSize)
+      ,BaseOffset(aBaseOffset)
+    {}
+
+    void setFilePointer(std::int64_t Offset, seek_mode Mode = seek_beginning) override
+    {
+      if (Mode == seek_beginning)
+        Offset -= static_cast<std::int64_t>(BaseOffset);
+      MemIOCallback::setFilePointer(Offset, Mode);
+    }
+    std::uint64_t getFilePointer() override
+    {
+      return BaseOffset + MemIOCallback::getFilePointer();
+    }
+
+  private:
+    const std::uint64_t BaseOffset;
+};
+
+} // namespace
+
+struct KaxClusterPipeline::Job {
+  KaxCluster & Cluster;
+  const std::uint64_t Position;
+  const std::uint64_t Size;
+  std::unique_ptr<OffsetMemIOCallback> Data;
+  std::exception_ptr Error;
+  bool bDone{false};
+
+  Job(KaxCluster & aCluster, std::uint64_t aPosition, std::uint64_t aSize)
+    :Cluster(aCluster), Position(aPosition), Size(aSize)
+  {}
+};
+
+KaxClusterPipeline::KaxClusterPipeline(IOCallback & aOutput, KaxCues & aCues, unsigned int aWorkers, std::size_t aMaxPending, EbmlElement::ShouldWrite aWriteFilter)
+  :Output(aOutput)
+  ,Cues(aCues)
+  ,WriteFilter(aWriteFilter)
+  ,MaxPending(aMaxPending)
+  ,NextPosition(aOutput.getFilePointer())
+{
+  if (aWorkers == 0)
+    aWorkers = std::max(1u, std::thread::hardware_concurrency());
+  if (MaxPending == 0)
+    MaxPending = 2 * aWorkers;
+
+  Workers.reserve(aWorkers);
+  for (unsigned int i = 0; i < aWorkers; i++)
+    Workers.emplace_back(&KaxClusterPipeline::WorkerLoop, this);
+}
+
+KaxClusterPipeline::~KaxClusterPipeline()
+{
+  try {
+    Flush();
+  } catch (...) {
+  }
+
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    bStopping = true;
+  }
+  WorkAvailable.notify_all();
+  for (auto & Worker : Workers)
+    Worker.join();
+}
+
+std::size_t KaxClusterPipeline::Pending() const
+{
+  std::lock_guard<std::mutex> Guard(Lock);
+  return Jobs.size();
+}
+
+void KaxClusterPipeline::WorkerLoop()
+{
+  std::unique_lock<std::mutex> Guard(Lock);
+  while (true) {
+    WorkAvailable.wait(Guard, [this] { return bStopping || !Queue.empty(); });
+    if (Queue.empty())
+      return; // stopping
+
+    auto Current = Queue.front();
+    Queue.pop_front();
+    Guard.unlock();
+
+    try {
+      Current->Data = std::make_unique<OffsetMemIOCallback>(Current->Position, Current->Size);
+      Current->Cluster.RenderBlocks(*Current->Data, WriteFilter);
+    } catch (...) {
+      Current->Error = std::current_exception();
+    }
+
+    Guard.lock();
+    Current->bDone = true;
+    WorkDone.notify_all();
+  }
+}
+
+/*!
+  \brief write the oldest Cluster if it's rendered
+  \param bWait wait for the rendering of the oldest Cluster
+  \return true if a Cluster was written
+*/
+bool KaxClusterPipeline::CommitFront(bool bWait)
+{
+  std::unique_ptr<Job> Front;
+  {
+    std::unique_lock<std::mutex> Guard(Lock);
+    if (Jobs.empty())
+      return false;
+    if (bWait)
+      WorkDone.wait(Guard, [this] { return Jobs.front()->bDone; });
+    else if (!Jobs.front()->bDone)
+      return false;
+    Front = std::move(Jobs.front());
+    Jobs.pop_front();
+  }
+
+  if (Front->Error)
+    std::rethrow_exception(Front->Error);
+
+  const std::uint64_t RenderedSize = Front->Data->GetDataBufferSize();
+  if (RenderedSize != Front->Size)
+    throw std::runtime_error("KaxClusterPipeline: the Cluster size changed during rendering");
+
+  Output.writeFully(Front->Data->GetDataBuffer(), RenderedSize);
+  Front->Data.reset();
+
+  Front->Cluster.UpdateCues(Cues);
+  if (OnCommit)
+    OnCommit(Front->Cluster, RenderedSize);
+  return true;
+}
+
+std::uint64_t KaxClusterPipeline::Push(KaxCluster & Cluster)
+{
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    if (Jobs.empty())
+      NextPosition = Output.getFilePointer(); // other elements may have been written in between
+  }
+
+  const std::uint64_t Position = NextPosition;
+  const std::uint64_t Size = Cluster.PrepareRender(WriteFilter);
+  NextPosition += Size;
+
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    auto NewJob = std::make_unique<Job>(Cluster, Position, Size);
+    Queue.push_back(NewJob.get());
+    Jobs.push_back(std::move(NewJob));
+  }
+  WorkAvailable.notify_one();
+
+  // write what's ready and keep the amount of memory used bounded
+  while (CommitFront(false)) {}
+  while (Pending() > MaxPending)
+    CommitFront(true);
+
+  return Position;
+}
+
+void KaxClusterPipeline::Flush()
+{
+  while (CommitFront(true)) {}
+}
+
+} // namespace libmatroska
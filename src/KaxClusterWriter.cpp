@@ -0,0 +1,192 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include <algorithm>
+#include <limits>
+
+#include "matroska/KaxClusterWriter.h"
+#include "matroska/KaxBlockData.h"
+#include "matroska/KaxCluster.h"
+#include "matroska/KaxCues.h"
+#include "matroska/KaxCuesData.h"
+#include "matroska/KaxSegment.h"
+#include "matroska/KaxSemantic.h"
+
+using namespace libebml;
+
+namespace libmatroska {
+
+KaxClusterWriter::KaxClusterWriter(IOCallback & aOutput, const KaxSegment & aSegment, KaxCues & aCues, std::uint64_t aTimestampScale)
+  :Output(aOutput)
+  ,Segment(aSegment)
+  ,Cues(aCues)
+  ,TimestampScale(aTimestampScale)
+{
+  Cues.SetGlobalTimestampScale(TimestampScale);
+}
+
+KaxClusterWriter::~KaxClusterWriter()
+{
+  try {
+    Flush();
+  } catch (...) {
+  }
+  ReleaseCluster();
+}
+
+bool KaxClusterWriter::IsCueTrack(std::uint64_t aTrackNumber) const
+{
+  return CueTracks.empty() || std::find(CueTracks.begin(), CueTracks.end(), aTrackNumber) != CueTracks.end();
+}
+
+/*!
+  \return true if a frame of \a aSize octets at \a timestamp can be added to the current Cluster
+*/
+bool KaxClusterWriter::Fits(std::uint64_t timestamp, std::uint64_t aSize) const
+{
+  if (FramesSize + aSize > MaxSize)
+    return false;
+  if (std::max(LastTimestamp, timestamp) - std::min(FirstTimestamp, timestamp) > MaxDuration)
+    return false;
+
+  // the Block timestamp is relative to the Cluster timestamp
+  const std::int64_t Local = (static_cast<std::int64_t>(timestamp) - static_cast<std::int64_t>(ClusterTimestamp)) / static_cast<std::int64_t>(TimestampScale);
+  return Local >= std::numeric_limits<std::int16_t>::min() && Local <= std::numeric_limits<std::int16_t>::max();
+}
+
+void KaxClusterWriter::StartCluster(std::uint64_t timestamp)
+{
+  Cluster = std::make_unique<KaxCluster>();
+  Cluster->SetParent(Segment);
+  Cluster->InitTimestamp(timestamp / TimestampScale, TimestampScale);
+  Cluster->EnableChecksum(bCrc32 && !bLive);
+  Cluster->SetChecksumInPlace(bCrc32InPlace);
+  GetChild<KaxClusterTimestamp>(*Cluster);
+  if (PreviousSize != 0)
+    GetChild<KaxClusterPrevSize>(*Cluster).SetValue(PreviousSize);
+
+  ClusterTimestamp = timestamp / TimestampScale * TimestampScale;
+  FirstTimestamp   = timestamp;
+  LastTimestamp    = timestamp;
+  FramesSize       = 0;
+
+  if (bLive) {
+    // the Cluster head and timestamp are written before the first frame
+    ClusterPosition = Output.getFilePointer();
+    LiveBlocks      = 0;
+    Cluster->SetSizeInfinite();
+    Cluster->SetSizeLength(8);
+    Cluster->WriteHead(Output, 8);
+    GetChild<KaxClusterTimestamp>(*Cluster).SetValue(timestamp / TimestampScale);
+    for (const auto & Element : *Cluster)
+      Element->Render(Output, EbmlElement::WriteSkipDefault, false, true);
+  }
+}
+
+/*!
+  \brief write a Block of the live Cluster and set its CuePoint position
+*/
+void KaxClusterWriter::WriteLiveBlock(KaxBlockBlob & Blob)
+{
+  if (Blob.IsSimpleBlock())
+    static_cast<KaxSimpleBlock &>(Blob).Render(Output);
+  else
+    static_cast<KaxBlockGroup &>(Blob).Render(Output);
+  LiveBlocks++;
+
+  const auto CuePoints = Cues.ListSize();
+  Cues.PositionSet(Blob);
+  if (Cues.ListSize() != CuePoints && LiveBlocks > 1) {
+    // KaxCluster::GetBlockNumber() doesn't know the live Blocks, 1 is the default value
+    auto & Point = static_cast<KaxCuePoint &>(*Cues.GetElementList().back());
+    GetChild<KaxCueBlockNumber>(GetChild<KaxCueTrackPositions>(Point)).SetValue(LiveBlocks);
+  }
+}
+
+void KaxClusterWriter::AddFrame(const KaxTrackEntry & track, std::uint64_t timestamp, FrameBuffer && frame, bool bKeyframe, std::uint64_t aDuration)
+{
+  const std::uint64_t FrameSize = frame.Size();
+  if (Cluster && FramesSize != 0 && !Fits(timestamp, FrameSize))
+    Flush();
+  if (!Cluster)
+    StartCluster(timestamp);
+
+  const std::uint64_t TrackNumber = static_cast<std::uint64_t>(track.TrackNumber());
+  auto Blob = std::make_unique<KaxBlockBlob>(aDuration != 0 ? BLOCK_BLOB_NO_SIMPLE : BLOCK_BLOB_ALWAYS_SIMPLE);
+  Blob->SetParent(*Cluster);
+  Blob->AddFrameAuto(track, timestamp, std::move(frame), LACING_NONE);
+
+  const auto Previous = TrackTimestamps.find(TrackNumber);
+  if (aDuration != 0) {
+    Blob->SetBlockDuration(aDuration);
+    if (!bKeyframe && Previous != TrackTimestamps.end()) {
+      auto & Group = static_cast<KaxBlockGroup &>(*Blob);
+      auto & Reference = GetChild<KaxReferenceBlock>(Group);
+      Reference.SetParentBlock(Group);
+      Reference.SetReferencedTimestamp((static_cast<std::int64_t>(Previous->second) - static_cast<std::int64_t>(timestamp)) / static_cast<std::int64_t>(TimestampScale));
+    }
+  } else
+    static_cast<KaxSimpleBlock &>(*Blob).SetKeyframe(bKeyframe);
+
+  if (bKeyframe && IsCueTrack(TrackNumber))
+    Cues.AddBlockBlob(*Blob);
+
+  if (bLive)
+    WriteLiveBlock(*Blob);
+  else {
+    Cluster->AddBlockBlob(Blob.get());
+    Blobs.push_back(std::move(Blob));
+  }
+
+  FirstTimestamp = std::min(FirstTimestamp, timestamp);
+  LastTimestamp  = std::max(LastTimestamp, timestamp);
+  FramesSize    += FrameSize;
+  TrackTimestamps[TrackNumber] = timestamp;
+}
+
+/*!
+  \brief delete the current Cluster and its Blocks
+*/
+void KaxClusterWriter::ReleaseCluster()
+{
+  if (Cluster) {
+    // the Blocks belong to the Blobs, not to the Cluster
+    for (auto Element : *Cluster) {
+      if (EbmlId(*Element) != EBML_ID(KaxSimpleBlock) && EbmlId(*Element) != EBML_ID(KaxBlockGroup))
+        delete Element;
+    }
+    Cluster->RemoveAll();
+    Cluster.reset();
+  }
+  Blobs.clear();
+}
+
+void KaxClusterWriter::Flush()
+{
+  if (!Cluster)
+    return;
+
+  std::uint64_t Size;
+  const std::uint64_t Position = bLive ? ClusterPosition : Output.getFilePointer();
+  try {
+    if (bLive)
+      Size = Output.getFilePointer() - ClusterPosition; // already written
+    else
+      Size = Cluster->Render(Output, Cues);
+    if (OnCluster)
+      OnCluster(*Cluster, Position, Size);
+  } catch (...) {
+    ReleaseCluster();
+    throw;
+  }
+
+  PreviousSize = Size;
+  ClusterCount++;
+  ReleaseCluster();
+}
+
+} // namespace libmatroska
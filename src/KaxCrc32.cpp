@@ -0,0 +1,290 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include "matroska/KaxCrc32.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MATROSKA_CRC32_PCLMUL 1
+#define MATROSKA_CRC32_TARGET __attribute__((target("pclmul,sse4.1")))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define MATROSKA_CRC32_PCLMUL 1
+#define MATROSKA_CRC32_TARGET
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+using namespace libebml;
+
+namespace libmatroska {
+
+namespace {
+
+using Crc32Tables = std::array<std::array<std::uint32_t, 256>, 8>;
+
+constexpr Crc32Tables MakeTables()
+{
+  Crc32Tables Tables{};
+  for (std::uint32_t i = 0; i < 256; i++) {
+    std::uint32_t Crc = i;
+    for (int Bit = 0; Bit < 8; Bit++)
+      Crc = (Crc >> 1) ^ (0xEDB88320 & (0 - (Crc & 1)));
+    Tables[0][i] = Crc;
+  }
+  for (std::uint32_t i = 0; i < 256; i++) {
+    for (std::size_t t = 1; t < 8; t++)
+      Tables[t][i] = (Tables[t - 1][i] >> 8) ^ Tables[0][Tables[t - 1][i] & 0xFF];
+  }
+  return Tables;
+}
+
+constexpr Crc32Tables Tables = MakeTables();
+
+std::uint32_t UpdateBytes(std::uint32_t Crc, const binary * Data, std::size_t Size)
+{
+  while (Size--)
+    Crc = (Crc >> 8) ^ Tables[0][(Crc ^ *Data++) & 0xFF];
+  return Crc;
+}
+
+std::uint32_t UpdateSlicing(std::uint32_t Crc, const binary * Data, std::size_t Size)
+{
+  while (Size >= 8) {
+    const std::uint32_t Low  = Crc ^ (static_cast<std::uint32_t>(Data[0]) | static_cast<std::uint32_t>(Data[1]) << 8 |
+                                      static_cast<std::uint32_t>(Data[2]) << 16 | static_cast<std::uint32_t>(Data[3]) << 24);
+    const std::uint32_t High =        static_cast<std::uint32_t>(Data[4]) | static_cast<std::uint32_t>(Data[5]) << 8 |
+                                      static_cast<std::uint32_t>(Data[6]) << 16 | static_cast<std::uint32_t>(Data[7]) << 24;
+    Crc = Tables[7][Low & 0xFF]          ^ Tables[6][(Low >> 8) & 0xFF] ^
+          Tables[5][(Low >> 16) & 0xFF]  ^ Tables[4][Low >> 24] ^
+          Tables[3][High & 0xFF]         ^ Tables[2][(High >> 8) & 0xFF] ^
+          Tables[1][(High >> 16) & 0xFF] ^ Tables[0][High >> 24];
+    Data += 8;
+    Size -= 8;
+  }
+  return UpdateBytes(Crc, Data, Size);
+}
+
+#if defined(__ARM_FEATURE_CRC32)
+std::uint32_t UpdateArm(std::uint32_t Crc, const binary * Data, std::size_t Size)
+{
+  while (Size >= 8) {
+    std::uint64_t Value;
+    memcpy(&Value, Data, sizeof(Value));
+    Crc = __crc32d(Crc, Value);
+    Data += 8;
+    Size -= 8;
+  }
+  while (Size--)
+    Crc = __crc32b(Crc, *Data++);
+  return Crc;
+}
+#endif // __ARM_FEATURE_CRC32
+
+#if defined(MATROSKA_CRC32_PCLMUL)
+/*!
+  \brief fold 16 octet blocks with carry-less multiplications, then a Barrett reduction
+  \note \a Size must be a multiple of 16, at least 64
+  \see "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction", Intel 2009
+*/
+MATROSKA_CRC32_TARGET std::uint32_t UpdatePclmul(std::uint32_t Crc, const binary * Data, std::size_t Size)
+{
+  // bit-reflected constants for the 0x04C11DB7 polynomial
+  alignas(16) static const std::uint64_t K1K2[] = { 0x0154442bd4, 0x01c6e41596 };
+  alignas(16) static const std::uint64_t K3K4[] = { 0x01751997d0, 0x00ccaa009e };
+  alignas(16) static const std::uint64_t K5K0[] = { 0x0163cd6124, 0x0000000000 };
+  alignas(16) static const std::uint64_t Poly[] = { 0x01db710641, 0x01f7011641 };
+
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+  x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Data + 0x00));
+  x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Data + 0x10));
+  x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Data + 0x20));
+  x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Data + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(Crc)));
+  x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(K1K2));
+  Data += 64;
+  Size -= 64;
+
+  // fold 4 blocks at once
+  while (Size >= 64) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i *>(Data + 0x00)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i *>(Data + 0x10)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i *>(Data + 0x20)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i *>(Data + 0x30)));
+
+    Data += 64;
+    Size -= 64;
+  }
+
+  // fold the 4 blocks into one
+  x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(K3K4));
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  // fold the remaining blocks one at a time
+  while (Size >= 16) {
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Data));
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    Data += 16;
+    Size -= 16;
+  }
+
+  // fold 128 bits to 64 bits
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_srli_si128(x1, 8);
+  x1 = _mm_xor_si128(x1, x2);
+
+  x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(K5K0));
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, x3);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduction to 32 bits
+  x0 = _mm_load_si128(reinterpret_cast<const __m128i *>(Poly));
+  x2 = _mm_and_si128(x1, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return static_cast<std::uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+bool HasPclmul()
+{
+#if defined(_MSC_VER)
+  int Registers[4];
+  __cpuid(Registers, 1);
+  return (Registers[2] & (1 << 1)) != 0 && (Registers[2] & (1 << 19)) != 0;
+#else
+  return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+std::uint32_t UpdateX86(std::uint32_t Crc, const binary * Data, std::size_t Size)
+{
+  if (Size >= 64) {
+    const std::size_t Folded = Size & ~static_cast<std::size_t>(15);
+    Crc   = UpdatePclmul(Crc, Data, Folded);
+    Data += Folded;
+    Size -= Folded;
+  }
+  return UpdateSlicing(Crc, Data, Size);
+}
+#endif // MATROSKA_CRC32_PCLMUL
+
+using UpdateFunction = std::uint32_t (*)(std::uint32_t Crc, const binary * Data, std::size_t Size);
+
+UpdateFunction SelectUpdate()
+{
+#if defined(__ARM_FEATURE_CRC32)
+  return UpdateArm;
+#else
+#if defined(MATROSKA_CRC32_PCLMUL)
+  if (HasPclmul())
+    return UpdateX86;
+#endif
+  return UpdateSlicing;
+#endif
+}
+
+} // namespace
+
+void KaxCrc32::Update(const void * Data, std::size_t Size)
+{
+  static const UpdateFunction Function = SelectUpdate();
+  State = Function(State, static_cast<const binary *>(Data), Size);
+}
+
+std::uint32_t KaxCrc32::Compute(const void * Data, std::size_t Size)
+{
+  KaxCrc32 Crc;
+  Crc.Update(Data, Size);
+  return Crc.Value();
+}
+
+void KaxCrc32::Store(std::uint32_t Crc, binary (&Buffer)[4])
+{
+  Buffer[0] = static_cast<binary>(Crc);
+  Buffer[1] = static_cast<binary>(Crc >> 8);
+  Buffer[2] = static_cast<binary>(Crc >> 16);
+  Buffer[3] = static_cast<binary>(Crc >> 24);
+}
+
+std::uint32_t KaxCrc32::Load(const binary * Buffer)
+{
+  return static_cast<std::uint32_t>(Buffer[0])       | static_cast<std::uint32_t>(Buffer[1]) << 8 |
+         static_cast<std::uint32_t>(Buffer[2]) << 16 | static_cast<std::uint32_t>(Buffer[3]) << 24;
+}
+
+void KaxCrc32IOCallback::Start(std::uint64_t aDataStart, std::uint64_t aDataSize)
+{
+  Crc.Reset();
+  DataStart = aDataStart;
+  DataEnd   = aDataStart + aDataSize;
+  Checked   = aDataStart;
+}
+
+bool KaxCrc32IOCallback::IsValid() const
+{
+  // CRC-32 element ID and size
+  if (DataEnd - DataStart < sizeof(Head) || Head[0] != 0xBF || Head[1] != 0x84)
+    return true;
+  return Crc.Value() == KaxCrc32::Load(Head + 2);
+}
+
+std::size_t KaxCrc32IOCallback::read(void *Buffer, std::size_t Size)
+{
+  const std::uint64_t Position = Source.getFilePointer();
+  const std::size_t Read = Source.read(Buffer, Size);
+
+  // only the octets following the ones already checked, the ones read again are ignored
+  if (Position > Checked || Position + Read <= Checked || Checked >= DataEnd)
+    return Read;
+
+  auto Data = static_cast<const binary *>(Buffer) + (Checked - Position);
+  auto Length = static_cast<std::size_t>(std::min<std::uint64_t>(Position + Read, DataEnd) - Checked);
+  for (; Length != 0 && Checked - DataStart < sizeof(Head); Length--)
+    Head[Checked++ - DataStart] = *Data++;
+  Crc.Update(Data, Length);
+  Checked += Length;
+  return Read;
+}
+
+} // namespace libmatroska
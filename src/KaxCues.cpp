@@ -5,6 +5,7 @@
   \file
   \author Steve Lhomme     <robux4 @ users.sf.net>
 */
+#include <algorithm>
 #include <cassert>
 
 #include "matroska/KaxCues.h"
@@ -44,74 +45,208 @@ bool KaxCues::AddBlockGroup(const KaxBlockGroup & BlockRef)
 bool KaxCues::AddBlockBlob(const KaxBlockBlob & BlockReference)
 {
   // Do not add the element if it's already present.
-  const auto& pr = myTempReferences;
-  const bool present = std::find(pr.begin(), pr.end(), &BlockReference) != pr.end();
-  if (!present)
-    myTempReferences.push_back(&BlockReference);
+  if (myTempReferences.insert(&BlockReference).second)
+    bTempIndexValid = false;
+  return true;
+}
+
+/*!
+  \return true if the Block gets a CuePoint with the current policy
+*/
+bool KaxCues::IsCued(const KaxBlockBlob & BlockReference, const BlockKey & Key)
+{
+  if (myPolicy.bKeyframesOnly) {
+    const bool bKeyframe = BlockReference.IsSimpleBlock()
+                         ? static_cast<KaxSimpleBlock &>(BlockReference).IsKeyframe()
+                         : static_cast<KaxBlockGroup &>(BlockReference).ReferenceCount() == 0;
+    if (!bKeyframe)
+      return false;
+  }
+
+  std::uint64_t Interval = myPolicy.MinInterval;
+  if (myPolicy.PrimaryTrack != 0 && Key.Track != myPolicy.PrimaryTrack) {
+    if (myPolicy.SecondaryInterval == 0)
+      return false;
+    Interval = myPolicy.SecondaryInterval;
+  }
 
+  const auto Last = myLastCues.find(Key.Track);
+  if (Last != myLastCues.end() && Key.Timestamp >= Last->second && Key.Timestamp - Last->second < Interval)
+    return false;
+
+  myLastCues[Key.Track] = Key.Timestamp;
   return true;
 }
 
-void KaxCues::PositionSet(const KaxBlockBlob & BlockReference)
+void KaxCues::AddCuePoint(const KaxBlockBlob & BlockReference)
 {
-  // look for the element in the temporary references
-  const auto& pr = myTempReferences;
-  auto it = std::find(pr.begin(), pr.end(), &BlockReference);
+  if (!BlockReference.HasBlock())
+    return;
 
-  if (it != pr.end()) {
-    // found, now add the element to the entry list
+  // the track and timestamp may have changed since the Blob was added
+  const auto & theBlock = static_cast<KaxInternalBlock &>(BlockReference);
+  if (IsCued(BlockReference, BlockKey{theBlock.TrackNum(), theBlock.GlobalTimestamp()})) {
     auto & NewPoint = AddNewChild<KaxCuePoint>(*this);
     NewPoint.PositionSet(BlockReference, GlobalTimestampScale());
-    myTempReferences.erase(it);
+    InvalidateIndex();
   }
 }
 
-void KaxCues::PositionSet(const KaxBlockGroup & BlockRef)
+void KaxCues::PositionSet(const KaxBlockBlob & BlockReference)
 {
   // look for the element in the temporary references
-  auto it = std::find_if(myTempReferences.begin(), myTempReferences.end(),
-    [&](const KaxBlockBlob *myTempReference)
-      { auto& refTmp = static_cast<KaxInternalBlock &>(*myTempReference);
-        return refTmp.GlobalTimestamp() == BlockRef.GlobalTimestamp()
-            && refTmp.TrackNum() == BlockRef.TrackNumber(); });
-
-  if(it != myTempReferences.end()) {
-    // found, now add the element to the entry list
-    auto & NewPoint = AddNewChild<KaxCuePoint>(*this);
-    NewPoint.PositionSet(**it, GlobalTimestampScale());
-    myTempReferences.erase(it);
+  if (myTempReferences.erase(&BlockReference) != 0)
+    AddCuePoint(BlockReference);
+}
+
+void KaxCues::IndexPendingBlocks()
+{
+  myTempGroups.clear();
+  myTempKeys.clear();
+  myTempGroups.reserve(myTempReferences.size());
+  myTempKeys.reserve(myTempReferences.size());
+  for (const auto BlockReference : myTempReferences) {
+    if (!BlockReference->HasBlock())
+      continue;
+    if (!BlockReference->IsSimpleBlock())
+      myTempGroups.emplace(&static_cast<KaxBlockGroup &>(*BlockReference), BlockReference);
+    const auto & theBlock = static_cast<KaxInternalBlock &>(*BlockReference);
+    myTempKeys.emplace(BlockKey{theBlock.TrackNum(), theBlock.GlobalTimestamp()}, BlockReference);
   }
+  bTempIndexValid = true;
 }
 
-/*!
-  \warning Assume that the list has been sorted (Sort())
-*/
-const KaxCuePoint * KaxCues::GetTimestampPoint(std::uint64_t aTimestamp) const
+void KaxCues::PositionSet(const KaxBlockGroup & BlockRef)
 {
-  const std::uint64_t TimestampToLocate = aTimestamp / GlobalTimestampScale();
-  const KaxCuePoint * aPointPrev = nullptr;
-  std::uint64_t aPrevTime = 0;
-  std::uint64_t aNextTime = 0xFFFFFFFFFFFFLL;
+  if (!bTempIndexValid)
+    IndexPendingBlocks();
+
+  // look for the Blob holding this BlockGroup, or else one with the same track and timestamp
+  const KaxBlockBlob * Found = nullptr;
+  const auto Group = myTempGroups.find(&BlockRef);
+  if (Group != myTempGroups.end()) {
+    if (myTempReferences.count(Group->second) != 0)
+      Found = Group->second;
+    myTempGroups.erase(Group);
+  }
+  if (Found == nullptr) {
+    auto range = myTempKeys.equal_range(BlockKey{BlockRef.TrackNumber(), BlockRef.GlobalTimestamp()});
+    while (range.first != range.second && Found == nullptr) {
+      if (myTempReferences.count(range.first->second) != 0)
+        Found = range.first->second;
+      range.first = myTempKeys.erase(range.first);
+    }
+  }
+
+  if (Found != nullptr) {
+    myTempReferences.erase(Found);
+    AddCuePoint(*Found);
+  }
+}
+
+void KaxCues::Read(EbmlStream & inDataStream, const EbmlSemanticContext & Context, int & UpperEltFound, EbmlElement * & FoundElt, bool AllowDummyElt, ScopeMode ReadFully)
+{
+  // the CuePoints read may reuse the addresses of the previous ones
+  InvalidateIndex();
+  EbmlMaster::Read(inDataStream, Context, UpperEltFound, FoundElt, AllowDummyElt, ReadFully);
+}
+
+void KaxCues::Remove(std::vector<EbmlElement *>::iterator & Itr)
+{
+  InvalidateIndex();
+  EbmlMaster::Remove(Itr);
+}
+
+void KaxCues::RemoveAll()
+{
+  InvalidateIndex();
+  EbmlMaster::RemoveAll();
+}
+
+void KaxCues::BuildIndex() const
+{
+  myIndex.clear();
+  myTrackIndex.clear();
 
   for (const auto& e : *this) {
-    if (EbmlId(*e) == EBML_ID(KaxCuePoint)) {
-      auto tmp = static_cast<const KaxCuePoint *>(e);
-      // check the tile
-      auto aTime = FindChild<const KaxCueTime>(*tmp);
-      if (aTime) {
-        auto _Time = static_cast<std::uint64_t>(*aTime);
-        if (_Time > aPrevTime && _Time < TimestampToLocate) {
-          aPrevTime = _Time;
-          aPointPrev = tmp;
-        }
-        if (_Time < aNextTime && _Time > TimestampToLocate) {
-          aNextTime= _Time;
-        }
-      }
+    if (EbmlId(*e) != EBML_ID(KaxCuePoint))
+      continue;
+    auto CuePoint = static_cast<const KaxCuePoint *>(e);
+    auto aTime = FindChild<const KaxCueTime>(*CuePoint);
+    if (!aTime)
+      continue;
+
+    for (auto aPoss = FindChild<const KaxCueTrackPositions>(*CuePoint); aPoss; aPoss = FindNextChild<const KaxCueTrackPositions>(*CuePoint, *aPoss)) {
+      auto aTrack = FindChild<const KaxCueTrack>(*aPoss);
+      myIndex.push_back({static_cast<std::uint64_t>(*aTime),
+                         aTrack ? static_cast<std::uint64_t>(*aTrack) : 0,
+                         aPoss->ClusterPosition(),
+                         aPoss->RelativePosition(),
+                         CuePoint});
     }
   }
 
-  return aPointPrev;
+  std::stable_sort(myIndex.begin(), myIndex.end(), [](const KaxCueIndexEntry & a, const KaxCueIndexEntry & b) {
+    return a.Time < b.Time || (a.Time == b.Time && a.Track < b.Track);
+  });
+
+  myTrackIndex.resize(myIndex.size());
+  for (std::size_t i = 0; i < myIndex.size(); i++)
+    myTrackIndex[i] = i;
+  // myIndex is sorted by time, keep that order within each track
+  std::stable_sort(myTrackIndex.begin(), myTrackIndex.end(), [this](std::size_t a, std::size_t b) {
+    return myIndex[a].Track < myIndex[b].Track;
+  });
+
+  myIndexedChildren = ListSize();
+  bIndexValid = true;
+}
+
+const std::vector<KaxCueIndexEntry> & KaxCues::GetIndex() const
+{
+  if (!bIndexValid || myIndexedChildren != ListSize())
+    BuildIndex();
+  return myIndex;
+}
+
+const KaxCueIndexEntry * KaxCues::FindIndexEntry(std::uint64_t aTimestamp, std::uint64_t aTrack) const
+{
+  const auto & Index = GetIndex();
+  const std::uint64_t TimestampToLocate = aTimestamp / GlobalTimestampScale();
+
+  if (aTrack == 0) {
+    // first entry after the timestamp
+    auto it = std::upper_bound(Index.begin(), Index.end(), TimestampToLocate, [](std::uint64_t Time, const KaxCueIndexEntry & Entry) {
+      return Time < Entry.Time;
+    });
+    if (it == Index.begin())
+      return nullptr;
+    return &*(it - 1);
+  }
+
+  // first entry of the track after the timestamp
+  auto it = std::upper_bound(myTrackIndex.begin(), myTrackIndex.end(), std::make_pair(aTrack, TimestampToLocate),
+    [&Index](const std::pair<std::uint64_t, std::uint64_t> & Key, std::size_t Entry) {
+      return Key.first < Index[Entry].Track || (Key.first == Index[Entry].Track && Key.second < Index[Entry].Time);
+    });
+  if (it == myTrackIndex.begin() || Index[*(it - 1)].Track != aTrack)
+    return nullptr;
+  return &Index[*(it - 1)];
+}
+
+/*!
+  \return the last CuePoint at or before \a aTimestamp
+*/
+const KaxCuePoint * KaxCues::GetTimestampPoint(std::uint64_t aTimestamp) const
+{
+  const auto Entry = FindIndexEntry(aTimestamp);
+  return Entry ? Entry->Point : nullptr;
+}
+
+const KaxCuePoint * KaxCues::GetTimestampPoint(std::uint64_t aTimestamp, std::uint64_t aTrack) const
+{
+  const auto Entry = FindIndexEntry(aTimestamp, aTrack);
+  return Entry ? Entry->Point : nullptr;
 }
 
 std::uint64_t KaxCues::GetTimestampPosition(std::uint64_t aTimestamp) const
@@ -127,4 +262,22 @@ std::uint64_t KaxCues::GetTimestampPosition(std::uint64_t aTimestamp) const
   return aTrack->ClusterPosition();
 }
 
+std::uint64_t KaxCues::GetTimestampPosition(std::uint64_t aTimestamp, std::uint64_t aTrack) const
+{
+  const auto Entry = FindIndexEntry(aTimestamp, aTrack);
+  return Entry ? Entry->ClusterPosition : 0;
+}
+
+bool KaxCues::GetBlockPosition(std::uint64_t aTimestamp, std::uint64_t aTrack, std::uint64_t & aClusterPosition, std::uint64_t & aRelativePosition) const
+{
+  const auto Entry = FindIndexEntry(aTimestamp, aTrack);
+  // 0 is not a Block position, the ClusterTimestamp comes first
+  if (!Entry || Entry->RelativePosition == 0)
+    return false;
+
+  aClusterPosition  = Entry->ClusterPosition;
+  aRelativePosition = Entry->RelativePosition;
+  return true;
+}
+
 } // namespace libmatroska
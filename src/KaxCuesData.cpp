@@ -20,6 +20,39 @@ using namespace libebml;
 
 namespace libmatroska {
 
+namespace {
+
+/*!
+  \brief set the CueRelativePosition and CueBlockNumber of \a Block, a SimpleBlock or BlockGroup of \a Cluster
+  \note nothing is set if the Block is not written yet, the CueBlockNumber
+  is only set from KaxCluster::UpdateCues(), KaxClusterWriter sets it for the live Blocks
+*/
+void SetBlockPosition(KaxCueTrackPositions & Positions, const EbmlElement & Block, const KaxCluster * Cluster)
+{
+  if (!Cluster || Block.GetElementPosition() <= Cluster->GetElementPosition())
+    return;
+
+  GetChild<KaxCueRelativePosition>(Positions).SetValue(Block.GetElementPosition() - Cluster->GetDataStart());
+
+  // 1 is the default value, it's not written, like in KaxIndexBuilder
+  const std::uint64_t BlockNumber = Cluster->GetBlockNumber(Block);
+  if (BlockNumber > 1)
+    GetChild<KaxCueBlockNumber>(Positions).SetValue(BlockNumber);
+}
+
+/*!
+  \brief set the CueDuration from the BlockDuration of \a BlockGroup
+  \note the BlockDuration is in Track ticks, the same as Segment ticks with the default TrackTimestampScale
+*/
+void SetBlockDuration(KaxCueTrackPositions & Positions, const KaxBlockGroup & BlockGroup)
+{
+  const auto Duration = FindChild<const KaxBlockDuration>(BlockGroup);
+  if (Duration)
+    GetChild<KaxCueDuration>(Positions).SetValue(static_cast<std::uint64_t>(*Duration));
+}
+
+} // namespace
+
 /*!
   \todo handle codec state checking
   \todo remove duplicate references (reference to 2 frames that each reference the same frame)
@@ -37,11 +70,17 @@ void KaxCuePoint::PositionSet(const KaxBlockGroup & BlockReference, std::uint64_
   auto & TheClustPos = GetChild<KaxCueClusterPosition>(NewPositions);
   TheClustPos.SetValue(BlockReference.ClusterPosition());
 
+  SetBlockPosition(NewPositions, BlockReference, BlockReference.GetParentCluster());
+  SetBlockDuration(NewPositions, BlockReference);
+
   // handle reference use
   if (BlockReference.ReferenceCount() != 0) {
     for (unsigned int i=0; i<BlockReference.ReferenceCount(); i++) {
+      const auto RefdBlock = BlockReference.Reference(i).ReferencedBlock();
+      if (!RefdBlock)
+        continue;
       auto & NewRefs = AddNewChild<KaxCueReference>(NewPositions);
-      NewRefs.AddReference(BlockReference.Reference(i).RefBlock(), GlobalTimestampScale);
+      NewRefs.AddReference(*RefdBlock, GlobalTimestampScale);
     }
   }
 
@@ -84,13 +123,20 @@ void KaxCuePoint::PositionSet(const KaxInternalBlock & BlockReference, const Kax
   auto & TheClustPos = GetChild<KaxCueClusterPosition>(NewPositions);
   TheClustPos.SetValue(BlockReference.ClusterPosition());
 
+  // the Cluster holds the BlockGroup, not its Block
+  if (BlockGroup) {
+    SetBlockPosition(NewPositions, *BlockGroup, BlockReference.GetParentCluster());
+    SetBlockDuration(NewPositions, *BlockGroup);
+  } else
+    SetBlockPosition(NewPositions, BlockReference, BlockReference.GetParentCluster());
+
 #if 0 // MATROSKA_VERSION >= 2
   // handle reference use
   if (BlockReference.ReferenceCount() != 0) {
     unsigned int i;
     for (i=0; i<BlockReference.ReferenceCount(); i++) {
       KaxCueReference & NewRefs = AddNewChild<KaxCueReference>(NewPositions);
-      NewRefs.AddReference(BlockReference.Reference(i).RefBlock(), GlobalTimestampScale);
+      NewRefs.AddReference(*BlockReference.Reference(i).ReferencedBlock(), GlobalTimestampScale);
     }
   }
 #endif // MATROSKA_VERSION
@@ -109,14 +155,23 @@ void KaxCuePoint::PositionSet(const KaxInternalBlock & BlockReference, const Kax
 /*!
   \todo handle codec state checking
 */
-void KaxCueReference::AddReference(const KaxBlockBlob & BlockReference, std::uint64_t GlobalTimestampScale)
+void KaxCueReference::AddReference(const KaxInternalBlock & BlockReference, std::uint64_t GlobalTimestampScale)
 {
-  auto& theBlock = static_cast<KaxInternalBlock&>(BlockReference);
   auto& NewTime = GetChild<KaxCueRefTime>(*this);
-  NewTime.SetValue(theBlock.GlobalTimestamp() / GlobalTimestampScale);
+  NewTime.SetValue(BlockReference.GlobalTimestamp() / GlobalTimestampScale);
 
   auto & TheClustPos = GetChild<KaxCueRefCluster>(*this);
-  TheClustPos.SetValue(theBlock.ClusterPosition());
+  TheClustPos.SetValue(BlockReference.ClusterPosition());
+}
+
+void KaxCueReference::AddReference(const KaxBlockBlob & BlockReference, std::uint64_t GlobalTimestampScale)
+{
+  AddReference(static_cast<KaxInternalBlock&>(BlockReference), GlobalTimestampScale);
+}
+
+void KaxCueReference::AddReference(const KaxBlockGroup & BlockReference, std::uint64_t GlobalTimestampScale)
+{
+  AddReference(*FindChild<const KaxBlock>(BlockReference), GlobalTimestampScale);
 }
 
 bool KaxCuePoint::IsSmallerThan(const EbmlElement * Cmp) const
@@ -198,6 +253,15 @@ std::uint64_t KaxCueTrackPositions::ClusterPosition() const
   return static_cast<std::uint64_t>(*aPos);
 }
 
+std::uint64_t KaxCueTrackPositions::RelativePosition() const
+{
+  const auto aPos = FindChild<const KaxCueRelativePosition>(*this);
+  if (!aPos)
+    return 0;
+
+  return static_cast<std::uint64_t>(*aPos);
+}
+
 std::uint16_t KaxCueTrackPositions::TrackNumber() const
 {
   const auto aTrack = FindChild<const KaxCueTrack>(*this);
@@ -0,0 +1,79 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include <algorithm>
+
+#include <ebml/EbmlCrc32.h>
+#include <ebml/EbmlVoid.h>
+#include "KaxElementTable.h"
+#include "matroska/KaxBlock.h"
+#include "matroska/KaxCluster.h"
+#include "matroska/KaxCues.h"
+#include "matroska/KaxSeekHead.h"
+#include "matroska/KaxSemantic.h"
+
+using namespace libebml;
+
+namespace libmatroska {
+
+KaxElementTable::KaxElementTable(std::initializer_list<const EbmlCallbacks *> Elements)
+{
+  Entries.reserve(Elements.size());
+  for (const auto Callbacks : Elements)
+    Entries.push_back({EBML_INFO_ID(*Callbacks).GetValue(), Callbacks});
+  std::sort(Entries.begin(), Entries.end(),
+            [](const KaxElementEntry & a, const KaxElementEntry & b) { return a.Id < b.Id; });
+}
+
+const EbmlCallbacks * KaxElementTable::Find(std::uint32_t Id) const
+{
+  const auto Found = std::lower_bound(begin(), end(), Id,
+                                      [](const KaxElementEntry & Entry, std::uint32_t Value) { return Entry.Id < Value; });
+  if (Found == end() || Found->Id != Id)
+    return nullptr;
+  return Found->Callbacks;
+}
+
+const KaxElementTable & KaxElementTable::Global()
+{
+  static const KaxElementTable Table{
+    &EBML_INFO(EbmlCrc32),
+    &EBML_INFO(EbmlVoid),
+  };
+  return Table;
+}
+
+const KaxElementTable & KaxElementTable::Segment()
+{
+  static const KaxElementTable Table{
+    &EBML_INFO(KaxAttachments),
+    &EBML_INFO(KaxChapters),
+    &EBML_INFO(KaxCluster),
+    &EBML_INFO(KaxCues),
+    &EBML_INFO(KaxInfo),
+    &EBML_INFO(KaxSeekHead),
+    &EBML_INFO(KaxTags),
+    &EBML_INFO(KaxTracks),
+  };
+  return Table;
+}
+
+const KaxElementTable & KaxElementTable::Cluster()
+{
+  static const KaxElementTable Table{
+    &EBML_INFO(KaxBlockGroup),
+    &EBML_INFO(KaxClusterPosition),
+    &EBML_INFO(KaxClusterPrevSize),
+    &EBML_INFO(KaxClusterSilentTracks),
+    &EBML_INFO(KaxClusterTimestamp),
+    &EBML_INFO(KaxEncryptedBlock),
+    &EBML_INFO(KaxSimpleBlock),
+  };
+  return Table;
+}
+
+} // namespace libmatroska
@@ -0,0 +1,58 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \brief ID tables of the scanners, not installed
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_ELEMENT_TABLE_H
+#define LIBMATROSKA_ELEMENT_TABLE_H
+
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+#include <ebml/EbmlElement.h>
+
+namespace libmatroska {
+
+/*!
+  \brief an element allowed in a KaxElementTable
+*/
+struct KaxElementEntry {
+  std::uint32_t                  Id; ///< the ID as coded in the file, marker bits included
+  const libebml::EbmlCallbacks * Callbacks;
+};
+
+/*!
+  \brief ID lookup of the elements allowed in a Matroska master
+
+  The scanners reading the file without creating elements use them to
+  identify the elements with a binary search on a few entries. The IDs are
+  taken from the element definitions when a table is first used. The Segment
+  and Cluster have a table, the EBML global elements (CRC-32, Void) are found
+  in Global().
+*/
+class KaxElementTable {
+  public:
+    explicit KaxElementTable(std::initializer_list<const libebml::EbmlCallbacks *> Elements);
+
+    /// \return the callbacks of the element with the ID \a Id, nullptr if not in the table
+    const libebml::EbmlCallbacks * Find(std::uint32_t Id) const;
+
+    const KaxElementEntry * begin() const { return Entries.data(); }
+    const KaxElementEntry * end() const { return Entries.data() + Entries.size(); }
+    std::size_t size() const { return Entries.size(); }
+
+    static const KaxElementTable & Global();
+    static const KaxElementTable & Segment();
+    static const KaxElementTable & Cluster();
+
+  private:
+    std::vector<KaxElementEntry> Entries; ///< sorted by ID
+};
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_ELEMENT_TABLE_H
@@ -0,0 +1,323 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <limits>
+#include <thread>
+
+#include "matroska/KaxIndexBuilder.h"
+#include "matroska/KaxClusterBlockScanner.h"
+#include "matroska/KaxCues.h"
+#include "matroska/KaxCuesData.h"
+#include "matroska/KaxSemantic.h"
+#include "KaxElementTable.h"
+#include "KaxParseHelpers.h"
+
+using namespace libebml;
+
+namespace libmatroska {
+
+static constexpr std::uint64_t NoPosition = std::numeric_limits<std::uint64_t>::max();
+
+/*!
+  \brief Clusters and Blocks found in a part of the Segment
+*/
+struct KaxIndexBuilder::Chunk {
+  std::uint64_t Start;
+  std::uint64_t End;
+  std::uint64_t Stop{NoPosition}; ///< position of the Cluster following the last one of the chunk, NoPosition if unknown
+  std::vector<KaxIndexCluster> Clusters;
+  std::vector<KaxIndexEntry>   Entries;
+  std::exception_ptr           Error;
+
+  Chunk(std::uint64_t aStart, std::uint64_t aEnd)
+    :Start(aStart), End(aEnd)
+  {}
+};
+
+/*!
+  \brief check the data following a Cluster ID looks like a Cluster
+  \param Head the Cluster ID followed by \a Available - 4 octets
+  \param DataEnd the end of the Segment
+*/
+static bool IsClusterHead(const binary * Head, std::size_t Available, std::uint64_t Position, std::uint64_t DataEnd)
+{
+  if (Available <= 4)
+    return true; // end of the file, let the scanner decide
+  const unsigned int SizeLength = internal::VINTLength(Head[4]);
+  if (SizeLength == 0)
+    return false;
+  if (4 + SizeLength > Available)
+    return true;
+
+  std::uint64_t Size = Head[4] & (0xFF >> SizeLength);
+  for (unsigned int i = 1; i < SizeLength; i++)
+    Size = (Size << 8) | Head[4 + i];
+  const bool UnknownSize = (Size == (std::uint64_t(1) << (7 * SizeLength)) - 1);
+  if (!UnknownSize && Position + 4 + SizeLength + Size > DataEnd)
+    return false;
+  if (Size == 0 || 4 + SizeLength >= Available)
+    return true;
+
+  // the first child must be an element found in Clusters
+  const binary * Child = &Head[4 + SizeLength];
+  const unsigned int IdLength = internal::VINTLength(Child[0]);
+  if (IdLength == 0 || IdLength > 4)
+    return false;
+  if (4 + SizeLength + IdLength > Available)
+    return true;
+  std::uint32_t Id = 0;
+  for (unsigned int i = 0; i < IdLength; i++)
+    Id = (Id << 8) | Child[i];
+  return KaxElementTable::Cluster().Find(Id) != nullptr || KaxElementTable::Global().Find(Id) != nullptr;
+}
+
+KaxIndexBuilder::KaxIndexBuilder(InputFactory aOpenInput, std::uint64_t aSegmentDataStart, std::uint64_t aSegmentDataEnd, std::uint64_t aTimestampScale)
+  :OpenInput(std::move(aOpenInput))
+  ,SegmentDataStart(aSegmentDataStart)
+  ,SegmentDataEnd(aSegmentDataEnd)
+  ,TimestampScale(aTimestampScale)
+{
+}
+
+/*!
+  \brief start the scanner on the first Cluster found between \a From and \a Limit
+*/
+bool KaxIndexBuilder::Resync(IOCallback & Input, KaxClusterBlockScanner & Scanner, std::uint64_t From, std::uint64_t Limit) const
+{
+  static constexpr std::size_t BufferSize = 64 * 1024;
+  static constexpr std::size_t Overlap = 16; // enough for a Cluster head and its first child ID
+  std::vector<binary> Buffer(BufferSize);
+
+  std::uint64_t Position = From;
+  while (Position < Limit && Position < SegmentDataEnd) {
+    const std::size_t ToRead = static_cast<std::size_t>(std::min<std::uint64_t>(BufferSize, SegmentDataEnd - Position));
+    Input.setFilePointer(Position, seek_beginning);
+    const std::size_t Read = Input.read(Buffer.data(), ToRead);
+    if (Read < 4)
+      return false;
+    const bool bLast = Read < BufferSize;
+    const std::size_t SearchEnd = bLast ? Read - 3 : Read - Overlap;
+
+    for (std::size_t i = 0; i < SearchEnd && Position + i < Limit; i++) {
+      if (Buffer[i] != 0x1F || Buffer[i + 1] != 0x43 || Buffer[i + 2] != 0xB6 || Buffer[i + 3] != 0x75)
+        continue;
+      if (IsClusterHead(&Buffer[i], Read - i, Position + i, SegmentDataEnd) && Scanner.StartCluster(Position + i))
+        return true;
+    }
+    if (bLast)
+      return false;
+    Position += SearchEnd;
+  }
+  return false;
+}
+
+void KaxIndexBuilder::ScanChunk(IOCallback & Input, Chunk & Range, bool bFromStart) const
+{
+  KaxClusterBlockScanner Scanner(Input, TimestampScale);
+
+  bool bFound = false;
+  if (bFromStart) {
+    // follow the element sizes from a known element start
+    Scanner.Seek(Range.Start);
+    bFound = Scanner.NextCluster(SegmentDataEnd);
+  }
+  if (!bFound)
+    bFound = Resync(Input, Scanner, Range.Start, Range.End);
+
+  while (bFound) {
+    const std::uint64_t ClusterPosition = Scanner.ClusterPosition();
+    if (ClusterPosition >= Range.End) {
+      Range.Stop = ClusterPosition;
+      return;
+    }
+
+    KaxBlockRecord Record;
+    std::uint64_t BlockNumber = 0;
+    while (Scanner.Next(Record)) {
+      BlockNumber++;
+      if (bKeyframesOnly && !Record.IsKeyframe)
+        continue;
+      Range.Entries.push_back(KaxIndexEntry{Record.Timestamp, Record.TrackNumber, ClusterPosition,
+                                            Record.ElementPosition - Scanner.ClusterDataStart(), BlockNumber,
+                                            Record.HasDuration ? Record.Duration : 0});
+    }
+
+    const std::uint64_t ClusterEnd = std::min(Scanner.ClusterEnd(), SegmentDataEnd);
+    Range.Clusters.push_back(KaxIndexCluster{ClusterPosition, ClusterEnd - ClusterPosition, Scanner.ClusterTimestamp()});
+
+    if (!Scanner.IsValid()) {
+      // damaged Cluster, the Blocks found so far are kept
+      bFound = Resync(Input, Scanner, ClusterPosition + 4, Range.End);
+      continue;
+    }
+
+    bFound = Scanner.NextCluster(SegmentDataEnd);
+    if (!bFound)
+      bFound = Resync(Input, Scanner, ClusterEnd, Range.End);
+  }
+  Range.Stop = NoPosition;
+}
+
+void KaxIndexBuilder::Build()
+{
+  Clusters.clear();
+  Entries.clear();
+  if (SegmentDataEnd <= SegmentDataStart)
+    return;
+
+  const std::uint64_t ChunkLength = std::max<std::uint64_t>(ChunkSize, 1024 * 1024);
+  std::vector<Chunk> Chunks;
+  for (std::uint64_t Start = SegmentDataStart; Start < SegmentDataEnd; Start += ChunkLength)
+    Chunks.emplace_back(Start, std::min(Start + ChunkLength, SegmentDataEnd));
+
+  std::atomic<std::size_t> NextChunk{0};
+  auto Worker = [&] {
+    std::unique_ptr<IOCallback> Input;
+    for (std::size_t Index = NextChunk++; Index < Chunks.size(); Index = NextChunk++) {
+      try {
+        if (!Input)
+          Input = OpenInput();
+        ScanChunk(*Input, Chunks[Index], Index == 0);
+      } catch (...) {
+        Chunks[Index].Error = std::current_exception();
+      }
+    }
+  };
+
+  unsigned int ThreadCount = Threads ? Threads : std::max(1u, std::thread::hardware_concurrency());
+  ThreadCount = static_cast<unsigned int>(std::min<std::size_t>(ThreadCount, Chunks.size()));
+  std::vector<std::thread> Workers;
+  for (unsigned int i = 1; i < ThreadCount; i++)
+    Workers.emplace_back(Worker);
+  Worker();
+  for (auto & Thread : Workers)
+    Thread.join();
+
+  for (const auto & Range : Chunks) {
+    if (Range.Error)
+      std::rethrow_exception(Range.Error);
+  }
+
+  // keep each chunk from the Cluster where the previous one stopped
+  std::unique_ptr<IOCallback> Input;
+  std::uint64_t Next = NoPosition;
+  for (std::size_t Index = 0; Index < Chunks.size(); Index++) {
+    auto * Range = &Chunks[Index];
+    std::size_t First = 0;
+    if (Index != 0 && Next != NoPosition) {
+      if (Next >= Range->End)
+        continue; // the chunk is inside the last Cluster
+
+      const auto Found = std::find_if(Range->Clusters.begin(), Range->Clusters.end(),
+                                      [Next](const KaxIndexCluster & Cluster) { return Cluster.Position == Next; });
+      if (Found == Range->Clusters.end()) {
+        // the chunk was synchronized on a false Cluster ID, walk it again from the known Cluster
+        Chunk Rescan(Next, Range->End);
+        if (!Input)
+          Input = OpenInput();
+        ScanChunk(*Input, Rescan, true);
+        *Range = std::move(Rescan);
+      } else
+        First = static_cast<std::size_t>(Found - Range->Clusters.begin());
+    }
+
+    if (First < Range->Clusters.size()) {
+      const std::uint64_t FirstPosition = Range->Clusters[First].Position;
+      Clusters.insert(Clusters.end(), Range->Clusters.begin() + First, Range->Clusters.end());
+      for (const auto & Entry : Range->Entries) {
+        if (Entry.ClusterPosition >= FirstPosition)
+          Entries.push_back(Entry);
+      }
+    }
+    Next = Range->Stop;
+  }
+
+  std::stable_sort(Entries.begin(), Entries.end(), [](const KaxIndexEntry & a, const KaxIndexEntry & b) {
+    if (a.Timestamp != b.Timestamp)
+      return a.Timestamp < b.Timestamp;
+    return a.TrackNumber < b.TrackNumber;
+  });
+}
+
+const KaxIndexEntry * KaxIndexLookup::Find(std::uint64_t aTimestamp, std::uint64_t aTrack) const
+{
+  if (aTrack == 0) {
+    const KaxIndexEntry * Found = std::upper_bound(Entries, Entries + EntryCount, aTimestamp,
+      [](std::uint64_t Timestamp, const KaxIndexEntry & Entry) { return Timestamp < Entry.Timestamp; });
+    return Found == Entries ? nullptr : Found - 1;
+  }
+
+  const KaxIndexTrack * Track = std::lower_bound(Tracks, Tracks + TrackCount, aTrack,
+    [](const KaxIndexTrack & Entry, std::uint64_t Number) { return Entry.TrackNumber < Number; });
+  if (Track == Tracks + TrackCount || Track->TrackNumber != aTrack)
+    return nullptr;
+
+  const std::uint64_t * First = Positions + Track->First;
+  const std::uint64_t * Found = std::upper_bound(First, First + Track->Count, aTimestamp,
+    [this](std::uint64_t Timestamp, std::uint64_t Position) { return Timestamp < Entries[Position].Timestamp; });
+  return Found == First ? nullptr : Entries + *(Found - 1);
+}
+
+void KaxIndexLookup::BuildTracks(const std::vector<KaxIndexEntry> & aEntries, std::vector<KaxIndexTrack> & Tracks, std::vector<std::uint64_t> & Positions)
+{
+  Positions.resize(aEntries.size());
+  for (std::size_t Index = 0; Index < Positions.size(); Index++)
+    Positions[Index] = Index;
+  // the entries are sorted by timestamp, each track keeps that order
+  std::stable_sort(Positions.begin(), Positions.end(), [&aEntries](std::uint64_t a, std::uint64_t b) {
+    return aEntries[a].TrackNumber < aEntries[b].TrackNumber;
+  });
+
+  Tracks.clear();
+  for (std::size_t Index = 0; Index < Positions.size(); Index++) {
+    const std::uint64_t TrackNumber = aEntries[Positions[Index]].TrackNumber;
+    if (Tracks.empty() || Tracks.back().TrackNumber != TrackNumber)
+      Tracks.push_back({TrackNumber, Index, 0});
+    Tracks.back().Count++;
+  }
+}
+
+std::vector<KaxIndexEntry> KaxIndexBuilder::CueEntries(const KaxCues & Cues, std::uint64_t aSegmentDataStart, std::uint64_t aTimestampScale)
+{
+  // the index is already sorted by time and track
+  std::vector<KaxIndexEntry> Result;
+  Result.reserve(Cues.GetIndex().size());
+  for (const auto & Cue : Cues.GetIndex())
+    Result.push_back({Cue.Time * aTimestampScale, Cue.Track, aSegmentDataStart + Cue.ClusterPosition, Cue.RelativePosition, 0, 0});
+  return Result;
+}
+
+void KaxIndexBuilder::FillCues(KaxCues & Cues) const
+{
+  KaxCuePoint * Point = nullptr;
+  std::uint64_t PointTime = 0;
+
+  for (const auto & Entry : Entries) {
+    const std::uint64_t Time = Entry.Timestamp / TimestampScale;
+    if (Point == nullptr || Time != PointTime) {
+      Point = &AddNewChild<KaxCuePoint>(Cues);
+      GetChild<KaxCueTime>(*Point).SetValue(Time);
+      PointTime = Time;
+    }
+
+    auto & Positions = AddNewChild<KaxCueTrackPositions>(*Point);
+    GetChild<KaxCueTrack>(Positions).SetValue(Entry.TrackNumber);
+    GetChild<KaxCueClusterPosition>(Positions).SetValue(Entry.ClusterPosition - SegmentDataStart);
+    GetChild<KaxCueRelativePosition>(Positions).SetValue(Entry.RelativePosition);
+    if (Entry.BlockNumber != 1)
+      GetChild<KaxCueBlockNumber>(Positions).SetValue(Entry.BlockNumber);
+    if (Entry.Duration != 0)
+      GetChild<KaxCueDuration>(Positions).SetValue(Entry.Duration / TimestampScale);
+  }
+
+  Cues.InvalidateIndex();
+}
+
+} // namespace libmatroska
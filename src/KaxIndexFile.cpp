@@ -0,0 +1,172 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "matroska/KaxIndexFile.h"
+#include "matroska/KaxCrc32.h"
+#include "matroska/KaxCues.h"
+
+using namespace libebml;
+
+namespace libmatroska {
+
+namespace {
+
+constexpr binary Magic[4] = { 'M', 'K', 'X', 'I' };
+
+/// header of the index file, the records follow it
+struct Header {
+  binary        Magic[4];
+  std::uint32_t Version;
+  std::uint64_t FileSize;
+  std::uint64_t ModificationTime;
+  std::uint64_t Checksum;
+  std::uint64_t SegmentDataStart;
+  std::uint64_t TimestampScale;
+  std::uint64_t ClusterCount;
+  std::uint64_t EntryCount;
+  std::uint64_t TrackCount;
+  std::uint32_t RecordsCrc; ///< CRC-32 of the Cluster, Block and track records and the track positions
+  std::uint32_t Reserved;
+};
+
+static_assert(sizeof(Header) == 80, "the index file header is 80 octets");
+static_assert(sizeof(KaxIndexCluster) == 3 * 8 && std::is_trivially_copyable<KaxIndexCluster>::value,
+              "KaxIndexCluster records are stored as they are in memory");
+static_assert(sizeof(KaxIndexEntry) == 6 * 8 && std::is_trivially_copyable<KaxIndexEntry>::value,
+              "KaxIndexEntry records are stored as they are in memory");
+static_assert(sizeof(KaxIndexTrack) == 3 * 8 && std::is_trivially_copyable<KaxIndexTrack>::value,
+              "KaxIndexTrack records are stored as they are in memory");
+
+/// write \a Records if there are any
+template <typename Type>
+void WriteRecords(IOCallback & output, const std::vector<Type> & Records)
+{
+  if (!Records.empty())
+    output.writeFully(Records.data(), Records.size() * sizeof(Type));
+}
+
+} // namespace
+
+void KaxIndexFile::Write(IOCallback & output, const KaxIndexFileKey & Key,
+                         std::uint64_t aSegmentDataStart, std::uint64_t aTimestampScale,
+                         const std::vector<KaxIndexCluster> & aClusters, const std::vector<KaxIndexEntry> & aEntries)
+{
+  std::vector<KaxIndexTrack> Tracks;
+  std::vector<std::uint64_t> Positions;
+  KaxIndexLookup::BuildTracks(aEntries, Tracks, Positions);
+
+  KaxCrc32 Crc;
+  Crc.Update(aClusters.data(), aClusters.size() * sizeof(KaxIndexCluster));
+  Crc.Update(aEntries.data(), aEntries.size() * sizeof(KaxIndexEntry));
+  Crc.Update(Tracks.data(), Tracks.size() * sizeof(KaxIndexTrack));
+  Crc.Update(Positions.data(), Positions.size() * sizeof(std::uint64_t));
+
+  Header Head{};
+  memcpy(Head.Magic, Magic, sizeof(Magic));
+  Head.Version          = Version;
+  Head.FileSize         = Key.FileSize;
+  Head.ModificationTime = Key.ModificationTime;
+  Head.Checksum         = Key.Checksum;
+  Head.SegmentDataStart = aSegmentDataStart;
+  Head.TimestampScale   = aTimestampScale;
+  Head.ClusterCount     = aClusters.size();
+  Head.EntryCount       = aEntries.size();
+  Head.TrackCount       = Tracks.size();
+  Head.RecordsCrc       = Crc.Value();
+
+  output.writeFully(&Head, sizeof(Head));
+  WriteRecords(output, aClusters);
+  WriteRecords(output, aEntries);
+  WriteRecords(output, Tracks);
+  WriteRecords(output, Positions);
+}
+
+void KaxIndexFile::Write(IOCallback & output, const KaxIndexFileKey & Key, const KaxIndexBuilder & Builder)
+{
+  Write(output, Key, Builder.GetSegmentDataStart(), Builder.GetTimestampScale(), Builder.GetClusters(), Builder.GetEntries());
+}
+
+void KaxIndexFile::Write(IOCallback & output, const KaxIndexFileKey & Key,
+                         std::uint64_t aSegmentDataStart, std::uint64_t aTimestampScale, const KaxCues & Cues)
+{
+  Write(output, Key, aSegmentDataStart, aTimestampScale, {}, KaxIndexBuilder::CueEntries(Cues, aSegmentDataStart, aTimestampScale));
+}
+
+bool KaxIndexFile::Open(std::shared_ptr<const binary> aData, std::size_t aSize, const KaxIndexFileKey & Key)
+{
+  Close();
+
+  if (!aData || aSize < sizeof(Header) || reinterpret_cast<std::uintptr_t>(aData.get()) % alignof(std::uint64_t) != 0)
+    return false;
+
+  Header Head;
+  memcpy(&Head, aData.get(), sizeof(Head));
+  if (memcmp(Head.Magic, Magic, sizeof(Magic)) != 0 || Head.Version != Version)
+    return false;
+  if (Key != KaxIndexFileKey{Head.FileSize, Head.ModificationTime, Head.Checksum})
+    return false;
+
+  const std::size_t Available = aSize - sizeof(Header);
+  if (Head.ClusterCount > Available / sizeof(KaxIndexCluster))
+    return false;
+  const std::size_t ClustersSize = static_cast<std::size_t>(Head.ClusterCount) * sizeof(KaxIndexCluster);
+  if (Head.EntryCount > (Available - ClustersSize) / (sizeof(KaxIndexEntry) + sizeof(std::uint64_t)))
+    return false;
+  const std::size_t EntriesSize = static_cast<std::size_t>(Head.EntryCount) * sizeof(KaxIndexEntry);
+  const std::size_t PositionsSize = static_cast<std::size_t>(Head.EntryCount) * sizeof(std::uint64_t);
+  if (Head.TrackCount > (Available - ClustersSize - EntriesSize - PositionsSize) / sizeof(KaxIndexTrack))
+    return false;
+  const std::size_t TracksSize = static_cast<std::size_t>(Head.TrackCount) * sizeof(KaxIndexTrack);
+
+  const binary * Records = aData.get() + sizeof(Header);
+  const auto Tracks = reinterpret_cast<const KaxIndexTrack *>(Records + ClustersSize + EntriesSize);
+  for (std::size_t Index = 0; Index < Head.TrackCount; Index++) {
+    // the positions themselves are only checked by Verify()
+    if (Tracks[Index].First > Head.EntryCount || Tracks[Index].Count > Head.EntryCount - Tracks[Index].First)
+      return false;
+  }
+
+  Data              = std::move(aData);
+  SegmentDataStart  = Head.SegmentDataStart;
+  TimestampScale    = Head.TimestampScale;
+  Clusters          = reinterpret_cast<const KaxIndexCluster *>(Records);
+  ClusterCount      = static_cast<std::size_t>(Head.ClusterCount);
+  Lookup.Entries    = reinterpret_cast<const KaxIndexEntry *>(Records + ClustersSize);
+  Lookup.EntryCount = static_cast<std::size_t>(Head.EntryCount);
+  Lookup.Tracks     = Tracks;
+  Lookup.TrackCount = static_cast<std::size_t>(Head.TrackCount);
+  Lookup.Positions  = reinterpret_cast<const std::uint64_t *>(Records + ClustersSize + EntriesSize + TracksSize);
+  RecordsCrc        = Head.RecordsCrc;
+  return true;
+}
+
+void KaxIndexFile::Close()
+{
+  Data.reset();
+  Clusters     = nullptr;
+  ClusterCount = 0;
+  Lookup       = KaxIndexLookup{};
+}
+
+bool KaxIndexFile::Verify() const
+{
+  if (!IsOpen())
+    return false;
+  KaxCrc32 Crc;
+  Crc.Update(Clusters, ClusterCount * sizeof(KaxIndexCluster));
+  Crc.Update(Lookup.Entries, Lookup.EntryCount * sizeof(KaxIndexEntry));
+  Crc.Update(Lookup.Tracks, Lookup.TrackCount * sizeof(KaxIndexTrack));
+  Crc.Update(Lookup.Positions, Lookup.EntryCount * sizeof(std::uint64_t));
+  return Crc.Value() == RecordsCrc;
+}
+
+} // namespace libmatroska
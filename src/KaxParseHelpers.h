@@ -0,0 +1,88 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \brief decoding of raw EBML and Block heads, shared by the scanners, not installed
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#ifndef LIBMATROSKA_PARSE_HELPERS_H
+#define LIBMATROSKA_PARSE_HELPERS_H
+
+#include <ebml/EbmlHead.h>
+
+#include "matroska/KaxClusterBlockScanner.h"
+#include "matroska/KaxSegment.h"
+#include "KaxElementTable.h"
+
+namespace libmatroska {
+
+namespace internal {
+
+/*!
+  \return the length of an EBML coded value from its first byte, 0 if invalid
+*/
+inline unsigned int VINTLength(libebml::binary FirstByte)
+{
+  unsigned int Length = 1;
+  for (libebml::binary Mask = 0x80; Mask; Mask >>= 1, Length++) {
+    if (FirstByte & Mask)
+      return Length;
+  }
+  return 0;
+}
+
+/*!
+  \return true if the element can only be found at the top level of a Segment
+  \note used to find the end of Clusters with an unknown size
+*/
+inline bool IsTopLevelId(std::uint32_t Id)
+{
+  return KaxElementTable::Segment().Find(Id) != nullptr
+      || Id == EBML_ID(KaxSegment).GetValue()
+      || Id == EBML_ID(libebml::EbmlHead).GetValue();
+}
+
+/*!
+  \brief decode the track number, timestamp, flags and number of frames of a Block head
+  \param Head the start of the Block data, \a Available octets of it
+  \note Record.IsSimpleBlock must be set, the flags of a Block don't tell if it's a keyframe
+  \return the size of the head before the lace head, 0 if it's invalid
+*/
+inline std::size_t DecodeBlockHead(const libebml::binary * Head, std::size_t Available, KaxBlockRecord & Record)
+{
+  if (Available < 4)
+    return 0;
+
+  const unsigned int TrackLength = VINTLength(Head[0]);
+  if (TrackLength == 0 || TrackLength + 3 > Available)
+    return 0;
+  Record.TrackNumber = Head[0] & (0xFF >> TrackLength);
+  for (unsigned int i = 1; i < TrackLength; i++)
+    Record.TrackNumber = (Record.TrackNumber << 8) | Head[i];
+
+  const libebml::binary *cursor = &Head[TrackLength];
+  Record.RelativeTimestamp = static_cast<std::int16_t>((cursor[0] << 8) | cursor[1]);
+  const libebml::binary Flags = cursor[2];
+  const std::size_t HeadSize = TrackLength + 3;
+
+  if (Record.IsSimpleBlock) {
+    Record.IsKeyframe    = (Flags & 0x80) != 0;
+    Record.IsDiscardable = (Flags & 0x01) != 0;
+  }
+  Record.IsInvisible = (Flags & 0x08) != 0;
+  Record.Lacing      = static_cast<LacingType>((Flags & 0x06) >> 1);
+  Record.FrameCount  = 1;
+  if (Record.Lacing != LACING_NONE) {
+    if (HeadSize >= Available)
+      return 0;
+    Record.FrameCount = Head[HeadSize] + 1;
+  }
+  return HeadSize;
+}
+
+} // namespace internal
+
+} // namespace libmatroska
+
+#endif // LIBMATROSKA_PARSE_HELPERS_H
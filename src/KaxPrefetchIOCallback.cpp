@@ -0,0 +1,258 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "matroska/KaxPrefetchIOCallback.h"
+#include "matroska/KaxCluster.h"
+#include "matroska/KaxCues.h"
+#include "matroska/KaxSeekHead.h"
+#include "matroska/KaxSegment.h"
+
+using namespace libebml;
+
+namespace libmatroska {
+
+KaxPrefetchIOCallback::KaxPrefetchIOCallback(IOCallback & aSource, std::size_t aPageSize, std::size_t aMaxPages)
+  :Source(aSource)
+  ,PageSize(std::max<std::size_t>(aPageSize, 4096))
+  ,MaxPages(std::max<std::size_t>(aMaxPages, 4))
+  ,Position(aSource.getFilePointer())
+{
+  Loader = std::thread(&KaxPrefetchIOCallback::LoaderLoop, this);
+}
+
+KaxPrefetchIOCallback::~KaxPrefetchIOCallback()
+{
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    bStopping = true;
+  }
+  PageRequested.notify_all();
+  Loader.join();
+}
+
+void KaxPrefetchIOCallback::LoaderLoop()
+{
+  std::unique_lock<std::mutex> Guard(Lock);
+  while (true) {
+    PageRequested.wait(Guard, [this] { return bStopping || !Requests.empty(); });
+    if (bStopping)
+      return;
+
+    const std::uint64_t Index = Requests.front();
+    Requests.pop_front();
+    const auto Found = Pages.find(Index);
+    if (Found == Pages.end() || Found->second.bReady)
+      continue; // dropped or already loaded
+    Guard.unlock();
+
+    std::vector<binary> Data(PageSize);
+    std::exception_ptr Error;
+    try {
+      std::lock_guard<std::mutex> SourceGuard(SourceLock);
+      Source.setFilePointer(Index * PageSize, seek_beginning);
+      Data.resize(Source.read(Data.data(), PageSize));
+    } catch (...) {
+      Error = std::current_exception();
+    }
+
+    Guard.lock();
+    // the page can't be evicted while it's not ready
+    auto & Loaded = Pages[Index];
+    Loaded.Data   = std::move(Data);
+    Loaded.Error  = Error;
+    Loaded.bReady = true;
+    PageLoaded.notify_all();
+  }
+}
+
+/*!
+  \brief drop the least recently used page that is loaded
+  \return false if all the pages are being loaded
+  \note must be called with Lock held
+*/
+bool KaxPrefetchIOCallback::MakeRoom()
+{
+  auto Oldest = Pages.end();
+  for (auto It = Pages.begin(); It != Pages.end(); ++It) {
+    if (It->second.bReady && (Oldest == Pages.end() || It->second.LastUse < Oldest->second.LastUse))
+      Oldest = It;
+  }
+  if (Oldest == Pages.end())
+    return false;
+  Pages.erase(Oldest);
+  return true;
+}
+
+/*!
+  \brief add a page to load
+  \param bUrgent the parser is waiting for that page
+  \return false if there was no room for the page
+  \note must be called with Lock held
+*/
+bool KaxPrefetchIOCallback::Request(std::uint64_t Index, bool bUrgent)
+{
+  const auto Found = Pages.find(Index);
+  if (Found != Pages.end()) {
+    if (bUrgent && !Found->second.bReady) {
+      // don't wait behind the pages loaded in advance
+      const auto Queued = std::find(Requests.begin(), Requests.end(), Index);
+      if (Queued != Requests.end()) {
+        Requests.erase(Queued);
+        Requests.push_front(Index);
+      }
+    }
+    return true;
+  }
+  if (Pages.size() >= MaxPages && !MakeRoom() && !bUrgent)
+    return false;
+
+  auto & NewPage = Pages[Index];
+  NewPage.LastUse = bUrgent ? ++UseCounter : UseCounter;
+  if (bUrgent)
+    Requests.push_front(Index);
+  else
+    Requests.push_back(Index);
+  PageRequested.notify_one();
+  return true;
+}
+
+std::size_t KaxPrefetchIOCallback::read(void *Buffer, std::size_t Size)
+{
+  auto Output = static_cast<binary *>(Buffer);
+  std::size_t Read = 0;
+
+  std::unique_lock<std::mutex> Guard(Lock);
+  while (Read < Size) {
+    const std::uint64_t Index = Position / PageSize;
+    auto Found = Pages.find(Index);
+    if (Found != Pages.end() && Found->second.bReady)
+      Hits++;
+    else {
+      Misses++;
+      Request(Index, true);
+      PageLoaded.wait(Guard, [this, Index] {
+        auto Loaded = Pages.find(Index);
+        return Loaded != Pages.end() && Loaded->second.bReady;
+      });
+      Found = Pages.find(Index);
+    }
+
+    auto & Current = Found->second;
+    Current.LastUse = ++UseCounter;
+    if (Current.Error) {
+      const auto Error = Current.Error;
+      Pages.erase(Found); // try again on the next read
+      std::rethrow_exception(Error);
+    }
+
+    const auto Offset = static_cast<std::size_t>(Position % PageSize);
+    if (Offset >= Current.Data.size())
+      break; // end of the source
+    const std::size_t Copy = std::min(Size - Read, Current.Data.size() - Offset);
+    memcpy(Output + Read, Current.Data.data() + Offset, Copy);
+    Read     += Copy;
+    Position += Copy;
+    if (Current.Data.size() < PageSize)
+      break; // end of the source
+  }
+
+  // keep the following pages coming
+  const std::uint64_t Next = Position / PageSize;
+  for (std::size_t i = 1; i <= ReadAhead; i++) {
+    if (!Request(Next + i, false))
+      break;
+  }
+  return Read;
+}
+
+void KaxPrefetchIOCallback::setFilePointer(std::int64_t Offset, seek_mode Mode)
+{
+  switch (Mode) {
+    case seek_current:
+      Position = static_cast<std::uint64_t>(std::max<std::int64_t>(0, static_cast<std::int64_t>(Position) + Offset));
+      break;
+    case seek_end:
+      {
+        std::lock_guard<std::mutex> SourceGuard(SourceLock);
+        Source.setFilePointer(Offset, seek_end);
+        Position = Source.getFilePointer();
+      }
+      break;
+    case seek_beginning:
+    default:
+      Position = static_cast<std::uint64_t>(std::max<std::int64_t>(0, Offset));
+      break;
+  }
+}
+
+std::size_t KaxPrefetchIOCallback::write(const void * /* Buffer */, std::size_t /* Size */)
+{
+  throw std::runtime_error("KaxPrefetchIOCallback is read-only");
+}
+
+void KaxPrefetchIOCallback::close()
+{
+  std::lock_guard<std::mutex> SourceGuard(SourceLock);
+  Source.close();
+}
+
+void KaxPrefetchIOCallback::Prefetch(std::uint64_t aPosition, std::uint64_t aSize)
+{
+  if (aSize == 0)
+    return;
+  // leave room for the pages being read
+  const std::size_t Room = MaxPages > ReadAhead + 1 ? MaxPages - ReadAhead - 1 : 1;
+  const std::uint64_t MaxRange = static_cast<std::uint64_t>(Room) * PageSize;
+  const std::uint64_t Last = (aPosition + std::min(aSize, MaxRange) - 1) / PageSize;
+
+  std::lock_guard<std::mutex> Guard(Lock);
+  for (std::uint64_t Index = aPosition / PageSize; Index <= Last; Index++) {
+    if (!Request(Index, false))
+      break;
+  }
+}
+
+void KaxPrefetchIOCallback::Prefetch(const KaxCluster & Cluster)
+{
+  if (Cluster.IsFiniteSize())
+    Prefetch(Cluster.GetElementPosition(), Cluster.GetDataStart() + Cluster.GetSize() - Cluster.GetElementPosition());
+}
+
+void KaxPrefetchIOCallback::Prefetch(const KaxSegment & Segment, const KaxSeekHead & SeekHead)
+{
+  for (auto Seek = FindChild<KaxSeek>(SeekHead); Seek; Seek = FindNextChild<KaxSeek>(SeekHead, *Seek)) {
+    const std::int64_t Location = Seek->Location();
+    if (Location >= 0)
+      Prefetch(Segment.GetGlobalPosition(static_cast<std::uint64_t>(Location)), 1);
+  }
+}
+
+void KaxPrefetchIOCallback::Prefetch(const KaxSegment & Segment, const KaxCues & Cues, std::uint64_t aTimestamp, std::size_t aClusters)
+{
+  const auto & Index = Cues.GetIndex();
+  if (Index.empty() || aClusters == 0)
+    return;
+
+  const auto First = Cues.FindIndexEntry(aTimestamp);
+  std::size_t Entry = First ? static_cast<std::size_t>(First - Index.data()) : 0;
+
+  std::vector<std::uint64_t> Clusters;
+  for (; Entry < Index.size() && Clusters.size() < aClusters; Entry++) {
+    const std::uint64_t ClusterPosition = Index[Entry].ClusterPosition;
+    if (std::find(Clusters.begin(), Clusters.end(), ClusterPosition) == Clusters.end())
+      Clusters.push_back(ClusterPosition);
+  }
+
+  for (const auto ClusterPosition : Clusters)
+    Prefetch(Segment.GetGlobalPosition(ClusterPosition), PageSize);
+}
+
+} // namespace libmatroska
@@ -0,0 +1,342 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include <algorithm>
+#include <limits>
+
+#include <ebml/EbmlHead.h>
+#include "matroska/KaxPushParser.h"
+#include "matroska/KaxBlock.h"
+#include "matroska/KaxBlockData.h"
+#include "matroska/KaxCluster.h"
+#include "matroska/KaxSemantic.h"
+#include "KaxParseHelpers.h"
+
+using namespace libebml;
+
+namespace libmatroska {
+
+namespace {
+
+constexpr std::uint64_t NoPosition = std::numeric_limits<std::uint64_t>::max();
+
+/// EBML head of an element
+struct ElementHead {
+  std::uint32_t Id;
+  std::uint64_t DataSize;
+  std::size_t   Size;         ///< size of the head, 0 if more data is needed to read it
+  bool          bUnknownSize;
+};
+
+/*!
+  \brief read the EBML head of the element at \a Data
+  \return false if the head is invalid
+*/
+bool ReadHead(const binary * Data, std::size_t Available, ElementHead & Head)
+{
+  Head.Size = 0;
+  if (Available == 0)
+    return true;
+
+  const unsigned int IdLength = internal::VINTLength(Data[0]);
+  if (IdLength == 0 || IdLength > 4)
+    return false;
+  if (Available <= IdLength)
+    return true;
+  const unsigned int SizeLength = internal::VINTLength(Data[IdLength]);
+  if (SizeLength == 0)
+    return false;
+  if (Available < IdLength + SizeLength)
+    return true;
+
+  Head.Id = 0;
+  for (unsigned int i = 0; i < IdLength; i++)
+    Head.Id = (Head.Id << 8) | Data[i];
+
+  const binary * SizeData = Data + IdLength;
+  Head.DataSize = SizeData[0] & (0xFF >> SizeLength);
+  for (unsigned int i = 1; i < SizeLength; i++)
+    Head.DataSize = (Head.DataSize << 8) | SizeData[i];
+  Head.bUnknownSize = (Head.DataSize == (std::uint64_t(1) << (7 * SizeLength)) - 1);
+  Head.Size = IdLength + SizeLength;
+  return true;
+}
+
+/*!
+  \return the number of octets missing to \a Pending to hold the head of the
+  element it starts with, or the whole element once the head is known
+  \note \a Pending is not empty and starts with a valid element head
+*/
+std::uint64_t MissingSize(const std::vector<binary> & Pending)
+{
+  const unsigned int IdLength = internal::VINTLength(Pending[0]);
+  if (Pending.size() <= IdLength)
+    return IdLength + 1 - Pending.size();
+  const unsigned int SizeLength = internal::VINTLength(Pending[IdLength]);
+  if (Pending.size() < IdLength + SizeLength)
+    return IdLength + SizeLength - Pending.size();
+
+  ElementHead Head;
+  ReadHead(Pending.data(), Pending.size(), Head);
+  return Head.Size + Head.DataSize - Pending.size();
+}
+
+bool ReadUInt(const binary * Data, std::uint64_t Size, std::uint64_t & Value)
+{
+  if (Size > 8)
+    return false;
+  Value = 0;
+  for (std::uint64_t i = 0; i < Size; i++)
+    Value = (Value << 8) | Data[i];
+  return true;
+}
+
+} // namespace
+
+KaxPushParser::KaxPushParser(Handler & aHandler, std::uint64_t aStartPosition, std::uint64_t aTimestampScale)
+  :myHandler(aHandler)
+  ,Position(aStartPosition)
+  ,TimestampScale(aTimestampScale)
+  ,WantedPosition(NoPosition)
+{
+}
+
+bool KaxPushParser::Feed(const binary * Data, std::size_t Size)
+{
+  if (bError)
+    return false;
+
+  while (!Pending.empty() && Size != 0) {
+    // only copy what completes the incomplete element, either its head or the whole element
+    const auto Copied = static_cast<std::size_t>(std::min<std::uint64_t>(MissingSize(Pending), Size));
+    Pending.insert(Pending.end(), Data, Data + Copied);
+    Data += Copied;
+    Size -= Copied;
+    const std::size_t Used = Process(Pending.data(), Pending.size());
+    Pending.erase(Pending.begin(), Pending.begin() + Used);
+    if (bError)
+      return false;
+  }
+
+  if (Pending.empty()) {
+    // parse in place, only keep the incomplete element
+    const std::size_t Used = Process(Data, Size);
+    Pending.assign(Data + Used, Data + Size);
+  }
+  return !bError;
+}
+
+bool KaxPushParser::Finish()
+{
+  bool bComplete = !bError && Pending.empty() && SkipRemaining == 0;
+
+  if (bInCluster) {
+    bComplete = bComplete && bClusterUnknownSize;
+    EndCluster();
+  }
+  if (bInSegment) {
+    bComplete = bComplete && bSegmentUnknownSize;
+    bInSegment = false;
+    myHandler.OnSegmentEnd(Position);
+  }
+  return bComplete;
+}
+
+void KaxPushParser::EndCluster()
+{
+  bInCluster = false;
+  myHandler.OnClusterEnd(Position);
+}
+
+std::size_t KaxPushParser::Process(const binary * Data, std::size_t Size)
+{
+  std::size_t Used = 0;
+  while (!bError) {
+    if (SkipRemaining != 0) {
+      const auto Skipped = static_cast<std::size_t>(std::min<std::uint64_t>(SkipRemaining, Size - Used));
+      Used          += Skipped;
+      Position      += Skipped;
+      SkipRemaining -= Skipped;
+      if (SkipRemaining != 0)
+        break;
+      continue;
+    }
+
+    if (bInCluster && !bClusterUnknownSize && Position >= ClusterEnd) {
+      EndCluster();
+      continue;
+    }
+    if (bInSegment && !bSegmentUnknownSize && Position >= SegmentEnd) {
+      if (bInCluster)
+        EndCluster(); // with an unknown size, it ends with the Segment
+      bInSegment = false;
+      myHandler.OnSegmentEnd(Position);
+      continue;
+    }
+
+    const binary * Element = Data + Used;
+    const std::size_t Available = Size - Used;
+    ElementHead Head;
+    if (!ReadHead(Element, Available, Head)) {
+      bError = true;
+      break;
+    }
+    if (Head.Size == 0)
+      break; // wait for the rest of the head
+
+    if (bInCluster && bClusterUnknownSize && internal::IsTopLevelId(Head.Id)) {
+      // beginning of the next top level element
+      EndCluster();
+      continue;
+    }
+    if (bInSegment && bSegmentUnknownSize && (Head.Id == EBML_ID(KaxSegment).GetValue() || Head.Id == EBML_ID(EbmlHead).GetValue())) {
+      // beginning of the next Segment
+      bInSegment = false;
+      myHandler.OnSegmentEnd(Position);
+      continue;
+    }
+
+    if (bInSegment && !bInCluster && Head.Id == EBML_ID(KaxCluster).GetValue()) {
+      bInCluster          = true;
+      bClusterUnknownSize = Head.bUnknownSize;
+      ClusterEnd          = Position + Head.Size + Head.DataSize;
+      ClusterTimestamp    = 0;
+      myHandler.OnCluster(Position, bClusterUnknownSize);
+      Used     += Head.Size;
+      Position += Head.Size;
+      continue;
+    }
+    if (!bInSegment && Head.Id == EBML_ID(KaxSegment).GetValue()) {
+      bInSegment          = true;
+      bSegmentUnknownSize = Head.bUnknownSize;
+      SegmentEnd          = Position + Head.Size + Head.DataSize;
+      myHandler.OnSegment(Position, Position + Head.Size, Head.DataSize, bSegmentUnknownSize);
+      Used     += Head.Size;
+      Position += Head.Size;
+      continue;
+    }
+
+    // the other elements can't be left before their end
+    if (Head.bUnknownSize || Head.DataSize > NoPosition - Position - Head.Size) {
+      bError = true;
+      break;
+    }
+    const std::uint64_t ElementSize = Head.Size + Head.DataSize;
+    const std::uint64_t ParentEnd = bInCluster ? (bClusterUnknownSize ? NoPosition : ClusterEnd)
+                                  : bInSegment ? (bSegmentUnknownSize ? NoPosition : SegmentEnd) : NoPosition;
+    if (Position + ElementSize > ParentEnd) {
+      bError = true;
+      break;
+    }
+
+    if (bInCluster) {
+      const bool bSimpleBlock = Head.Id == EBML_ID(KaxSimpleBlock).GetValue();
+      if (!bSimpleBlock && Head.Id != EBML_ID(KaxBlockGroup).GetValue() && Head.Id != EBML_ID(KaxClusterTimestamp).GetValue()) {
+        // CRC-32, Void, Position, PrevSize, etc.
+        SkipRemaining = ElementSize;
+        continue;
+      }
+      if (ElementSize > MaxElementSize) {
+        bError = true;
+        break;
+      }
+      if (ElementSize > Available)
+        break; // wait for the whole element
+
+      if (Head.Id == EBML_ID(KaxClusterTimestamp).GetValue()) {
+        if (!ReadUInt(Element + Head.Size, Head.DataSize, ClusterTimestamp)) {
+          bError = true;
+          break;
+        }
+        myHandler.OnClusterTimestamp(ClusterTimestamp);
+      } else {
+        KaxBlockRecord Record{};
+        if (!ReadBlock(Element, Head.Size, static_cast<std::size_t>(ElementSize), bSimpleBlock, Record)) {
+          bError = true;
+          break;
+        }
+        myHandler.OnBlock(Record, Element, static_cast<std::size_t>(ElementSize));
+      }
+      Used     += static_cast<std::size_t>(ElementSize);
+      Position += ElementSize;
+      continue;
+    }
+
+    // EBML header or top level element of the Segment
+    if (WantedPosition != Position) {
+      if (!myHandler.OnElementHead(Head.Id, Position, ElementSize) || ElementSize > MaxElementSize) {
+        SkipRemaining = ElementSize;
+        continue;
+      }
+      WantedPosition = Position;
+    }
+    if (ElementSize > Available)
+      break; // wait for the whole element
+    myHandler.OnElement(Head.Id, Position, Element, static_cast<std::size_t>(ElementSize));
+    WantedPosition = NoPosition;
+    Used     += static_cast<std::size_t>(ElementSize);
+    Position += ElementSize;
+  }
+  return Used;
+}
+
+bool KaxPushParser::ReadBlockHead(const binary * Block, std::size_t Size, std::uint64_t DataStart, KaxBlockRecord & Record) const
+{
+  const std::size_t HeadSize = internal::DecodeBlockHead(Block, Size, Record);
+  if (HeadSize == 0)
+    return false;
+
+  Record.PayloadPosition = DataStart + HeadSize;
+  Record.PayloadSize     = Size - HeadSize;
+  Record.Timestamp       = static_cast<std::uint64_t>((static_cast<std::int64_t>(ClusterTimestamp) + Record.RelativeTimestamp) * static_cast<std::int64_t>(TimestampScale));
+  return true;
+}
+
+bool KaxPushParser::ReadBlock(const binary * Element, std::size_t HeadSize, std::size_t ElementSize, bool bSimpleBlock, KaxBlockRecord & Record) const
+{
+  Record.ElementPosition = Position;
+  Record.IsSimpleBlock   = bSimpleBlock;
+  if (bSimpleBlock) {
+    Record.BlockPosition = Position;
+    return ReadBlockHead(Element + HeadSize, ElementSize - HeadSize, Position + HeadSize, Record);
+  }
+
+  bool BlockFound = false;
+  Record.IsKeyframe = true;
+
+  std::size_t Offset = HeadSize;
+  while (Offset < ElementSize) {
+    ElementHead Child;
+    if (!ReadHead(Element + Offset, ElementSize - Offset, Child) || Child.Size == 0 || Child.bUnknownSize)
+      return false;
+    if (Child.DataSize > ElementSize - Offset - Child.Size)
+      return false;
+    const binary * ChildData = Element + Offset + Child.Size;
+    const auto ChildSize = static_cast<std::size_t>(Child.DataSize);
+
+    if (Child.Id == EBML_ID(KaxBlock).GetValue()) {
+      if (BlockFound)
+        return false;
+      Record.BlockPosition = Position + Offset;
+      if (!ReadBlockHead(ChildData, ChildSize, Position + Offset + Child.Size, Record))
+        return false;
+      BlockFound = true;
+    } else if (Child.Id == EBML_ID(KaxReferenceBlock).GetValue()) {
+      Record.IsKeyframe = false;
+    } else if (Child.Id == EBML_ID(KaxBlockDuration).GetValue()) {
+      std::uint64_t Duration;
+      if (!ReadUInt(ChildData, ChildSize, Duration))
+        return false;
+      Record.Duration    = Duration * TimestampScale;
+      Record.HasDuration = true;
+    }
+    Offset += Child.Size + ChildSize;
+  }
+  return BlockFound;
+}
+
+} // namespace libmatroska
@@ -20,53 +20,95 @@ namespace libmatroska {
   \todo verify that the element is not already in the list
 */
 KaxSeek * KaxSeekHead::IndexThis(const EbmlElement & aElt, const KaxSegment & ParentSegment)
+{
+  return IndexThis(static_cast<const EbmlId&>(aElt), ParentSegment.GetRelativePosition(aElt));
+}
+
+KaxSeek * KaxSeekHead::IndexThis(const EbmlId & aId, std::uint64_t aRelativePosition)
 {
   // create a new point
   auto & aNewPoint = AddNewChild<KaxSeek>(*this);
 
   // add the informations to this element
   auto & aNewPos = GetChild<KaxSeekPosition>(aNewPoint);
-  aNewPos.SetValue(ParentSegment.GetRelativePosition(aElt));
+  aNewPos.SetValue(aRelativePosition);
 
   auto & aNewID = GetChild<KaxSeekID>(aNewPoint);
   binary ID[4];
-  static_cast<const EbmlId&>(aElt).Fill(ID);
-  aNewID.CopyBuffer(ID, EBML_ID_LENGTH((const EbmlId&)aElt));
+  aId.Fill(ID);
+  aNewID.CopyBuffer(ID, EBML_ID_LENGTH(aId));
+
+  // with a valid index, only add the new entry
+  if (bIndexValid && myIndexedChildren + 1 == ListSize()) {
+    auto & Entries = myIndex[aNewPoint.GetIdValue()];
+    myIndexPositions[&aNewPoint] = IndexPosition{aNewPoint.GetIdValue(), Entries.size()};
+    Entries.push_back(&aNewPoint);
+    myIndexedChildren = ListSize();
+  } else
+    bIndexValid = false;
 
   return &aNewPoint;
 }
 
-KaxSeek * KaxSeekHead::FindFirstOf(const EbmlCallbacks & Callbacks) const
+void KaxSeekHead::Read(EbmlStream & inDataStream, const EbmlSemanticContext & Context, int & UpperEltFound, EbmlElement * & FoundElt, bool AllowDummyElt, ScopeMode ReadFully)
+{
+  // the entries read may reuse the addresses of the previous ones
+  InvalidateIndex();
+  EbmlMaster::Read(inDataStream, Context, UpperEltFound, FoundElt, AllowDummyElt, ReadFully);
+}
+
+void KaxSeekHead::Remove(std::vector<EbmlElement *>::iterator & Itr)
+{
+  InvalidateIndex();
+  EbmlMaster::Remove(Itr);
+}
+
+void KaxSeekHead::RemoveAll()
+{
+  InvalidateIndex();
+  EbmlMaster::RemoveAll();
+}
+
+void KaxSeekHead::BuildIndex() const
 {
-  // parse all the Entries and find the first to match the type
-  auto aElt = FindChild<KaxSeek>(*this);
-  while (aElt) {
-    const auto aId = FindChild<KaxSeekID>(*aElt);
-    if (aId != nullptr) {
-      const auto aEbmlId = EbmlId(EbmlId::FromBuffer(aId->GetBuffer(), aId->GetSize()));
-      if (aEbmlId == EBML_INFO_ID(Callbacks)) {
-        return aElt;
-      }
-    }
-    aElt = FindNextChild<KaxSeek>(*this,*aElt);
+  myIndex.clear();
+  myIndexPositions.clear();
+
+  for (auto aElt = FindChild<KaxSeek>(*this); aElt; aElt = FindNextChild<KaxSeek>(*this, *aElt)) {
+    const auto Id = aElt->GetIdValue();
+    auto & Entries = myIndex[Id];
+    myIndexPositions[aElt] = IndexPosition{Id, Entries.size()};
+    Entries.push_back(aElt);
   }
 
-  return nullptr;
+  myIndexedChildren = ListSize();
+  bIndexValid = true;
 }
 
-KaxSeek * KaxSeekHead::FindNextOf(const KaxSeek &aPrev) const
+KaxSeek * KaxSeekHead::FindFirstOf(const EbmlCallbacks & Callbacks) const
 {
-  // look for the previous in the list
-  auto it = std::find(this->begin(), this->end(), static_cast<const EbmlElement*>(&aPrev));
-  if (it == this->end())
+  if (!bIndexValid || myIndexedChildren != ListSize())
+    BuildIndex();
+
+  const auto Entries = myIndex.find(EBML_INFO_ID(Callbacks).GetValue());
+  if (Entries == myIndex.end())
     return nullptr;
+  return Entries->second.front();
+}
+
+KaxSeek * KaxSeekHead::FindNextOf(const KaxSeek &aPrev) const
+{
+  if (!bIndexValid || myIndexedChildren != ListSize())
+    BuildIndex();
 
-  auto it2 = std::find_if(it + 1, this->end(), [&](auto e)
-      { return (EbmlId(*(*it)) == EBML_ID(KaxSeek)) && static_cast<KaxSeek *>(e)->IsEbmlId(aPrev); });
-  if (it2 == this->end())
+  const auto Prev = myIndexPositions.find(&aPrev);
+  if (Prev == myIndexPositions.end())
     return nullptr;
 
-  return static_cast<KaxSeek*>(*it2);
+  const auto & Entries = myIndex[Prev->second.Id];
+  if (Prev->second.Rank + 1 >= Entries.size())
+    return nullptr;
+  return Entries[Prev->second.Rank + 1];
 }
 
 std::int64_t KaxSeek::Location() const
@@ -86,6 +128,14 @@ bool KaxSeek::IsEbmlId(const EbmlId & aId) const
   return (aId == aEbmlId);
 }
 
+std::uint32_t KaxSeek::GetIdValue() const
+{
+  auto _Id = FindChild<KaxSeekID>(*this);
+  if (!_Id || _Id->GetSize() == 0 || _Id->GetSize() > 4)
+    return 0;
+  return EbmlId::FromBuffer(_Id->GetBuffer(), _Id->GetSize()).GetValue();
+}
+
 bool KaxSeek::IsEbmlId(const KaxSeek & aPoint) const
 {
   auto _IdA = FindChild<KaxSeekID>(*this);
@@ -0,0 +1,168 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include <algorithm>
+#include <cmath>
+
+#include <ebml/MemIOCallback.h>
+#include "matroska/KaxSegmentFinalizer.h"
+#include "matroska/KaxCues.h"
+#include "matroska/KaxSegment.h"
+
+using namespace libebml;
+
+namespace libmatroska {
+
+namespace {
+
+/*!
+  \brief code the head of a Void element of \a Total octets, head included
+  \note \a Total must be at least 2
+  \return the size of the head
+*/
+std::size_t VoidHead(std::uint64_t Total, binary (&Head)[9])
+{
+  Head[0] = 0xEC; // EbmlVoid
+  unsigned int SizeLength = 1;
+  while (SizeLength < 8 && Total - 1 - SizeLength >= (std::uint64_t(1) << (7 * SizeLength)) - 1)
+    SizeLength++;
+
+  const std::uint64_t DataSize = Total - 1 - SizeLength;
+  for (unsigned int i = 0; i < SizeLength; i++)
+    Head[1 + i] = static_cast<binary>(DataSize >> (8 * (SizeLength - 1 - i)));
+  Head[1] |= 0x80 >> (SizeLength - 1);
+  return 1 + SizeLength;
+}
+
+/// \return true if \a Size octets can be written in \a Room, with a Void element for the rest
+bool Fits(std::uint64_t Size, std::uint64_t Room)
+{
+  return Size == Room || Size + 2 <= Room;
+}
+
+/*!
+  \brief write \a Data at \a Position, followed by a Void head up to \a Room octets
+  \note it's done in a single write
+*/
+void WriteAt(IOCallback & Output, std::uint64_t Position, MemIOCallback & Data, std::uint64_t Room)
+{
+  const std::uint64_t Size = Data.GetDataBufferSize();
+  if (Room > Size) {
+    binary Head[9];
+    Data.write(Head, VoidHead(Room - Size, Head));
+  }
+  Output.setFilePointer(Position);
+  Output.writeFully(Data.GetDataBuffer(), Data.GetDataBufferSize());
+}
+
+} // namespace
+
+KaxSegmentFinalizer::KaxSegmentFinalizer(IOCallback & aOutput, KaxSegment & aSegment, KaxCues & aCues)
+  :Output(aOutput)
+  ,Segment(aSegment)
+  ,Cues(aCues)
+{
+}
+
+std::uint64_t KaxSegmentFinalizer::EstimateCuesSize(std::uint64_t aDuration, double aCuePointsPerSecond, unsigned int aTracks)
+{
+  // CuePoint head and CueTime: 12 octets at most
+  // CueTrackPositions with CueTrack, CueClusterPosition, CueRelativePosition,
+  // CueDuration and CueBlockNumber: 36 octets at most
+  const auto CuePoints = static_cast<std::uint64_t>(std::ceil(static_cast<double>(aDuration) / 1000000000.0 * std::max(aCuePointsPerSecond, 0.0))) + 1;
+  const std::uint64_t Size = CuePoints * (12 + 36 * static_cast<std::uint64_t>(std::max(aTracks, 1u)));
+  return 12 + Size + Size / 8;
+}
+
+/*!
+  \brief write a Void element of \a aSize octets
+*/
+void KaxSegmentFinalizer::Reserve(std::uint64_t aSize)
+{
+  binary Head[9];
+  const std::size_t HeadSize = VoidHead(aSize, Head);
+  Output.writeFully(Head, HeadSize);
+  aSize -= HeadSize;
+
+  static const binary Zeros[4096] = {};
+  while (aSize != 0) {
+    const auto Chunk = static_cast<std::size_t>(std::min<std::uint64_t>(aSize, sizeof(Zeros)));
+    Output.writeFully(Zeros, Chunk);
+    aSize -= Chunk;
+  }
+}
+
+void KaxSegmentFinalizer::Start(std::uint64_t aCuesSize, std::uint64_t aSeekHeadSize)
+{
+  // the size is written when the Segment is finished
+  Segment.WriteHead(Output, 8);
+
+  SeekHeadPosition = Output.getFilePointer();
+  SeekHeadRoom     = aSeekHeadSize < 2 ? 0 : aSeekHeadSize;
+  if (SeekHeadRoom != 0)
+    Reserve(SeekHeadRoom);
+
+  CuesPosition = Output.getFilePointer();
+  CuesRoom     = aCuesSize < 2 ? 0 : aCuesSize;
+  if (CuesRoom != 0)
+    Reserve(CuesRoom);
+}
+
+void KaxSegmentFinalizer::Index(const EbmlElement & aElt)
+{
+  SeekHead.IndexThis(aElt, Segment);
+}
+
+bool KaxSegmentFinalizer::Finish()
+{
+  bool bInPlace = true;
+  Output.setFilePointer(0, seek_end);
+  std::uint64_t End = Output.getFilePointer();
+
+  if (Cues.ListSize() != 0) {
+    MemIOCallback CuesData;
+    Cues.Render(CuesData);
+    const std::uint64_t CuesSize = CuesData.GetDataBufferSize();
+    if (Fits(CuesSize, CuesRoom)) {
+      WriteAt(Output, CuesPosition, CuesData, CuesRoom);
+      SeekHead.IndexThis(EBML_ID(KaxCues), Segment.GetRelativePosition(CuesPosition));
+    } else {
+      WriteAt(Output, End, CuesData, CuesSize);
+      SeekHead.IndexThis(EBML_ID(KaxCues), Segment.GetRelativePosition(End));
+      End += CuesSize;
+      bInPlace = false;
+    }
+  }
+
+  if (SeekHead.ListSize() != 0) {
+    MemIOCallback SeekData;
+    SeekHead.Render(SeekData);
+    const std::uint64_t SeekSize = SeekData.GetDataBufferSize();
+    if (Fits(SeekSize, SeekHeadRoom))
+      WriteAt(Output, SeekHeadPosition, SeekData, SeekHeadRoom);
+    else {
+      // the SeekHead goes at the end, referenced by a SeekHead in the reserved room
+      KaxSeekHead Forward;
+      Forward.IndexThis(EBML_ID(KaxSeekHead), Segment.GetRelativePosition(End));
+      WriteAt(Output, End, SeekData, SeekSize);
+      End += SeekSize;
+      bInPlace = false;
+
+      MemIOCallback ForwardData;
+      Forward.Render(ForwardData);
+      if (Fits(ForwardData.GetDataBufferSize(), SeekHeadRoom))
+        WriteAt(Output, SeekHeadPosition, ForwardData, SeekHeadRoom);
+    }
+  }
+
+  Segment.ForceSize(End - Segment.GetDataStart());
+  Segment.OverwriteHead(Output);
+  Output.setFilePointer(End);
+  return bInPlace;
+}
+
+} // namespace libmatroska
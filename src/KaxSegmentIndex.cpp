@@ -0,0 +1,130 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include <algorithm>
+
+#include "matroska/KaxSegmentIndex.h"
+#include "matroska/KaxCues.h"
+#include "matroska/KaxSeekHead.h"
+#include "matroska/KaxSemantic.h"
+#include "matroska/KaxTracks.h"
+
+using namespace libebml;
+
+namespace libmatroska {
+
+namespace {
+
+template <typename Type>
+std::uint64_t UIntegerValue(const EbmlMaster & Parent, std::uint64_t Default = 0)
+{
+  const auto Element = FindChild<const Type>(Parent);
+  return Element ? static_cast<std::uint64_t>(*Element) : Default;
+}
+
+KaxSegmentIndexTrack ReadTrack(const KaxTrackEntry & Entry)
+{
+  KaxSegmentIndexTrack Track;
+  Track.Number          = UIntegerValue<KaxTrackNumber>(Entry);
+  Track.UID             = UIntegerValue<KaxTrackUID>(Entry);
+  Track.Type            = UIntegerValue<KaxTrackType>(Entry);
+  Track.DefaultDuration = UIntegerValue<KaxTrackDefaultDuration>(Entry);
+  Track.CodecDelay      = UIntegerValue<KaxCodecDelay>(Entry);
+  Track.SeekPreRoll     = UIntegerValue<KaxSeekPreRoll>(Entry);
+  Track.bLacing         = Entry.LacingEnabled();
+
+  if (const auto Codec = FindChild<const KaxCodecID>(Entry))
+    Track.CodecID = Codec->GetValue();
+  if (const auto Private = FindChild<const KaxCodecPrivate>(Entry)) {
+    if (Private->GetBuffer() != nullptr)
+      Track.CodecPrivate.assign(Private->GetBuffer(), Private->GetBuffer() + Private->GetSize());
+  }
+  return Track;
+}
+
+} // namespace
+
+std::shared_ptr<const KaxSegmentIndex> KaxSegmentIndex::Create(std::uint64_t aSegmentDataStart, std::uint64_t aTimestampScale,
+                                                               const KaxTracks * aTracks, const KaxCues * aCues, const KaxSeekHead * aSeekHead,
+                                                               std::vector<KaxIndexCluster> aClusters)
+{
+  // the constructor is private, std::make_shared can't be used
+  std::shared_ptr<KaxSegmentIndex> Index(new KaxSegmentIndex);
+  Index->SegmentDataStart = aSegmentDataStart;
+  Index->TimestampScale   = aTimestampScale;
+
+  if (aTracks) {
+    for (auto Entry = FindChild<const KaxTrackEntry>(*aTracks); Entry; Entry = FindNextChild<const KaxTrackEntry>(*aTracks, *Entry))
+      Index->Tracks.push_back(ReadTrack(*Entry));
+    std::stable_sort(Index->Tracks.begin(), Index->Tracks.end(),
+                     [](const KaxSegmentIndexTrack & a, const KaxSegmentIndexTrack & b) { return a.Number < b.Number; });
+  }
+
+  if (aCues) {
+    Index->Cues = KaxIndexBuilder::CueEntries(*aCues, aSegmentDataStart, aTimestampScale);
+    KaxIndexLookup::BuildTracks(Index->Cues, Index->CueTracks, Index->CuePositions);
+  }
+
+  if (aSeekHead) {
+    for (auto Seek = FindChild<const KaxSeek>(*aSeekHead); Seek; Seek = FindNextChild<const KaxSeek>(*aSeekHead, *Seek)) {
+      const auto Id = Seek->GetIdValue();
+      if (Id != 0)
+        Index->SeekEntries.push_back({Id, aSegmentDataStart + static_cast<std::uint64_t>(Seek->Location())});
+    }
+    std::sort(Index->SeekEntries.begin(), Index->SeekEntries.end(), [](const KaxSegmentIndexSeek & a, const KaxSegmentIndexSeek & b) {
+      return a.Id < b.Id || (a.Id == b.Id && a.Position < b.Position);
+    });
+  }
+
+  Index->Clusters = std::move(aClusters);
+  return Index;
+}
+
+const KaxSegmentIndexTrack * KaxSegmentIndex::FindTrack(std::uint64_t aNumber) const
+{
+  const auto Found = std::lower_bound(Tracks.begin(), Tracks.end(), aNumber,
+    [](const KaxSegmentIndexTrack & Track, std::uint64_t Number) { return Track.Number < Number; });
+  if (Found == Tracks.end() || Found->Number != aNumber)
+    return nullptr;
+  return &*Found;
+}
+
+const KaxIndexEntry * KaxSegmentIndex::FindCue(std::uint64_t aTimestamp, std::uint64_t aTrack) const
+{
+  const KaxIndexLookup Lookup{Cues.data(), Cues.size(), CueTracks.data(), CueTracks.size(), CuePositions.data()};
+  return Lookup.Find(aTimestamp, aTrack);
+}
+
+std::uint64_t KaxSegmentIndex::FindSeek(std::uint32_t aId) const
+{
+  const auto Found = std::lower_bound(SeekEntries.begin(), SeekEntries.end(), aId,
+    [](const KaxSegmentIndexSeek & Seek, std::uint32_t Id) { return Seek.Id < Id; });
+  if (Found == SeekEntries.end() || Found->Id != aId)
+    return 0;
+  return Found->Position;
+}
+
+const KaxIndexCluster * KaxSegmentIndex::FindCluster(std::uint64_t aTimestamp) const
+{
+  const auto Found = std::upper_bound(Clusters.begin(), Clusters.end(), aTimestamp,
+    [this](std::uint64_t Timestamp, const KaxIndexCluster & Cluster) { return Timestamp < Cluster.Timestamp * TimestampScale; });
+  if (Found == Clusters.begin())
+    return nullptr;
+  return &*(Found - 1);
+}
+
+const KaxIndexCluster * KaxSegmentIndex::FindClusterAt(std::uint64_t aPosition) const
+{
+  const auto Found = std::upper_bound(Clusters.begin(), Clusters.end(), aPosition,
+    [](std::uint64_t Position, const KaxIndexCluster & Cluster) { return Position < Cluster.Position; });
+  if (Found == Clusters.begin())
+    return nullptr;
+  const auto & Cluster = *(Found - 1);
+  return aPosition < Cluster.Position + Cluster.Size ? &Cluster : nullptr;
+}
+
+} // namespace libmatroska
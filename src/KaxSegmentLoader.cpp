@@ -0,0 +1,180 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include <limits>
+
+#include "matroska/KaxSegmentLoader.h"
+#include "matroska/KaxCluster.h"
+#include "matroska/KaxSeekHead.h"
+#include "matroska/KaxSegment.h"
+#include "matroska/KaxSemantic.h"
+#include "matroska/KaxStats.h"
+
+using namespace libebml;
+
+namespace libmatroska {
+
+KaxSegmentLoader::KaxSegmentLoader(EbmlStream & aStream, KaxSegment & aSegment)
+  :Stream(aStream)
+  ,Segment(aSegment)
+  ,WalkPosition(aSegment.GetDataStart())
+{
+}
+
+void KaxSegmentLoader::AddEntry(std::uint32_t Id, std::uint64_t Position)
+{
+  if (EntryPositions.insert(Position).second) {
+    Entries.push_back(Entry{Id, Position});
+    FirstPositions.emplace(Id, Position);
+  }
+}
+
+std::uint64_t KaxSegmentLoader::MaxDataSize(std::uint64_t Position) const
+{
+  if (!Segment.IsFiniteSize())
+    return std::numeric_limits<std::uint64_t>::max();
+  const std::uint64_t End = Segment.GetEndPosition();
+  return Position < End ? End - Position : 0;
+}
+
+std::uint64_t KaxSegmentLoader::GetPosition(const EbmlCallbacks & Callbacks) const
+{
+  const std::uint32_t Id = EBML_INFO_ID(Callbacks).GetValue();
+  const auto Known = FirstPositions.find(Id);
+  return Known == FirstPositions.end() ? 0 : Known->second;
+}
+
+/*!
+  \brief read the whole element of the given type found at \a Position
+  \return nullptr if there is no such element at this position
+*/
+EbmlElement * KaxSegmentLoader::ReadElementAt(std::uint64_t Position, const EbmlCallbacks & Callbacks)
+{
+  const std::uint64_t MaxSize = MaxDataSize(Position);
+  if (MaxSize == 0)
+    return nullptr;
+
+  Stream.I_O().setFilePointer(Position, seek_beginning);
+  int UpperLevel = 0;
+  auto Element = Stream.FindNextElement(EBML_CONTEXT(&Segment), UpperLevel, MaxSize, false);
+  if (Element == nullptr)
+    return nullptr;
+  MATROSKA_STATS_ELEMENT(EbmlId(*Element).GetValue());
+  if (UpperLevel != 0 || Element->GetElementPosition() != Position || EbmlId(*Element) != EBML_INFO_ID(Callbacks)) {
+    delete Element;
+    return nullptr;
+  }
+
+  EbmlElement *Found = nullptr;
+  Element->Read(Stream, EBML_CONTEXT(Element), UpperLevel, Found, true, SCOPE_ALL_DATA);
+  delete Found;
+
+  Segment.PushElement(*Element);
+  return Element;
+}
+
+/*!
+  \brief walk the top level element heads until an element with \a TargetId is found
+  \param bStopAtCluster stop at the first Cluster, it will be walked by the next call
+  \return true if the element was found, it's the last Entry
+*/
+bool KaxSegmentLoader::Walk(std::uint32_t TargetId, bool bStopAtCluster)
+{
+  while (!bWalkDone) {
+    const std::uint64_t MaxSize = MaxDataSize(WalkPosition);
+    if (MaxSize == 0)
+      break;
+
+    Stream.I_O().setFilePointer(WalkPosition, seek_beginning);
+    int UpperLevel = 0;
+    auto Element = Stream.FindNextElement(EBML_CONTEXT(&Segment), UpperLevel, MaxSize, true);
+    if (Element == nullptr || UpperLevel != 0) {
+      delete Element;
+      break;
+    }
+
+    const std::uint32_t Id = EbmlId(*Element).GetValue();
+    MATROSKA_STATS_ELEMENT(Id);
+    const std::uint64_t Position = Element->GetElementPosition();
+    const bool bFinite = Element->IsFiniteSize();
+    const std::uint64_t End = bFinite ? Element->GetEndPosition() : 0;
+    delete Element;
+
+    if (bStopAtCluster && Id == EBML_ID(KaxCluster).GetValue()) {
+      WalkPosition = Position;
+      return false;
+    }
+
+    AddEntry(Id, Position);
+    if (!bFinite)
+      bWalkDone = true; // can't go further without parsing it
+    else
+      WalkPosition = End;
+    if (Id == TargetId)
+      return true;
+  }
+
+  bWalkDone = true;
+  return false;
+}
+
+bool KaxSegmentLoader::ReadSeekHeads()
+{
+  const std::uint32_t SeekHeadId = EBML_ID(KaxSeekHead).GetValue();
+  std::vector<std::uint64_t> ToRead;
+  if (GetPosition(EBML_INFO(KaxSeekHead)) != 0 || Walk(SeekHeadId, true))
+    ToRead.push_back(GetPosition(EBML_INFO(KaxSeekHead)));
+
+  bool bFound = false;
+  while (!ToRead.empty()) {
+    const std::uint64_t Position = ToRead.back();
+    ToRead.pop_back();
+    if (!SeekHeadsRead.insert(Position).second)
+      continue; // loop in the SeekHeads
+
+    auto SeekHead = static_cast<KaxSeekHead *>(ReadElementAt(Position, EBML_INFO(KaxSeekHead)));
+    if (SeekHead == nullptr)
+      continue;
+    if (!bFound)
+      Loaded[SeekHeadId] = SeekHead;
+    bFound = true;
+
+    for (auto Seek = FindChild<KaxSeek>(*SeekHead); Seek; Seek = FindNextChild<KaxSeek>(*SeekHead, *Seek)) {
+      const std::uint32_t Id = Seek->GetIdValue();
+      if (Id == 0)
+        continue;
+      const std::uint64_t ElementPosition = Segment.GetGlobalPosition(Seek->Location());
+      AddEntry(Id, ElementPosition);
+      if (Id == SeekHeadId)
+        ToRead.push_back(ElementPosition);
+    }
+  }
+  return bFound;
+}
+
+EbmlElement * KaxSegmentLoader::Load(const EbmlCallbacks & Callbacks)
+{
+  const std::uint32_t Id = EBML_INFO_ID(Callbacks).GetValue();
+  const auto Known = Loaded.find(Id);
+  if (Known != Loaded.end())
+    return Known->second;
+
+  std::uint64_t Position = GetPosition(Callbacks);
+  if (Position == 0 && Walk(Id, false))
+    Position = Entries.back().Position;
+  if (Position == 0)
+    return nullptr;
+
+  auto Element = ReadElementAt(Position, Callbacks);
+  if (Element == nullptr && Walk(Id, false)) // wrong SeekHead entry
+    Element = ReadElementAt(Entries.back().Position, Callbacks);
+  if (Element != nullptr)
+    Loaded[Id] = Element;
+  return Element;
+}
+
+} // namespace libmatroska
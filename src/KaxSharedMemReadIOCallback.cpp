@@ -0,0 +1,60 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "matroska/KaxSharedMemReadIOCallback.h"
+
+using namespace libebml;
+
+namespace libmatroska {
+
+KaxSharedMemReadIOCallback::KaxSharedMemReadIOCallback(std::shared_ptr<const binary> aData, std::size_t aSize, std::uint64_t aBaseOffset)
+  :Data(std::move(aData))
+  ,DataSize(Data ? aSize : 0)
+  ,BaseOffset(aBaseOffset)
+{
+}
+
+std::size_t KaxSharedMemReadIOCallback::read(void *Buffer, std::size_t Size)
+{
+  const std::size_t Available = std::min(Size, DataSize - Position);
+  if (Available) {
+    memcpy(Buffer, Data.get() + Position, Available);
+    Position += Available;
+  }
+  return Available;
+}
+
+void KaxSharedMemReadIOCallback::setFilePointer(std::int64_t Offset, seek_mode Mode)
+{
+  std::int64_t NewPosition;
+  switch (Mode) {
+    case seek_current:
+      NewPosition = static_cast<std::int64_t>(Position) + Offset;
+      break;
+    case seek_end:
+      NewPosition = static_cast<std::int64_t>(DataSize) + Offset;
+      break;
+    case seek_beginning:
+    default:
+      // absolute positions are file positions, like getFilePointer()
+      NewPosition = Offset - static_cast<std::int64_t>(BaseOffset);
+      break;
+  }
+
+  Position = static_cast<std::size_t>(std::clamp<std::int64_t>(NewPosition, 0, static_cast<std::int64_t>(DataSize)));
+}
+
+std::size_t KaxSharedMemReadIOCallback::write(const void * /* Buffer */, std::size_t /* Size */)
+{
+  throw std::runtime_error("KaxSharedMemReadIOCallback is read-only");
+}
+
+} // namespace libmatroska
@@ -0,0 +1,214 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "matroska/KaxStats.h"
+
+using namespace libebml;
+
+namespace libmatroska {
+
+namespace {
+
+/// the counters of one thread, only modified by that thread
+struct ThreadCounters {
+  std::array<std::atomic<std::uint64_t>, STATS_COUNTER_COUNT> Counters{};
+  std::mutex                                                  ElementsLock; ///< only contended during Collect()
+  std::unordered_map<std::uint32_t, std::uint64_t>            Elements;
+
+  ThreadCounters();
+  ~ThreadCounters();
+
+  void MergeInto(KaxStatsSnapshot & Snapshot);
+  void Clear();
+};
+
+struct Registry {
+  std::mutex                    Lock;
+  std::vector<ThreadCounters *> Threads;
+  KaxStatsSnapshot              Ended; ///< counted by the threads that ended
+};
+
+Registry & GetRegistry()
+{
+  // created before the first ThreadCounters so it's destroyed after the last one
+  static Registry Instance;
+  return Instance;
+}
+
+ThreadCounters::ThreadCounters()
+{
+  auto & Reg = GetRegistry();
+  const std::lock_guard<std::mutex> Lock(Reg.Lock);
+  Reg.Threads.push_back(this);
+}
+
+ThreadCounters::~ThreadCounters()
+{
+  auto & Reg = GetRegistry();
+  const std::lock_guard<std::mutex> Lock(Reg.Lock);
+  MergeInto(Reg.Ended);
+  Reg.Threads.erase(std::find(Reg.Threads.begin(), Reg.Threads.end(), this));
+}
+
+void ThreadCounters::MergeInto(KaxStatsSnapshot & Snapshot)
+{
+  for (std::size_t Index = 0; Index < Counters.size(); Index++)
+    Snapshot.Counters[Index] += Counters[Index].load(std::memory_order_relaxed);
+
+  const std::lock_guard<std::mutex> Lock(ElementsLock);
+  for (const auto & Element : Elements)
+    Snapshot.Elements[Element.first] += Element.second;
+}
+
+void ThreadCounters::Clear()
+{
+  for (auto & Counter : Counters)
+    Counter.store(0, std::memory_order_relaxed);
+
+  const std::lock_guard<std::mutex> Lock(ElementsLock);
+  Elements.clear();
+}
+
+ThreadCounters & Local()
+{
+  thread_local ThreadCounters Counters;
+  return Counters;
+}
+
+std::atomic<KaxStats::TraceCallback> TraceFunction{nullptr};
+std::atomic<void *>                  TraceOpaque{nullptr};
+
+constexpr const char * CounterNames[STATS_COUNTER_COUNT] = {
+  "IO reads",
+  "IO read bytes",
+  "IO writes",
+  "IO write bytes",
+  "ReadData copies",
+  "ReadData copied bytes",
+  "frames read",
+  "DataBuffer allocations",
+  "DataBuffer allocated bytes",
+  "Cluster renders",
+  "Cluster render ns",
+};
+
+} // namespace
+
+bool KaxStats::IsEnabled()
+{
+#if defined(MATROSKA_STATS)
+  return true;
+#else
+  return false;
+#endif
+}
+
+void KaxStats::Add(KaxStatsCounter Counter, std::uint64_t Value)
+{
+  // only this thread writes it, no need for an atomic increment
+  auto & Stored = Local().Counters[Counter];
+  Stored.store(Stored.load(std::memory_order_relaxed) + Value, std::memory_order_relaxed);
+}
+
+void KaxStats::AddElement(std::uint32_t Id)
+{
+  auto & Counters = Local();
+  const std::lock_guard<std::mutex> Lock(Counters.ElementsLock);
+  Counters.Elements[Id]++;
+}
+
+KaxStatsSnapshot KaxStats::Collect()
+{
+  auto & Reg = GetRegistry();
+  const std::lock_guard<std::mutex> Lock(Reg.Lock);
+  KaxStatsSnapshot Result = Reg.Ended;
+  for (auto Thread : Reg.Threads)
+    Thread->MergeInto(Result);
+  return Result;
+}
+
+void KaxStats::Reset()
+{
+  auto & Reg = GetRegistry();
+  const std::lock_guard<std::mutex> Lock(Reg.Lock);
+  Reg.Ended = KaxStatsSnapshot{};
+  for (auto Thread : Reg.Threads)
+    Thread->Clear();
+}
+
+const char * KaxStats::CounterName(KaxStatsCounter Counter)
+{
+  if (Counter >= STATS_COUNTER_COUNT)
+    return "unknown";
+  return CounterNames[Counter];
+}
+
+void KaxStats::SetTraceCallback(TraceCallback Callback, void * Opaque)
+{
+  TraceOpaque.store(Opaque, std::memory_order_relaxed);
+  TraceFunction.store(Callback, std::memory_order_release);
+}
+
+void KaxStats::TraceBegin(const char * Name)
+{
+  const auto Callback = TraceFunction.load(std::memory_order_acquire);
+  if (Callback)
+    Callback(TraceOpaque.load(std::memory_order_relaxed), Name, true);
+}
+
+void KaxStats::TraceEnd(const char * Name)
+{
+  const auto Callback = TraceFunction.load(std::memory_order_acquire);
+  if (Callback)
+    Callback(TraceOpaque.load(std::memory_order_relaxed), Name, false);
+}
+
+KaxStatsScope::KaxStatsScope(const char * aName, KaxStatsCounter aCounter)
+  :Name(aName)
+  ,Counter(aCounter)
+  ,Start(aCounter != STATS_COUNTER_COUNT ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{})
+{
+  KaxStats::TraceBegin(Name);
+}
+
+KaxStatsScope::~KaxStatsScope()
+{
+  KaxStats::TraceEnd(Name);
+  if (Counter != STATS_COUNTER_COUNT) {
+    const auto Elapsed = std::chrono::steady_clock::now() - Start;
+    KaxStats::Add(Counter, static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Elapsed).count()));
+  }
+}
+
+std::size_t KaxStatsIOCallback::read(void *Buffer, std::size_t Size)
+{
+  const std::size_t Read = Source.read(Buffer, Size);
+  KaxStats::Add(STATS_IO_READS, 1);
+  KaxStats::Add(STATS_IO_READ_BYTES, Read);
+  return Read;
+}
+
+void KaxStatsIOCallback::setFilePointer(std::int64_t Offset, seek_mode Mode)
+{
+  Source.setFilePointer(Offset, Mode);
+}
+
+std::size_t KaxStatsIOCallback::write(const void *Buffer, std::size_t Size)
+{
+  const std::size_t Written = Source.write(Buffer, Size);
+  KaxStats::Add(STATS_IO_WRITES, 1);
+  KaxStats::Add(STATS_IO_WRITE_BYTES, Written);
+  return Written;
+}
+
+} // namespace libmatroska
@@ -0,0 +1,117 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "matroska/KaxTrackEncoding.h"
+#include "matroska/KaxBlock.h"
+#include "matroska/KaxSemantic.h"
+#include "matroska/KaxTracks.h"
+
+using namespace libebml;
+
+namespace libmatroska {
+
+void KaxFrameView::CopyTo(binary * Buffer) const
+{
+  if (PrefixSize != 0)
+    memcpy(Buffer, Prefix, PrefixSize);
+  if (DataSize != 0)
+    memcpy(Buffer + PrefixSize, Data, DataSize);
+}
+
+KaxTrackEncoding::KaxTrackEncoding(const KaxTrackEntry & Track)
+{
+  const auto Encodings = FindChild<const KaxContentEncodings>(Track);
+  if (!Encodings)
+    return;
+
+  std::vector<std::pair<std::uint64_t, Step>> Ordered;
+  for (auto Encoding = FindChild<const KaxContentEncoding>(*Encodings); Encoding; Encoding = FindNextChild<const KaxContentEncoding>(*Encodings, *Encoding)) {
+    const auto Scope = FindChild<const KaxContentEncodingScope>(*Encoding);
+    if (Scope && (static_cast<std::uint64_t>(*Scope) & 1) == 0)
+      continue; // doesn't apply to the frames
+
+    const auto Order = FindChild<const KaxContentEncodingOrder>(*Encoding);
+    const auto Type  = FindChild<const KaxContentEncodingType>(*Encoding);
+
+    Step NewStep{Type && static_cast<std::uint64_t>(*Type) != 0, COMPRESSION_ZLIB, {}};
+    const auto Compression = FindChild<const KaxContentCompression>(*Encoding);
+    if (!NewStep.bEncrypted && Compression) {
+      const auto Algo = FindChild<const KaxContentCompAlgo>(*Compression);
+      if (Algo)
+        NewStep.Algo = static_cast<std::uint64_t>(*Algo);
+      const auto Settings = FindChild<const KaxContentCompSettings>(*Compression);
+      if (Settings && Settings->GetSize() != 0)
+        NewStep.Settings.assign(Settings->GetBuffer(), Settings->GetBuffer() + Settings->GetSize());
+    }
+    Ordered.emplace_back(Order ? static_cast<std::uint64_t>(*Order) : 0, std::move(NewStep));
+  }
+
+  // the encoding with the highest order was applied last, it's decoded first
+  std::stable_sort(Ordered.begin(), Ordered.end(), [](const auto & a, const auto & b) { return a.first > b.first; });
+  for (auto & Entry : Ordered)
+    Steps.push_back(std::move(Entry.second));
+}
+
+bool KaxTrackEncoding::IsSupported() const
+{
+  return std::none_of(Steps.begin(), Steps.end(), [this](const Step & s) {
+    return s.bEncrypted || (s.Algo != COMPRESSION_HEADER_STRIP && !myDecompressor);
+  });
+}
+
+bool KaxTrackEncoding::Decode(const DataBuffer & Frame, KaxFrameView & View)
+{
+  return Decode(Frame.Buffer(), Frame.Size(), View);
+}
+
+bool KaxTrackEncoding::Decode(const binary * Frame, std::size_t FrameSize, KaxFrameView & View)
+{
+  View = KaxFrameView{};
+  View.Data     = Frame;
+  View.DataSize = FrameSize;
+
+  unsigned int Next = 0;
+  for (const auto & s : Steps) {
+    if (s.bEncrypted)
+      return false;
+
+    if (View.PrefixSize != 0) {
+      // a stripped header followed by another encoding, the frame must be contiguous
+      auto & Flat = Buffers[Next];
+      Flat.resize(View.Size());
+      View.CopyTo(Flat.data());
+      View = KaxFrameView{};
+      View.Data     = Flat.data();
+      View.DataSize = Flat.size();
+      Next ^= 1;
+    }
+
+    if (s.Algo == COMPRESSION_HEADER_STRIP) {
+      View.Prefix     = s.Settings.data();
+      View.PrefixSize = s.Settings.size();
+      continue;
+    }
+
+    if (!myDecompressor)
+      return false;
+    auto & Output = Buffers[Next];
+    Output.clear();
+    if (!myDecompressor(s.Algo, View.Data, View.DataSize, Output))
+      return false;
+    View.Data     = Output.data();
+    View.DataSize = Output.size();
+    Next ^= 1;
+  }
+
+  return true;
+}
+
+} // namespace libmatroska
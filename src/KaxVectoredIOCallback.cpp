@@ -0,0 +1,28 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+#include "matroska/KaxVectoredIOCallback.h"
+
+using namespace libebml;
+
+namespace libmatroska {
+
+void WriteVectors(IOCallback & output, const KaxIOVector * Vectors, std::size_t Count)
+{
+  auto Vectored = dynamic_cast<KaxVectoredIOCallback *>(&output);
+  if (Vectored) {
+    Vectored->writeFullyV(Vectors, Count);
+    return;
+  }
+
+  for (std::size_t i = 0; i < Count; i++) {
+    if (Vectors[i].Size)
+      output.writeFully(Vectors[i].Buffer, Vectors[i].Size);
+  }
+}
+
+} // namespace libmatroska
@@ -0,0 +1,303 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \brief Throughput of the Block, Cluster, Cues and SeekHead hot paths on synthetic data
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+
+#include "matroska/KaxBlock.h"
+#include "matroska/KaxCluster.h"
+#include "matroska/KaxCues.h"
+#include "matroska/KaxCuesData.h"
+#include "matroska/KaxSeekHead.h"
+#include "matroska/KaxSegment.h"
+#include "matroska/KaxSemantic.h"
+#include "matroska/KaxTracks.h"
+
+#include <ebml/EbmlStream.h>
+#include <ebml/MemIOCallback.h>
+#include <ebml/MemReadIOCallback.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <new>
+#include <vector>
+
+using namespace libebml;
+using namespace libmatroska;
+
+// count all the allocations of the program, the library included
+static std::atomic<std::uint64_t> Allocations{0};
+
+void * operator new(std::size_t Size)
+{
+  Allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void * Memory = std::malloc(Size ? Size : 1))
+    return Memory;
+  throw std::bad_alloc();
+}
+
+void operator delete(void * Memory) noexcept
+{
+  std::free(Memory);
+}
+
+void operator delete(void * Memory, std::size_t) noexcept
+{
+  std::free(Memory);
+}
+
+namespace {
+
+constexpr std::uint64_t TimestampScale = 1000000;
+constexpr std::uint32_t FrameSize      = 1000;
+constexpr unsigned int  LacedFrames    = 8;
+
+double      MinTime = 0.5; ///< seconds spent on each benchmark
+const char *Filter  = nullptr;
+
+/// values used by the benchmarks, so the work is not optimized away
+volatile std::uint64_t Sink;
+
+/// deterministic pseudo random numbers
+struct Random {
+  std::uint64_t State{0x853c49e6748fea9bULL};
+  std::uint64_t Next() {
+    State = State * 6364136223846793005ULL + 1442695040888963407ULL;
+    return State >> 33;
+  }
+};
+
+/*!
+  \brief run \a Op until MinTime is spent and print its cost per call
+  \param BytesPerOp the amount of data processed by a call, 0 if not relevant
+*/
+template<typename Operation>
+void Run(const char * Name, std::uint64_t BytesPerOp, Operation && Op)
+{
+  if (Filter && !std::strstr(Name, Filter))
+    return;
+
+  Op(); // warm up
+
+  std::uint64_t Iterations = 1;
+  for (;;) {
+    const std::uint64_t AllocStart = Allocations.load(std::memory_order_relaxed);
+    const auto Start = std::chrono::steady_clock::now();
+    for (std::uint64_t i = 0; i < Iterations; i++)
+      Op();
+    const std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - Start;
+    const std::uint64_t Allocated = Allocations.load(std::memory_order_relaxed) - AllocStart;
+
+    if (Elapsed.count() >= MinTime || Iterations >= (std::uint64_t(1) << 32)) {
+      const double NsPerOp = Elapsed.count() * 1e9 / static_cast<double>(Iterations);
+      std::printf("%-36s %12" PRIu64 " %12.1f ns/op", Name, Iterations, NsPerOp);
+      if (BytesPerOp != 0)
+        std::printf(" %10.1f MB/s", static_cast<double>(BytesPerOp) * static_cast<double>(Iterations) / Elapsed.count() / 1e6);
+      else
+        std::printf(" %10s     ", "-");
+      std::printf(" %8.2f allocs/op\n", static_cast<double>(Allocated) / static_cast<double>(Iterations));
+      return;
+    }
+
+    // aim a bit above MinTime
+    const double Scale = Elapsed.count() > 0 ? MinTime / Elapsed.count() * 1.2 : 100.0;
+    Iterations = static_cast<std::uint64_t>(static_cast<double>(Iterations) * std::min(std::max(Scale, 2.0), 100.0));
+  }
+}
+
+/// a Segment with one track and a Cluster starting at 0
+struct Context {
+  KaxSegment      Segment;
+  KaxTracks       Tracks;
+  KaxTrackEntry & Track{GetChild<KaxTrackEntry>(Tracks)};
+  KaxCluster      Cluster;
+  std::vector<binary> Frames;
+
+  Context()
+    :Frames(LacedFrames * (FrameSize + LacedFrames))
+  {
+    GetChild<KaxTrackNumber>(Track).SetValue(1);
+    Track.SetGlobalTimestampScale(TimestampScale);
+    Track.EnableLacing(true);
+
+    Cluster.SetParent(Segment);
+    Cluster.InitTimestamp(0, TimestampScale);
+
+    Random Values;
+    for (auto & Byte : Frames)
+      Byte = static_cast<binary>(Values.Next());
+  }
+
+  /// size of the frame \a Index, all the same for fixed lacing
+  static std::uint32_t Size(unsigned int Index, LacingType Lacing) {
+    return Lacing == LACING_FIXED ? FrameSize : FrameSize + Index;
+  }
+
+  binary * Frame(unsigned int Index) { return Frames.data() + Index * (FrameSize + LacedFrames); }
+
+  /// fill \a Block with the frames, one if it's not laced
+  std::uint64_t Fill(KaxInternalBlock & Block, LacingType Lacing) {
+    Block.SetParent(Cluster);
+    std::uint64_t Payload = 0;
+    const unsigned int Count = Lacing == LACING_NONE ? 1 : LacedFrames;
+    for (unsigned int i = 0; i < Count; i++) {
+      Block.AddFrame(Track, 0, FrameBuffer(Frame(i), Size(i, Lacing)), Lacing);
+      Payload += Size(i, Lacing);
+    }
+    return Payload;
+  }
+};
+
+void BenchReadData(Context & Ctx, const char * Name, LacingType Lacing)
+{
+  // render the Block once
+  MemIOCallback Rendered;
+  std::uint64_t Payload;
+  {
+    KaxSimpleBlock Block;
+    Payload = Ctx.Fill(Block, Lacing);
+    Block.Render(Rendered);
+  }
+
+  MemReadIOCallback Input(Rendered.GetDataBuffer(), static_cast<std::size_t>(Rendered.GetDataBufferSize()));
+  EbmlStream Stream(Input);
+  int UpperLevel = 0;
+  std::unique_ptr<EbmlElement> Block(Stream.FindNextElement(EBML_CLASS_CONTEXT(KaxCluster), UpperLevel, UINT64_MAX, false));
+  const std::uint64_t DataStart = Input.getFilePointer();
+
+  Run(Name, Payload, [&] {
+    Input.setFilePointer(DataStart);
+    Block->ReadData(Input, SCOPE_ALL_DATA);
+    Sink = static_cast<KaxInternalBlock &>(*Block).NumberFrames();
+  });
+}
+
+void BenchRender(Context & Ctx)
+{
+  KaxSimpleBlock Block;
+  const std::uint64_t Payload = Ctx.Fill(Block, LACING_AUTO);
+  MemIOCallback Output(64 * 1024);
+
+  Run("SimpleBlock UpdateSize auto", Payload, [&] {
+    Sink = Block.UpdateSize();
+  });
+  Run("SimpleBlock Render auto", Payload, [&] {
+    Output.setFilePointer(0);
+    Sink = Block.Render(Output);
+  });
+}
+
+void BenchClusterRender(Context & Ctx)
+{
+  constexpr unsigned int BlockCount = 1000;
+  MemIOCallback Output(BlockCount * (FrameSize + 16));
+  KaxCues Cues;
+  Cues.SetGlobalTimestampScale(TimestampScale);
+
+  Run("Cluster Render 1000 blobs", std::uint64_t(BlockCount) * FrameSize, [&] {
+    auto Cluster = std::make_unique<KaxCluster>();
+    Cluster->SetParent(Ctx.Segment);
+    Cluster->InitTimestamp(0, TimestampScale);
+
+    std::vector<std::unique_ptr<KaxBlockBlob>> Blobs;
+    Blobs.reserve(BlockCount);
+    for (unsigned int i = 0; i < BlockCount; i++) {
+      auto Blob = std::make_unique<KaxBlockBlob>(BLOCK_BLOB_ALWAYS_SIMPLE);
+      Blob->SetParent(*Cluster);
+      Blob->AddFrameAuto(Ctx.Track, std::uint64_t(i) * TimestampScale, FrameBuffer(Ctx.Frame(0), FrameSize), LACING_NONE);
+      Cluster->AddBlockBlob(Blob.get());
+      Blobs.push_back(std::move(Blob));
+    }
+
+    Output.setFilePointer(0);
+    Sink = Cluster->Render(Output, Cues);
+
+    // the Blocks belong to the Blobs, not to the Cluster
+    for (auto Element : *Cluster) {
+      if (EbmlId(*Element) != EBML_ID(KaxSimpleBlock) && EbmlId(*Element) != EBML_ID(KaxBlockGroup))
+        delete Element;
+    }
+    Cluster->RemoveAll();
+  });
+}
+
+void BenchCues()
+{
+  constexpr unsigned int PointCount = 100000;
+  constexpr unsigned int Tracks     = 2;
+  KaxCues Cues;
+  Cues.SetGlobalTimestampScale(TimestampScale);
+  for (unsigned int i = 0; i < PointCount; i++) {
+    auto & Point = AddNewChild<KaxCuePoint>(Cues);
+    GetChild<KaxCueTime>(Point).SetValue(std::uint64_t(i) * 500);
+    auto & Positions = GetChild<KaxCueTrackPositions>(Point);
+    GetChild<KaxCueTrack>(Positions).SetValue(1 + i % Tracks);
+    GetChild<KaxCueClusterPosition>(Positions).SetValue(std::uint64_t(i) * 100000);
+  }
+  Cues.BuildIndex();
+
+  const std::uint64_t Duration = std::uint64_t(PointCount) * 500 * TimestampScale;
+  Random Values;
+  Run("Cues GetTimestampPoint 100k", 0, [&] {
+    Sink = reinterpret_cast<std::uintptr_t>(Cues.GetTimestampPoint((Values.Next() << 20) % Duration));
+  });
+  Run("Cues GetTimestampPoint track 100k", 0, [&] {
+    Sink = reinterpret_cast<std::uintptr_t>(Cues.GetTimestampPoint((Values.Next() << 20) % Duration, 2));
+  });
+}
+
+void BenchSeekHead()
+{
+  constexpr unsigned int SeekCount = 256;
+  KaxSeekHead SeekHead;
+  for (unsigned int i = 0; i < SeekCount - 1; i++)
+    SeekHead.IndexThis(EBML_ID(KaxCluster), std::uint64_t(i) * 1000000);
+  SeekHead.IndexThis(EBML_ID(KaxCues), std::uint64_t(SeekCount) * 1000000);
+
+  Run("SeekHead FindFirstOf 256", 0, [&] {
+    Sink = reinterpret_cast<std::uintptr_t>(SeekHead.FindFirstOf(EBML_INFO(KaxCues)));
+  });
+}
+
+} // namespace
+
+/*!
+  \brief run all the benchmarks, or the ones containing the first argument
+  \note -t <seconds> sets the time spent on each benchmark
+*/
+int main(int argc, char **argv)
+{
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "-t") && i + 1 < argc)
+      MinTime = std::atof(argv[++i]);
+    else
+      Filter = argv[i];
+  }
+
+  try {
+    Context Ctx;
+
+    BenchReadData(Ctx, "SimpleBlock ReadData no lacing", LACING_NONE);
+    BenchReadData(Ctx, "SimpleBlock ReadData Xiph", LACING_XIPH);
+    BenchReadData(Ctx, "SimpleBlock ReadData EBML", LACING_EBML);
+    BenchReadData(Ctx, "SimpleBlock ReadData fixed", LACING_FIXED);
+    BenchRender(Ctx);
+    BenchClusterRender(Ctx);
+    BenchCues();
+    BenchSeekHead();
+  } catch (const std::exception & Error) {
+    std::fprintf(stderr, "benchmark failed: %s\n", Error.what());
+    return 1;
+  }
+  return 0;
+}
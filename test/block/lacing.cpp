@@ -0,0 +1,322 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \brief Decoding of the lace sizes of Blocks, valid and corrupted
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+
+#include "matroska/KaxBlock.h"
+#include "matroska/KaxCluster.h"
+#include "matroska/KaxSharedMemReadIOCallback.h"
+#include "matroska/KaxStats.h"
+
+#include <ebml/EbmlStream.h>
+#include <ebml/MemReadIOCallback.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace libebml;
+using namespace libmatroska;
+
+namespace {
+
+int Failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      std::fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, CurrentTest, #cond); \
+      Failures++; \
+    } \
+  } while (0)
+
+const char * CurrentTest = "";
+
+enum ReadMode {
+  READ_COPY,    ///< SCOPE_ALL_DATA from a MemReadIOCallback, the Block data is copied
+  READ_SHARED,  ///< SCOPE_ALL_DATA from a KaxSharedMemReadIOCallback, no copy
+  READ_PARTIAL, ///< SCOPE_PARTIAL_DATA then LoadFrame()
+};
+
+const char * const ModeNames[] = { "copy", "shared", "partial" };
+
+/// EBML coded value of \a Length octets, the length marker added
+void PutVINT(std::vector<binary> & Out, std::uint64_t Value, unsigned int Length)
+{
+  for (unsigned int i = 0; i < Length; i++) {
+    auto Byte = static_cast<binary>(Value >> (8 * (Length - 1 - i)));
+    if (i == 0)
+      Byte |= static_cast<binary>(0x80 >> (Length - 1));
+    Out.push_back(Byte);
+  }
+}
+
+/// EBML coded value on the shortest length
+void PutVINT(std::vector<binary> & Out, std::uint64_t Value)
+{
+  unsigned int Length = 1;
+  while (Length < 8 && Value >= (std::uint64_t(1) << (7 * Length)) - 1)
+    Length++;
+  PutVINT(Out, Value, Length);
+}
+
+/// signed EBML lace delta on the shortest length
+void PutSignedVINT(std::vector<binary> & Out, std::int64_t Value)
+{
+  unsigned int Length = 1;
+  while (Length < 8) {
+    const std::int64_t Bias = (std::int64_t(1) << (7 * Length - 1)) - 1;
+    if (Value >= -Bias && Value <= Bias)
+      break;
+    Length++;
+  }
+  const std::int64_t Bias = (std::int64_t(1) << (7 * Length - 1)) - 1;
+  PutVINT(Out, static_cast<std::uint64_t>(Value + Bias), Length);
+}
+
+std::vector<binary> XiphHead(const std::vector<std::uint32_t> & Sizes)
+{
+  std::vector<binary> Head{static_cast<binary>(Sizes.size() - 1)};
+  for (std::size_t i = 0; i + 1 < Sizes.size(); i++) {
+    Head.insert(Head.end(), Sizes[i] / 0xFF, 0xFF);
+    Head.push_back(static_cast<binary>(Sizes[i] % 0xFF));
+  }
+  return Head;
+}
+
+std::vector<binary> EbmlHead(const std::vector<std::int64_t> & Sizes)
+{
+  std::vector<binary> Head{static_cast<binary>(Sizes.size() - 1)};
+  PutVINT(Head, static_cast<std::uint64_t>(Sizes[0]));
+  for (std::size_t i = 1; i + 1 < Sizes.size(); i++)
+    PutSignedVINT(Head, Sizes[i] - Sizes[i - 1]);
+  return Head;
+}
+
+/*!
+  \brief a SimpleBlock element of track 1 with \a PayloadSize octets of frames after \a LaceHead
+  \note the octet \a k of the frames is \a k modulo 256
+*/
+std::vector<binary> MakeSimpleBlock(LacingType Lacing, const std::vector<binary> & LaceHead, std::size_t PayloadSize)
+{
+  std::vector<binary> Data{0x81, 0x00, 0x00, static_cast<binary>(0x80 | (Lacing << 1))};
+  Data.insert(Data.end(), LaceHead.begin(), LaceHead.end());
+  for (std::size_t k = 0; k < PayloadSize; k++)
+    Data.push_back(static_cast<binary>(k));
+
+  std::vector<binary> Element{0xA3};
+  PutVINT(Element, Data.size());
+  Element.insert(Element.end(), Data.begin(), Data.end());
+  return Element;
+}
+
+/*!
+  \brief read \a Element and check its frames have the sizes \a Expected
+  \param Expected the frame sizes, empty when the Block is expected to be rejected
+*/
+void CheckRead(const std::vector<binary> & Element, ReadMode Mode, const std::vector<std::uint32_t> & Expected)
+{
+  std::unique_ptr<IOCallback> Input;
+  if (Mode == READ_SHARED) {
+    std::shared_ptr<binary> Copy(new binary[Element.size()], std::default_delete<binary[]>());
+    memcpy(Copy.get(), Element.data(), Element.size());
+    Input.reset(new KaxSharedMemReadIOCallback(Copy, Element.size()));
+  } else
+    Input.reset(new MemReadIOCallback(Element.data(), Element.size()));
+
+  EbmlStream Stream(*Input);
+  int UpperLevel = 0;
+  std::unique_ptr<EbmlElement> Found(Stream.FindNextElement(EBML_CLASS_CONTEXT(KaxCluster), UpperLevel, UINT64_MAX, false));
+  CHECK(Found != nullptr && EbmlId(*Found) == EBML_ID(KaxSimpleBlock));
+  if (Found == nullptr || EbmlId(*Found) != EBML_ID(KaxSimpleBlock))
+    return;
+
+  auto & Block = static_cast<KaxInternalBlock &>(*Found);
+  const std::uint64_t DataStart = Input->getFilePointer();
+  const auto Read = Block.ReadData(*Input, Mode == READ_PARTIAL ? SCOPE_PARTIAL_DATA : SCOPE_ALL_DATA);
+
+  if (Expected.empty()) {
+    CHECK(Read == 0);
+    CHECK(Block.NumberFrames() == 0);
+    CHECK(!Block.IsRawPassthrough());
+    return;
+  }
+
+  CHECK(Read == Block.GetSize());
+  CHECK(Block.NumberFrames() == Expected.size());
+  CHECK(Block.TrackNum() == 1);
+  CHECK(Block.IsRawPassthrough() == (Mode != READ_PARTIAL));
+  if (Block.NumberFrames() != Expected.size())
+    return;
+
+  // the frames end with the Block
+  std::uint64_t FrameStart = DataStart + Block.GetSize();
+  for (auto Size : Expected)
+    FrameStart -= Size;
+
+  std::size_t PayloadOffset = 0;
+  for (unsigned int i = 0; i < Expected.size(); i++) {
+    CHECK(Block.GetFrameSize(i) == Expected[i]);
+    CHECK(Block.GetDataPosition(i) == static_cast<std::int64_t>(FrameStart + PayloadOffset));
+
+    if (Mode == READ_PARTIAL) {
+      CHECK(!Block.IsFrameLoaded(i));
+      Block.LoadFrame(*Input, i);
+    }
+    CHECK(Block.IsFrameLoaded(i));
+
+    std::uint32_t Size = 0;
+    const binary * Data = Block.GetFrameData(i, Size);
+    CHECK(Data != nullptr && Size == Expected[i]);
+    if (Data != nullptr && Size == Expected[i]) {
+      bool bSame = true;
+      for (std::uint32_t k = 0; k < Size; k++)
+        bSame = bSame && Data[k] == static_cast<binary>(PayloadOffset + k);
+      CHECK(bSame);
+    }
+
+    auto & Buffer = Block.GetBuffer(i);
+    CHECK(Buffer.Size() == Expected[i] && Buffer.Buffer() == Data);
+    PayloadOffset += Expected[i];
+  }
+}
+
+void CheckAllModes(const char * Name, const std::vector<binary> & Element, const std::vector<std::uint32_t> & Expected)
+{
+  for (auto Mode : {READ_COPY, READ_SHARED, READ_PARTIAL}) {
+    char Test[128];
+    std::snprintf(Test, sizeof(Test), "%s (%s)", Name, ModeNames[Mode]);
+    CurrentTest = Test;
+    CheckRead(Element, Mode, Expected);
+  }
+}
+
+std::uint32_t Sum(const std::vector<std::uint32_t> & Sizes)
+{
+  std::uint32_t Total = 0;
+  for (auto Size : Sizes)
+    Total += Size;
+  return Total;
+}
+
+void TestNoLacing()
+{
+  CheckAllModes("no lacing", MakeSimpleBlock(LACING_NONE, {}, 500), {500});
+  CheckAllModes("no lacing, empty frame", MakeSimpleBlock(LACING_NONE, {}, 0), {0});
+}
+
+void TestXiph()
+{
+  const std::vector<std::uint32_t> Sizes{100, 300, 600};
+  CheckAllModes("Xiph", MakeSimpleBlock(LACING_XIPH, XiphHead(Sizes), Sum(Sizes)), Sizes);
+
+  // runs of 0xFF longer than 8 octets
+  const std::vector<std::uint32_t> Large{3000, 10, 5};
+  CheckAllModes("Xiph long runs", MakeSimpleBlock(LACING_XIPH, XiphHead(Large), Sum(Large)), Large);
+
+  // lace head longer than the first partial read
+  const std::vector<std::uint32_t> Huge{80000, 10};
+  CheckAllModes("Xiph lace head over 256 octets", MakeSimpleBlock(LACING_XIPH, XiphHead(Huge), Sum(Huge)), Huge);
+
+  const std::vector<std::uint32_t> Empty{0, 0, 7};
+  CheckAllModes("Xiph empty frames", MakeSimpleBlock(LACING_XIPH, XiphHead(Empty), Sum(Empty)), Empty);
+
+  // the Block ends in the middle of the lace sizes
+  CheckAllModes("Xiph truncated lace head", MakeSimpleBlock(LACING_XIPH, {2, 0xFF, 0xFF}, 0), {});
+  CheckAllModes("Xiph no lace sizes", MakeSimpleBlock(LACING_XIPH, {3}, 0), {});
+
+  // the sizes are bigger than the Block
+  CheckAllModes("Xiph oversized", MakeSimpleBlock(LACING_XIPH, XiphHead({300, 300, 1}), 100), {});
+  CheckAllModes("Xiph oversized long run", MakeSimpleBlock(LACING_XIPH, XiphHead({80000, 1}), 1000), {});
+}
+
+void TestEbml()
+{
+  const std::vector<std::uint32_t> Sizes{100, 300, 50, 800};
+  CheckAllModes("EBML", MakeSimpleBlock(LACING_EBML, EbmlHead({100, 300, 50, 800}), Sum(Sizes)), Sizes);
+
+  const std::vector<std::uint32_t> Large{20000, 3, 70000};
+  CheckAllModes("EBML large sizes", MakeSimpleBlock(LACING_EBML, EbmlHead({20000, 3, 70000}), Sum(Large)), Large);
+
+  // a 2 octets size cut after its first octet
+  CheckAllModes("EBML truncated lace head", MakeSimpleBlock(LACING_EBML, {2, 0x40}, 0), {});
+  CheckAllModes("EBML invalid size", MakeSimpleBlock(LACING_EBML, {1, 0x00}, 10), {});
+
+  CheckAllModes("EBML oversized", MakeSimpleBlock(LACING_EBML, EbmlHead({1000, 1}), 100), {});
+  CheckAllModes("EBML oversized delta", MakeSimpleBlock(LACING_EBML, EbmlHead({10, 5000, 1}), 100), {});
+  // the delta gives a negative size
+  CheckAllModes("EBML negative size", MakeSimpleBlock(LACING_EBML, EbmlHead({100, -200, 1}), 300), {});
+}
+
+void TestFixed()
+{
+  CheckAllModes("fixed", MakeSimpleBlock(LACING_FIXED, {2}, 600), {200, 200, 200});
+  CheckAllModes("fixed single frame", MakeSimpleBlock(LACING_FIXED, {0}, 50), {50});
+
+  // the payload can't be split in frames of the same size
+  CheckAllModes("fixed uneven", MakeSimpleBlock(LACING_FIXED, {2}, 100), {});
+  CheckAllModes("fixed no frame count", MakeSimpleBlock(LACING_FIXED, {}, 0), {});
+}
+
+/// \return the octets read by a SCOPE_PARTIAL_DATA read of \a Element
+std::uint64_t PartialReadBytes(const std::vector<binary> & Element, bool & bRead)
+{
+  MemReadIOCallback Memory(Element.data(), Element.size());
+  KaxStatsIOCallback Input(Memory);
+  EbmlStream Stream(Input);
+  int UpperLevel = 0;
+  std::unique_ptr<EbmlElement> Found(Stream.FindNextElement(EBML_CLASS_CONTEXT(KaxCluster), UpperLevel, UINT64_MAX, false));
+  bRead = false;
+  CHECK(Found != nullptr && EbmlId(*Found) == EBML_ID(KaxSimpleBlock));
+  if (Found == nullptr || EbmlId(*Found) != EBML_ID(KaxSimpleBlock))
+    return 0;
+
+  const auto Before = KaxStats::Collect()[STATS_IO_READ_BYTES];
+  bRead = Found->ReadData(Input, SCOPE_PARTIAL_DATA) != 0;
+  return KaxStats::Collect()[STATS_IO_READ_BYTES] - Before;
+}
+
+void TestPartialCorruption()
+{
+  CurrentTest = "partial read of invalid lace sizes";
+  bool bRead;
+
+  // invalid data found in the first read fail without reading the rest of the Block
+  CHECK(PartialReadBytes(MakeSimpleBlock(LACING_EBML, {1, 0x00}, 100000), bRead) <= 256);
+  CHECK(!bRead);
+  CHECK(PartialReadBytes(MakeSimpleBlock(LACING_EBML, EbmlHead({200000, 1}), 100000), bRead) <= 256);
+  CHECK(!bRead);
+
+  // a run of 0xFF longer than the Block
+  std::vector<binary> Run{1};
+  Run.insert(Run.end(), 2000, 0xFF);
+  CHECK(PartialReadBytes(MakeSimpleBlock(LACING_XIPH, Run, 100), bRead) <= 256);
+  CHECK(!bRead);
+
+  // a valid lace head longer than the first read is read again
+  CHECK(PartialReadBytes(MakeSimpleBlock(LACING_XIPH, XiphHead({80000, 10}), 80010), bRead) > 256);
+  CHECK(bRead);
+}
+
+} // namespace
+
+int main()
+{
+  TestNoLacing();
+  TestXiph();
+  TestEbml();
+  TestFixed();
+  TestPartialCorruption();
+
+  if (Failures) {
+    std::fprintf(stderr, "%d checks failed\n", Failures);
+    return 1;
+  }
+  std::printf("all lacing checks passed\n");
+  return 0;
+}
@@ -0,0 +1,154 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \brief Blocks read and rendered as they were read in another Cluster
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+
+#include "matroska/KaxBlock.h"
+#include "matroska/KaxCluster.h"
+#include "matroska/KaxSharedMemReadIOCallback.h"
+
+#include <ebml/EbmlStream.h>
+#include <ebml/MemIOCallback.h>
+#include <ebml/MemReadIOCallback.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace libebml;
+using namespace libmatroska;
+
+namespace {
+
+int Failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      std::fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, CurrentTest, #cond); \
+      Failures++; \
+    } \
+  } while (0)
+
+const char * CurrentTest = "";
+
+constexpr std::uint64_t TimestampScale = 1000000;
+
+/*!
+  \brief a SimpleBlock element of track 1 at the local timestamp 5, keyframe, with 3 Xiph laced frames
+  \note the octet \a k of the frames is \a k modulo 256
+*/
+std::vector<binary> MakeSimpleBlock()
+{
+  std::vector<binary> Data{0x81, 0x00, 0x05, 0x80 | (LACING_XIPH << 1), 2, 100, 0xFF, 45};
+  for (std::size_t k = 0; k < 100 + 300 + 50; k++)
+    Data.push_back(static_cast<binary>(k));
+
+  std::vector<binary> Element{0xA3, static_cast<binary>(0x40 | (Data.size() >> 8)), static_cast<binary>(Data.size())};
+  Element.insert(Element.end(), Data.begin(), Data.end());
+  return Element;
+}
+
+/*!
+  \brief read the SimpleBlock in \a Element as a child of \a Cluster
+  \param bParentFirst set the Cluster before reading the Block, otherwise after
+  \param bShared read from a KaxSharedMemReadIOCallback, otherwise the data are copied
+*/
+std::unique_ptr<KaxSimpleBlock> ReadBlock(const std::vector<binary> & Element, KaxCluster & Cluster, bool bParentFirst, bool bShared)
+{
+  std::unique_ptr<IOCallback> Input;
+  if (bShared) {
+    std::shared_ptr<binary> Copy(new binary[Element.size()], std::default_delete<binary[]>());
+    memcpy(Copy.get(), Element.data(), Element.size());
+    Input.reset(new KaxSharedMemReadIOCallback(Copy, Element.size()));
+  } else
+    Input.reset(new MemReadIOCallback(Element.data(), Element.size()));
+
+  EbmlStream Stream(*Input);
+  int UpperLevel = 0;
+  std::unique_ptr<EbmlElement> Found(Stream.FindNextElement(EBML_CLASS_CONTEXT(KaxCluster), UpperLevel, UINT64_MAX, false));
+  CHECK(Found != nullptr && EbmlId(*Found) == EBML_ID(KaxSimpleBlock));
+  if (Found == nullptr || EbmlId(*Found) != EBML_ID(KaxSimpleBlock))
+    return nullptr;
+
+  std::unique_ptr<KaxSimpleBlock> Block(static_cast<KaxSimpleBlock *>(Found.release()));
+  if (bParentFirst)
+    Block->SetParent(Cluster);
+  CHECK(Block->ReadData(*Input, SCOPE_ALL_DATA) == Block->GetSize());
+  if (!bParentFirst)
+    Block->SetParent(Cluster);
+  return Block;
+}
+
+void CheckRemux(const char * Name, bool bParentFirst, bool bShared)
+{
+  CurrentTest = Name;
+  const auto Element = MakeSimpleBlock();
+
+  KaxCluster Input;
+  Input.InitTimestamp(1000, TimestampScale);
+  auto Block = ReadBlock(Element, Input, bParentFirst, bShared);
+  if (!Block)
+    return;
+
+  CHECK(Block->IsRawPassthrough());
+  CHECK(Block->IsKeyframe());
+  CHECK(Block->NumberFrames() == 3);
+  CHECK(Block->GlobalTimestamp() == 1005 * TimestampScale);
+
+  // moved to a Cluster starting 2 ticks later, on another track
+  KaxCluster Output;
+  Output.InitTimestamp(1002, TimestampScale);
+  Block->SetParent(Output);
+  Block->SetTrackNum(2);
+  CHECK(Block->GlobalTimestamp() == 1005 * TimestampScale);
+
+  MemIOCallback Written;
+  Block->Render(Written);
+  CHECK(Block->IsRawPassthrough());
+
+  // only the track number and the local timestamp changed
+  auto Expected = Element;
+  Expected[3] = 0x82;
+  Expected[5] = 0x03;
+  CHECK(Written.GetDataBufferSize() == Expected.size());
+  CHECK(Written.GetDataBufferSize() == Expected.size() &&
+        memcmp(Written.GetDataBuffer(), Expected.data(), Expected.size()) == 0);
+
+  // and it reads back in the new Cluster
+  auto ReadBack = ReadBlock(std::vector<binary>(Written.GetDataBuffer(), Written.GetDataBuffer() + Written.GetDataBufferSize()),
+                            Output, bParentFirst, bShared);
+  if (!ReadBack)
+    return;
+  CHECK(ReadBack->TrackNum() == 2);
+  CHECK(ReadBack->GlobalTimestamp() == 1005 * TimestampScale);
+  CHECK(ReadBack->NumberFrames() == 3);
+  for (unsigned int i = 0; i < 3 && i < ReadBack->NumberFrames(); i++) {
+    std::uint32_t ReadSize = 0, Size = 0;
+    const binary * ReadData = ReadBack->GetFrameData(i, ReadSize);
+    const binary * Data = Block->GetFrameData(i, Size);
+    CHECK(ReadData != nullptr && Data != nullptr && ReadSize == Size && memcmp(ReadData, Data, Size) == 0);
+  }
+}
+
+} // namespace
+
+int main()
+{
+  CheckRemux("copied, parent set after the read", false, false);
+  CheckRemux("copied, parent set before the read", true, false);
+  CheckRemux("shared, parent set after the read", false, true);
+  CheckRemux("shared, parent set before the read", true, true);
+
+  if (Failures) {
+    std::fprintf(stderr, "%d checks failed\n", Failures);
+    return 1;
+  }
+  std::printf("all passthrough checks passed\n");
+  return 0;
+}
@@ -17,6 +17,7 @@
 #include <ebml/StdIOCallback.h>
 
 #include <matroska/KaxSegment.h>
+#include <matroska/KaxStats.h>
 
 #include <cinttypes>
 #include <cstdio>
@@ -31,6 +32,7 @@ using namespace libebml;
 #endif // win32
 
 static int ShowPos = 0;
+static int ShowStats = 0;
 
 #if 0 // TODO allowing find top level elements using an EbmlSemanticContextMaster
 DEFINE_START_SEMANTIC(KaxStream)
@@ -273,32 +275,62 @@ static void OutputTree(EbmlStream *Input)
     }
 }
 
+static void OutputStats()
+{
+    const auto Stats = libmatroska::KaxStats::Collect();
+    fprintf(stdout,"\r\nStatistics:\r\n");
+    if (!libmatroska::KaxStats::IsEnabled())
+        fprintf(stdout,"  (libmatroska built without ENABLE_STATS, only the I/O is counted)\r\n");
+    for (int Counter = 0; Counter < libmatroska::STATS_COUNTER_COUNT; ++Counter)
+    {
+        const auto Value = Stats[static_cast<libmatroska::KaxStatsCounter>(Counter)];
+        if (Value != 0)
+            fprintf(stdout,"  %-28s %" PRIu64 "\r\n",libmatroska::KaxStats::CounterName(static_cast<libmatroska::KaxStatsCounter>(Counter)),Value);
+    }
+    for (const auto & Element : Stats.Elements)
+        fprintf(stdout,"  element [%X] %" PRIu64 "\r\n",Element.first,Element.second);
+}
+
 int main(int argc, const char *argv[])
 {
     EbmlStream *Input;
 
-    if ((argc!=2 && argc!=3) || (argc==3 && strcmp(argv[1],"--pos")))
+    int Arg;
+    for (Arg=1; Arg<argc-1; ++Arg)
     {
-        fprintf(stderr, "Usage: mkvtree --pos [matroska_file]\r\n");
+        if (!strcmp(argv[Arg],"--pos"))
+            ShowPos = 1;
+        else if (!strcmp(argv[Arg],"--stats"))
+            ShowStats = 1;
+        else
+            break;
+    }
+
+    if (argc<2 || Arg!=argc-1)
+    {
+        fprintf(stderr, "Usage: mkvtree [--pos] [--stats] [matroska_file]\r\n");
 		fprintf(stderr, "Options:\r\n");
 		fprintf(stderr, "  --pos     output the position of elements\r\n");
+		fprintf(stderr, "  --stats   output the I/O and parsing statistics\r\n");
         return 1;
     }
 
-    if (argc==3)
-        ShowPos = 1;
-
     // open the file to parse
-    Input = new EbmlStream(*(new StdIOCallback(argv[argc-1], MODE_READ)));
+    auto File = new StdIOCallback(argv[argc-1], MODE_READ);
+    auto Counted = ShowStats ? new libmatroska::KaxStatsIOCallback(*File) : nullptr;
+    Input = new EbmlStream(Counted ? *static_cast<IOCallback *>(Counted) : *File);
     if (Input == NULL)
-        fprintf(stderr, "error: mkvtree cannot open file \"%s\"\r\n",argv[1]);
+        fprintf(stderr, "error: mkvtree cannot open file \"%s\"\r\n",argv[argc-1]);
     else
     {
         OutputEbmlhead(Input);
         OutputTree(Input);
+        if (ShowStats)
+            OutputStats();
 
         Input->I_O().close();
-        delete &(Input->I_O());
+        delete Counted;
+        delete File;
         delete Input;
     }
 
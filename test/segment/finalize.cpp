@@ -0,0 +1,243 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \brief Segments written with KaxSegmentFinalizer, read back
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+
+#include "matroska/KaxCluster.h"
+#include "matroska/KaxClusterWriter.h"
+#include "matroska/KaxCues.h"
+#include "matroska/KaxSeekHead.h"
+#include "matroska/KaxSegment.h"
+#include "matroska/KaxSegmentFinalizer.h"
+#include "matroska/KaxSegmentLoader.h"
+#include "matroska/KaxSemantic.h"
+
+#include <ebml/EbmlStream.h>
+#include <ebml/EbmlVoid.h>
+#include <ebml/MemIOCallback.h>
+#include <ebml/MemReadIOCallback.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace libebml;
+using namespace libmatroska;
+
+namespace {
+
+int Failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      std::fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, CurrentTest, #cond); \
+      Failures++; \
+    } \
+  } while (0)
+
+const char * CurrentTest = "";
+
+constexpr std::uint64_t TimestampScale = 1000000;
+constexpr unsigned int  FrameCount     = 100;
+constexpr unsigned int  KeyframeRate   = 25; ///< one keyframe and one Cluster per second
+
+/// what was written in the file, positions in the file
+struct SegmentLayout {
+  std::uint64_t              SeekHeadPosition{0};
+  std::uint64_t              CuesPosition{0};
+  std::uint64_t              InfoPosition{0};
+  std::vector<std::uint64_t> Clusters;
+  bool                       bInPlace{false};
+};
+
+/*!
+  \brief write a Segment of one video track starting at the beginning of \a File
+  \param aCuesSize,aSeekHeadSize the room reserved with KaxSegmentFinalizer::Start()
+*/
+SegmentLayout WriteSegment(MemIOCallback & File, std::uint64_t aCuesSize, std::uint64_t aSeekHeadSize)
+{
+  SegmentLayout Layout;
+  KaxSegment Segment;
+  KaxCues Cues;
+  KaxSegmentFinalizer Finalizer(File, Segment, Cues);
+  Finalizer.Start(aCuesSize, aSeekHeadSize);
+  Layout.SeekHeadPosition = Segment.GetDataStart();
+  Layout.CuesPosition     = Segment.GetDataStart() + aSeekHeadSize;
+
+  KaxInfo Info;
+  GetChild<KaxTimestampScale>(Info).SetValue(TimestampScale);
+  GetChild<KaxMuxingApp>(Info).SetValue(UTFstring{L"finalize test"});
+  GetChild<KaxWritingApp>(Info).SetValue(UTFstring{L"finalize test"});
+  Layout.InfoPosition = File.getFilePointer();
+  Info.Render(File);
+  Finalizer.Index(Info);
+
+  KaxTracks Tracks;
+  auto & Track = GetChild<KaxTrackEntry>(Tracks);
+  Track.SetGlobalTimestampScale(TimestampScale);
+  GetChild<KaxTrackNumber>(Track).SetValue(1);
+  GetChild<KaxTrackUID>(Track).SetValue(1);
+  GetChild<KaxTrackType>(Track).SetValue(track_video);
+  GetChild<KaxCodecID>(Track).SetValue("V_TEST");
+  Tracks.Render(File);
+  Finalizer.Index(Tracks);
+
+  {
+    KaxClusterWriter Writer(File, Segment, Cues, TimestampScale);
+    Writer.SetMaxClusterDuration(999000000);
+    Writer.SetClusterCallback([&Layout](const KaxCluster &, std::uint64_t Position, std::uint64_t) {
+      Layout.Clusters.push_back(Position);
+    });
+    for (unsigned int i = 0; i < FrameCount; i++) {
+      auto Data = std::make_unique<binary[]>(100);
+      std::memset(Data.get(), static_cast<int>(i), 100);
+      Writer.AddFrame(Track, i * 40000000ULL, FrameBuffer(std::move(Data), 100), i % KeyframeRate == 0);
+    }
+    Writer.Flush();
+  }
+
+  Layout.bInPlace = Finalizer.Finish();
+  CHECK(File.getFilePointer() == File.GetDataBufferSize());
+  return Layout;
+}
+
+/*!
+  \brief the IDs and positions of the top level elements of \a Segment
+  \return false if the elements don't cover the whole Segment
+*/
+bool ReadTopLevel(EbmlStream & Stream, KaxSegment & Segment, std::vector<KaxSegmentLoader::Entry> & Elements)
+{
+  std::uint64_t Position = Segment.GetDataStart();
+  while (Position < Segment.GetEndPosition()) {
+    Stream.I_O().setFilePointer(Position);
+    int UpperLevel = 0;
+    std::unique_ptr<EbmlElement> Element(Stream.FindNextElement(EBML_CONTEXT(&Segment), UpperLevel, Segment.GetEndPosition() - Position, true));
+    if (Element == nullptr || UpperLevel != 0 || Element->GetElementPosition() != Position || !Element->IsFiniteSize())
+      return false;
+    Elements.push_back({EbmlId(*Element).GetValue(), Position});
+    Position = Element->GetEndPosition();
+  }
+  return Position == Segment.GetEndPosition();
+}
+
+std::uint32_t IdAt(const std::vector<KaxSegmentLoader::Entry> & Elements, std::uint64_t Position)
+{
+  const auto Found = std::find_if(Elements.begin(), Elements.end(),
+                                  [Position](const KaxSegmentLoader::Entry & e) { return e.Position == Position; });
+  return Found == Elements.end() ? 0 : Found->Id;
+}
+
+/*!
+  \brief read back the Segment written in \a File and check it matches \a Layout
+  \param aCuesAt position where the Cues are expected
+*/
+void CheckSegment(const MemIOCallback & File, const SegmentLayout & Layout, std::uint64_t aCuesAt)
+{
+  MemReadIOCallback Input(File.GetDataBuffer(), File.GetDataBufferSize());
+  EbmlStream Stream(Input);
+  std::unique_ptr<EbmlElement> Found(Stream.FindNextID(EBML_INFO(KaxSegment), UINT64_MAX));
+  CHECK(Found != nullptr && Found->GetElementPosition() == 0);
+  if (Found == nullptr)
+    return;
+
+  auto & Segment = static_cast<KaxSegment &>(*Found);
+  CHECK(Segment.IsFiniteSize());
+  CHECK(Segment.GetEndPosition() == File.GetDataBufferSize());
+
+  // the reserved room is still covered by elements, nothing else moved
+  std::vector<KaxSegmentLoader::Entry> Elements;
+  CHECK(ReadTopLevel(Stream, Segment, Elements));
+  CHECK(IdAt(Elements, Layout.SeekHeadPosition) == EBML_ID(KaxSeekHead).GetValue());
+  CHECK(IdAt(Elements, Layout.InfoPosition) == EBML_ID(KaxInfo).GetValue());
+  CHECK(IdAt(Elements, aCuesAt) == EBML_ID(KaxCues).GetValue());
+  CHECK(Layout.Clusters.size() == FrameCount / KeyframeRate);
+  for (auto Position : Layout.Clusters)
+    CHECK(IdAt(Elements, Position) == EBML_ID(KaxCluster).GetValue());
+
+  // the elements are found through the SeekHeads
+  KaxSegmentLoader Loader(Stream, Segment);
+  CHECK(Loader.ReadSeekHeads());
+  CHECK(Loader.GetPosition(EBML_INFO(KaxInfo)) == Layout.InfoPosition);
+  CHECK(Loader.GetPosition(EBML_INFO(KaxCues)) == aCuesAt);
+  CHECK(Loader.Load<KaxInfo>() != nullptr);
+  CHECK(Loader.Load<KaxTracks>() != nullptr);
+
+  const auto Cues = Loader.Load<KaxCues>();
+  CHECK(Cues != nullptr);
+  if (Cues == nullptr)
+    return;
+
+  // one CuePoint per keyframe, pointing at the Cluster holding it
+  const auto & Index = Cues->GetIndex();
+  CHECK(Index.size() == FrameCount / KeyframeRate);
+  for (std::size_t i = 0; i < Index.size() && i < Layout.Clusters.size(); i++) {
+    CHECK(Index[i].Track == 1);
+    CHECK(Index[i].Time * TimestampScale == i * KeyframeRate * 40000000ULL);
+    CHECK(Segment.GetGlobalPosition(Index[i].ClusterPosition) == Layout.Clusters[i]);
+  }
+}
+
+void TestInPlace()
+{
+  CurrentTest = "SeekHead and Cues in their room";
+  MemIOCallback File;
+  const auto Layout = WriteSegment(File, KaxSegmentFinalizer::EstimateCuesSize(4000000000, 1.0), 256);
+  CHECK(Layout.bInPlace);
+  CHECK(Layout.CuesPosition < Layout.InfoPosition);
+  CheckSegment(File, Layout, Layout.CuesPosition);
+}
+
+void TestCuesAppended()
+{
+  CurrentTest = "Cues too large for their room";
+  MemIOCallback File;
+  const auto Layout = WriteSegment(File, 16, 256);
+  CHECK(!Layout.bInPlace);
+  CHECK(!Layout.Clusters.empty());
+  // the Cues are after the last Cluster, its end isn't known here, search for them
+  MemReadIOCallback Input(File.GetDataBuffer(), File.GetDataBufferSize());
+  EbmlStream Stream(Input);
+  std::unique_ptr<EbmlElement> Found(Stream.FindNextID(EBML_INFO(KaxSegment), UINT64_MAX));
+  CHECK(Found != nullptr);
+  if (Found == nullptr)
+    return;
+  std::vector<KaxSegmentLoader::Entry> Elements;
+  CHECK(ReadTopLevel(Stream, static_cast<KaxSegment &>(*Found), Elements));
+  CHECK(!Elements.empty() && Elements.back().Id == EBML_ID(KaxCues).GetValue());
+  CHECK(IdAt(Elements, Layout.CuesPosition) == EBML_ID(EbmlVoid).GetValue());
+  if (!Elements.empty())
+    CheckSegment(File, Layout, Elements.back().Position);
+}
+
+void TestSeekHeadForwarded()
+{
+  CurrentTest = "SeekHead too large for its room";
+  MemIOCallback File;
+  const auto Layout = WriteSegment(File, KaxSegmentFinalizer::EstimateCuesSize(4000000000, 1.0), 40);
+  CHECK(!Layout.bInPlace);
+  // the SeekHead in the room only points to the one at the end
+  CheckSegment(File, Layout, Layout.CuesPosition);
+}
+
+} // namespace
+
+int main()
+{
+  TestInPlace();
+  TestCuesAppended();
+  TestSeekHeadForwarded();
+
+  if (Failures) {
+    std::fprintf(stderr, "%d checks failed\n", Failures);
+    return 1;
+  }
+  std::printf("all finalize checks passed\n");
+  return 0;
+}
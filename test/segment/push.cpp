@@ -0,0 +1,242 @@
+// Copyright © 2002-2010 Steve Lhomme.
+// SPDX-License-Identifier: LGPL-2.1-or-later
+
+/*!
+  \file
+  \brief Segments parsed with KaxPushParser, fed in chunks of any size
+  \author Steve Lhomme     <robux4 @ users.sf.net>
+*/
+
+#include "matroska/KaxCluster.h"
+#include "matroska/KaxClusterWriter.h"
+#include "matroska/KaxCues.h"
+#include "matroska/KaxPushParser.h"
+#include "matroska/KaxSegment.h"
+#include "matroska/KaxSegmentFinalizer.h"
+#include "matroska/KaxSemantic.h"
+
+#include <ebml/EbmlHead.h>
+#include <ebml/MemIOCallback.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace libebml;
+using namespace libmatroska;
+
+namespace {
+
+int Failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      std::fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, CurrentTest, #cond); \
+      Failures++; \
+    } \
+  } while (0)
+
+const char * CurrentTest = "";
+
+constexpr std::uint64_t TimestampScale = 1000000;
+constexpr unsigned int  FrameCount     = 60;
+
+/*!
+  \brief write an EBML header and a Segment of one video track in \a File
+  \param bLive write Clusters with an unknown size
+  \note every third frame has a duration and is written in a BlockGroup
+  \return the number of Clusters written
+*/
+unsigned int WriteFile(MemIOCallback & File, bool bLive)
+{
+  unsigned int Clusters = 0;
+  EbmlHead Head;
+  GetChild<EDocType>(Head).SetValue("matroska");
+  GetChild<EDocTypeVersion>(Head).SetValue(4);
+  GetChild<EDocTypeReadVersion>(Head).SetValue(2);
+  Head.Render(File);
+
+  KaxSegment Segment;
+  KaxCues Cues;
+  KaxSegmentFinalizer Finalizer(File, Segment, Cues);
+  Finalizer.Start(KaxSegmentFinalizer::EstimateCuesSize(3000000000, 1.0), 256);
+
+  KaxInfo Info;
+  GetChild<KaxTimestampScale>(Info).SetValue(TimestampScale);
+  GetChild<KaxMuxingApp>(Info).SetValue(UTFstring{L"push test"});
+  GetChild<KaxWritingApp>(Info).SetValue(UTFstring{L"push test"});
+  Info.Render(File);
+  Finalizer.Index(Info);
+
+  KaxTracks Tracks;
+  auto & Track = GetChild<KaxTrackEntry>(Tracks);
+  Track.SetGlobalTimestampScale(TimestampScale);
+  GetChild<KaxTrackNumber>(Track).SetValue(1);
+  GetChild<KaxTrackUID>(Track).SetValue(1);
+  GetChild<KaxTrackType>(Track).SetValue(track_video);
+  GetChild<KaxCodecID>(Track).SetValue("V_TEST");
+  Tracks.Render(File);
+  Finalizer.Index(Tracks);
+
+  {
+    KaxClusterWriter Writer(File, Segment, Cues, TimestampScale);
+    Writer.SetMaxClusterDuration(499000000);
+    Writer.EnableClusterCrc32();
+    Writer.SetLiveMode(bLive);
+    Writer.SetClusterCallback([&Clusters](const KaxCluster &, std::uint64_t, std::uint64_t) { Clusters++; });
+    for (unsigned int i = 0; i < FrameCount; i++) {
+      const std::uint32_t Size = 50 + 7 * i;
+      auto Data = std::make_unique<binary[]>(Size);
+      std::memset(Data.get(), static_cast<int>(i), Size);
+      Writer.AddFrame(Track, i * 40000000ULL, FrameBuffer(std::move(Data), Size), i % 10 == 0, i % 3 == 2 ? 40000000 : 0);
+    }
+    Writer.Flush();
+  }
+
+  Finalizer.Finish();
+  return Clusters;
+}
+
+/// the calls received from the parser, as text, with a copy of the data given
+class RecordingHandler : public KaxPushParser::Handler {
+  public:
+    std::vector<std::string> Calls;
+    unsigned int             Blocks{0};
+    unsigned int             BlocksInChunk{0}; ///< Blocks given from the memory of the chunk being fed
+    const binary *           ChunkStart{nullptr};
+    const binary *           ChunkEnd{nullptr};
+
+    void OnSegment(std::uint64_t Position, std::uint64_t DataStart, std::uint64_t Size, bool bUnknownSize) override {
+      Add("Segment %" PRIu64 " %" PRIu64 " %" PRIu64 " %d", Position, DataStart, Size, bUnknownSize);
+    }
+    void OnSegmentEnd(std::uint64_t EndPosition) override {
+      Add("SegmentEnd %" PRIu64, EndPosition);
+    }
+    bool OnElementHead(std::uint32_t Id, std::uint64_t Position, std::uint64_t Size) override {
+      Add("ElementHead %X %" PRIu64 " %" PRIu64, Id, Position, Size);
+      return true;
+    }
+    void OnElement(std::uint32_t Id, std::uint64_t Position, const binary * Data, std::size_t Size) override {
+      Add("Element %X %" PRIu64, Id, Position);
+      Calls.back().append(reinterpret_cast<const char *>(Data), Size);
+    }
+    void OnCluster(std::uint64_t Position, bool bUnknownSize) override {
+      Add("Cluster %" PRIu64 " %d", Position, bUnknownSize);
+    }
+    void OnClusterTimestamp(std::uint64_t Timestamp) override {
+      Add("ClusterTimestamp %" PRIu64, Timestamp);
+    }
+    void OnBlock(const KaxBlockRecord & Record, const binary * Element, std::size_t ElementSize) override {
+      Add("Block %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %d %d %d %" PRIu64,
+          Record.ElementPosition, Record.BlockPosition, Record.PayloadPosition, Record.PayloadSize,
+          Record.Timestamp, Record.TrackNumber, Record.IsSimpleBlock, Record.IsKeyframe,
+          Record.HasDuration, Record.HasDuration ? Record.Duration : 0);
+      Calls.back().append(reinterpret_cast<const char *>(Element), ElementSize);
+      Blocks++;
+      if (Element >= ChunkStart && Element + ElementSize <= ChunkEnd)
+        BlocksInChunk++;
+    }
+    void OnClusterEnd(std::uint64_t EndPosition) override {
+      Add("ClusterEnd %" PRIu64, EndPosition);
+    }
+
+  private:
+    template <typename... Args>
+    void Add(const char * Format, Args... args) {
+      char Text[256];
+      std::snprintf(Text, sizeof(Text), Format, args...);
+      Calls.emplace_back(Text);
+    }
+};
+
+/*!
+  \brief parse \a File fed in the chunks given by \a NextSize
+  \return false if the parser failed or didn't end cleanly
+*/
+template <typename SizeFunction>
+bool Parse(const MemIOCallback & File, RecordingHandler & Handler, SizeFunction NextSize)
+{
+  KaxPushParser Parser(Handler);
+  const binary * Data = File.GetDataBuffer();
+  std::size_t Remaining = File.GetDataBufferSize();
+  while (Remaining != 0) {
+    const std::size_t Size = std::min<std::size_t>(NextSize(), Remaining);
+    // each chunk is a separate buffer, only valid during the call
+    std::vector<binary> Chunk(Data, Data + Size);
+    Handler.ChunkStart = Chunk.data();
+    Handler.ChunkEnd   = Chunk.data() + Chunk.size();
+    if (!Parser.Feed(Chunk.data(), Chunk.size()))
+      return false;
+    Data      += Size;
+    Remaining -= Size;
+  }
+  Handler.ChunkStart = Handler.ChunkEnd = nullptr;
+  return Parser.Finish() && Parser.GetPendingSize() == 0;
+}
+
+void CheckChunks(const char * Name, bool bLive)
+{
+  CurrentTest = Name;
+  MemIOCallback File;
+  const unsigned int Clusters = WriteFile(File, bLive);
+  CHECK(Clusters > 1);
+  const std::size_t FileSize = File.GetDataBufferSize();
+
+  RecordingHandler Whole;
+  CHECK(Parse(File, Whole, [FileSize]() { return FileSize; }));
+  CHECK(Whole.Blocks == FrameCount);
+  CHECK(Whole.BlocksInChunk == FrameCount);
+  CHECK(std::count_if(Whole.Calls.begin(), Whole.Calls.end(),
+                      [](const std::string & Call) { return Call.compare(0, 8, "Cluster ") == 0; }) == static_cast<std::ptrdiff_t>(Clusters));
+  CHECK(!Whole.Calls.empty() && Whole.Calls.back().compare(0, 11, "SegmentEnd ") == 0);
+
+  RecordingHandler Bytes;
+  CHECK(Parse(File, Bytes, []() { return std::size_t{1}; }));
+  CHECK(Bytes.Calls == Whole.Calls);
+
+  std::mt19937 Random(1234);
+  std::uniform_int_distribution<std::size_t> ChunkSize(1, 700);
+  for (int Run = 0; Run < 20; Run++) {
+    RecordingHandler Chunked;
+    CHECK(Parse(File, Chunked, [&]() { return ChunkSize(Random); }));
+    CHECK(Chunked.Calls == Whole.Calls);
+  }
+
+  // split in the first Block, the elements after it are parsed in the second chunk without copy
+  std::size_t FirstBlock = 0;
+  for (const auto & Call : Whole.Calls) {
+    if (std::sscanf(Call.c_str(), "Block %zu", &FirstBlock) == 1)
+      break;
+  }
+  CHECK(FirstBlock != 0);
+  RecordingHandler Split;
+  bool bFirst = true;
+  CHECK(Parse(File, Split, [&]() {
+    const std::size_t Size = bFirst ? FirstBlock + 2 : FileSize;
+    bFirst = false;
+    return Size;
+  }));
+  CHECK(Split.Calls == Whole.Calls);
+  CHECK(Split.BlocksInChunk == FrameCount - 1);
+}
+
+} // namespace
+
+int main()
+{
+  CheckChunks("sized Clusters", false);
+  CheckChunks("live Clusters", true);
+
+  if (Failures) {
+    std::fprintf(stderr, "%d checks failed\n", Failures);
+    return 1;
+  }
+  std::printf("all push parser checks passed\n");
+  return 0;
+}